@@ -0,0 +1,113 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../include/BVH.hpp"
+#include "../include/Mesh.hpp"
+
+// 比较LinearBVH与CompressedBVH的节点内存和求交速度
+// 用法：bvhbench [三角形数] [光线数]
+int main(int argc, char** argv) {
+  size_t triangleNum = argc > 1 ? std::atol(argv[1]) : 200000;
+  size_t rayNum = argc > 2 ? std::atol(argv[2]) : 500000;
+
+  // 边长100的立方体内随机分布的小三角形
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> uniform(0, 1);
+  sre::Mesh mesh;
+  sre::Material m;
+  uint32_t materialId = mesh.addMaterial(m);
+  uint32_t texcoordId = mesh.addTexCoord(sre::Vec2<float>(0, 0));
+  for (size_t i = 0; i < triangleNum; i++) {
+    sre::Vec3<float> c(100 * uniform(rng), 100 * uniform(rng),
+                       100 * uniform(rng));
+    sre::Vec3<float> p[3];
+    for (int k = 0; k < 3; k++) {
+      p[k] = c + sre::Vec3<float>(uniform(rng) - 0.5f, uniform(rng) - 0.5f,
+                                  uniform(rng) - 0.5f) *
+                     2.0f;
+    }
+    sre::TriangleIndex index;
+    for (int k = 0; k < 3; k++) {
+      index.v[k] = mesh.addPosition(p[k]);
+      index.vt[k] = texcoordId;
+    }
+    // 法向量朝向立方体中心，即光线射来的方向
+    sre::Vec3<float> n = sre::Vec3<float>::cross(p[1] - p[0], p[2] - p[0]);
+    if (sre::Vec3<float>::dot(n, c - sre::Vec3<float>(50, 50, 50)) > 0) {
+      n = -n;
+    }
+    index.n = mesh.addNormal(n);
+    index.materialId = materialId;
+    mesh.addTriangle(index);
+  }
+  mesh.finalize();
+  std::vector<sre::Hittable*> objects;
+  for (const sre::Triangle& triangle : mesh.getTriangles()) {
+    objects.push_back(const_cast<sre::Triangle*>(&triangle));
+  }
+
+  // 从立方体中心附近向随机方向发射
+  std::vector<sre::Ray> rays;
+  rays.reserve(rayNum);
+  for (size_t i = 0; i < rayNum; i++) {
+    sre::Vec3<float> o(40 + 20 * uniform(rng), 40 + 20 * uniform(rng),
+                       40 + 20 * uniform(rng));
+    sre::Vec3<float> d(uniform(rng) - 0.5f, uniform(rng) - 0.5f,
+                       uniform(rng) - 0.5f);
+    rays.emplace_back(o, sre::Vec3<float>::normalize(d));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  sre::LinearBVH linear(objects);
+  std::chrono::duration<double> linearBuild =
+      std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  sre::CompressedBVH compressed(linear, &mesh);
+  std::chrono::duration<double> compressedBuild =
+      std::chrono::steady_clock::now() - start;
+
+  auto trace = [&](const sre::Hittable& bvh, std::vector<sre::HitResult>& res) {
+    res.assign(rays.size(), sre::HitResult());
+    auto start = std::chrono::steady_clock::now();
+#pragma omp parallel for schedule(dynamic, 1024)
+    for (int i = 0; i < static_cast<int>(rays.size()); i++) {
+      bvh.hit(rays[i], res[i]);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+  };
+  std::vector<sre::HitResult> linearRes, compressedRes;
+  double linearTime = trace(linear, linearRes);
+  double compressedTime = trace(compressed, compressedRes);
+
+  // 两种布局的最近交点必须一致
+  size_t hitNum = 0, mismatches = 0;
+  for (size_t i = 0; i < rays.size(); i++) {
+    const sre::HitResult& a = linearRes[i];
+    const sre::HitResult& b = compressedRes[i];
+    hitNum += a.isHit;
+    if (a.isHit != b.isHit || (a.isHit && a.distance != b.distance)) {
+      mismatches++;
+    }
+  }
+
+  size_t linearBytes = linear.getNodeNum() * sizeof(sre::LinearBVHNode);
+  size_t compressedBytes = compressed.getMemorySize();
+  std::cout << "triangles: " << triangleNum << '\n'
+            << "rays: " << rayNum << " (hit " << hitNum << ")" << '\n'
+            << "linear BVH: " << linear.getNodeNum() << " nodes, "
+            << linearBytes / 1024 << "KB, build " << linearBuild.count()
+            << "s, " << rayNum / linearTime / 1e6 << " Mrays/s" << '\n'
+            << "compressed BVH: " << compressed.getNodeNum() << " nodes, "
+            << compressedBytes / 1024 << "KB, build "
+            << compressedBuild.count() << "s, "
+            << rayNum / compressedTime / 1e6 << " Mrays/s" << '\n'
+            << "memory ratio: "
+            << static_cast<double>(compressedBytes) / linearBytes << '\n'
+            << "mismatches: " << mismatches << std::endl;
+  return mismatches == 0 ? 0 : 1;
+}
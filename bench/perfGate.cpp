@@ -0,0 +1,380 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// 性能回归检查：比较基线与本次的sre_bench或sre_quality结果
+// 用法：sre_gate <基线JSON> <本次JSON> [容差=0.05] [置信度=0.95]
+// 每一项用各次重复的耗时求均值差的单侧置信区间（Welch），
+// 只有在给定置信度下确实慢了超过容差才算回归；sre_quality的relMSE
+// 用两边记录的标准误差做同样的单侧检验，改动采样引起的正常波动不算回归，
+// 没有标准误差时直接比较，超过容差即为回归（误差变大）。
+// 基线中没有耗时的项（如提交的误差基线）只比较relMSE。
+// 有回归、基线中的项缺失或基线文件不存在时返回1，缺少基线不会被当作通过
+
+// 只支持基准输出用到的JSON子集：对象、数组、数字、字符串
+struct JsonValue {
+  enum Type { NUMBER, STRING, ARRAY, OBJECT } type = NUMBER;
+  double number = 0;
+  std::string string;
+  std::vector<JsonValue> array;
+  std::vector<std::pair<std::string, JsonValue>> object;
+
+  const JsonValue* find(const std::string& key) const {
+    for (const auto& member : object) {
+      if (member.first == key) {
+        return &member.second;
+      }
+    }
+    return nullptr;
+  }
+};
+
+static void skipSpace(const std::string& s, size_t& i) {
+  while (i < s.size() && std::isspace(static_cast<unsigned char>(s[i]))) {
+    i++;
+  }
+}
+
+static bool parseValue(const std::string& s, size_t& i, JsonValue& value);
+
+static bool parseString(const std::string& s, size_t& i, std::string& out) {
+  if (s[i] != '"') {
+    return false;
+  }
+  for (i++; i < s.size() && s[i] != '"'; i++) {
+    if (s[i] == '\\' && i + 1 < s.size()) {
+      i++;
+    }
+    out += s[i];
+  }
+  if (i >= s.size()) {
+    return false;
+  }
+  i++;
+  return true;
+}
+
+static bool parseValue(const std::string& s, size_t& i, JsonValue& value) {
+  skipSpace(s, i);
+  if (i >= s.size()) {
+    return false;
+  }
+  if (s[i] == '"') {
+    value.type = JsonValue::STRING;
+    return parseString(s, i, value.string);
+  }
+  if (s[i] == '[' || s[i] == '{') {
+    bool isObject = s[i] == '{';
+    char close = isObject ? '}' : ']';
+    value.type = isObject ? JsonValue::OBJECT : JsonValue::ARRAY;
+    i++;
+    skipSpace(s, i);
+    if (i < s.size() && s[i] == close) {
+      i++;
+      return true;
+    }
+    while (i < s.size()) {
+      JsonValue element;
+      std::string key;
+      if (isObject) {
+        skipSpace(s, i);
+        if (!parseString(s, i, key)) {
+          return false;
+        }
+        skipSpace(s, i);
+        if (i >= s.size() || s[i++] != ':') {
+          return false;
+        }
+      }
+      if (!parseValue(s, i, element)) {
+        return false;
+      }
+      if (isObject) {
+        value.object.emplace_back(key, element);
+      } else {
+        value.array.push_back(element);
+      }
+      skipSpace(s, i);
+      if (i < s.size() && s[i] == ',') {
+        i++;
+      } else if (i < s.size() && s[i] == close) {
+        i++;
+        return true;
+      } else {
+        return false;
+      }
+    }
+    return false;
+  }
+  char* end = nullptr;
+  value.type = JsonValue::NUMBER;
+  value.number = std::strtod(s.c_str() + i, &end);
+  if (end == s.c_str() + i) {
+    return false;
+  }
+  i = end - s.c_str();
+  return true;
+}
+
+static bool loadJson(const std::string& fileName, JsonValue& root) {
+  std::ifstream ifs(fileName);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << ifs.rdbuf();
+  std::string s = buffer.str();
+  size_t i = 0;
+  return parseValue(s, i, root) && root.type == JsonValue::OBJECT;
+}
+
+// 一项测量：各次重复的耗时（越小越好），以及可选的确定性误差
+struct Measurement {
+  std::vector<double> runs;
+  double error = -1;  // relMSE，小于0表示没有
+  double errorStdErr = 0;  // relMSE的标准误差
+};
+
+static std::vector<double> getNumbers(const JsonValue* value) {
+  std::vector<double> numbers;
+  if (value != nullptr) {
+    for (const JsonValue& element : value->array) {
+      numbers.push_back(element.number);
+    }
+  }
+  return numbers;
+}
+
+// 按"场景/内核"或"场景/spp"展开两种基准的结果
+static std::map<std::string, Measurement> collect(const JsonValue& root) {
+  std::map<std::string, Measurement> measurements;
+  const JsonValue* scenes = root.find("scenes");
+  if (scenes == nullptr) {
+    return measurements;
+  }
+  for (const JsonValue& scene : scenes->array) {
+    const JsonValue* name = scene.find("name");
+    std::string prefix = name != nullptr ? name->string + "/" : "/";
+    if (const JsonValue* kernels = scene.find("kernels")) {
+      for (const JsonValue& kernel : kernels->array) {
+        const JsonValue* kernelName = kernel.find("name");
+        Measurement& m =
+            measurements[prefix + (kernelName ? kernelName->string : "")];
+        m.runs = getNumbers(kernel.find("runs_ns"));
+      }
+    }
+    if (const JsonValue* curve = scene.find("curve")) {
+      for (const JsonValue& point : curve->array) {
+        const JsonValue* spp = point.find("spp");
+        Measurement& m = measurements[
+            prefix + std::to_string(spp ? static_cast<long>(spp->number) : 0) +
+            "spp"];
+        m.runs = getNumbers(point.find("runs_s"));
+        if (m.runs.empty()) {
+          if (const JsonValue* seconds = point.find("seconds")) {
+            m.runs.push_back(seconds->number);
+          }
+        }
+        if (const JsonValue* relMSE = point.find("relmse")) {
+          m.error = relMSE->number;
+        }
+        if (const JsonValue* stdErr = point.find("relmse_stderr")) {
+          m.errorStdErr = stdErr->number;
+        }
+      }
+    }
+  }
+  return measurements;
+}
+
+static void getMoments(const std::vector<double>& runs, double& mean,
+                       double& variance) {
+  mean = 0;
+  variance = 0;
+  for (double run : runs) {
+    mean += run / runs.size();
+  }
+  for (double run : runs) {
+    variance += (run - mean) * (run - mean);
+  }
+  variance = runs.size() > 1 ? variance / (runs.size() - 1) : 0;
+}
+
+// 标准正态分布的分位数（Acklam的有理逼近）
+static double normalQuantile(double p) {
+  static const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02,
+                             -2.759285104469687e+02, 1.383577518672690e+02,
+                             -3.066479806614716e+01, 2.506628277459239e+00};
+  static const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02,
+                             -1.556989798598866e+02, 6.680131188771972e+01,
+                             -1.328068155288572e+01};
+  static const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01,
+                             -2.400758277161838e+00, -2.549732539343734e+00,
+                             4.374664141464968e+00,  2.938163982698783e+00};
+  static const double d[] = {7.784695709041462e-03, 3.224671290700398e-01,
+                             2.445134137142996e+00, 3.754408661907416e+00};
+  if (p < 0.02425) {
+    double q = std::sqrt(-2 * std::log(p));
+    return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q +
+            c[5]) /
+           ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+  }
+  if (p > 1 - 0.02425) {
+    return -normalQuantile(1 - p);
+  }
+  double q = p - 0.5, r = q * q;
+  return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) *
+         q /
+         (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+// 自由度为df的t分布的分位数（Cornish-Fisher展开）
+static double tQuantile(double p, double df) {
+  double z = normalQuantile(p);
+  double z3 = z * z * z, z5 = z3 * z * z;
+  return z + (z3 + z) / (4 * df) + (5 * z5 + 16 * z3 + 3 * z) / (96 * df * df);
+}
+
+// relMSE的差减去置信度对应的波动后仍超过容差才判为变差
+static bool isWorse(const Measurement& base, const Measurement& cur,
+                    double tolerance, double confidence) {
+  if (base.error <= 0 || cur.error < 0) {
+    return false;
+  }
+  double se = std::sqrt(base.errorStdErr * base.errorStdErr +
+                        cur.errorStdErr * cur.errorStdErr);
+  double lower = cur.error - base.error - normalQuantile(confidence) * se;
+  return lower > base.error * tolerance;
+}
+
+static void printError(const Measurement& base, const Measurement& cur) {
+  std::cout << "relMSE " << base.error << " -> " << cur.error;
+  if (base.errorStdErr > 0 || cur.errorStdErr > 0) {
+    std::cout << " (stderr " << base.errorStdErr << ", " << cur.errorStdErr
+              << ")";
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cout << "Usage: sre_gate <baseline.json> <current.json> "
+                 "[tolerance] [confidence]"
+              << std::endl;
+    return 2;
+  }
+  double tolerance = argc > 3 ? std::atof(argv[3]) : 0.05;
+  double confidence = argc > 4 ? std::atof(argv[4]) : 0.95;
+
+  JsonValue baselineRoot, currentRoot;
+  if (!std::ifstream(argv[1]).is_open()) {
+    // 耗时基线与机器有关，不随代码提交，每台机器要先生成自己的
+    std::cout << "No baseline: " << argv[1] << '\n'
+              << "Timing baselines are per machine and not committed; build "
+                 "the perf_baseline target on this machine (on the commit to "
+                 "compare against) and run the gate again."
+              << std::endl;
+    return 1;
+  }
+  if (!loadJson(argv[1], baselineRoot)) {
+    std::cout << "Baseline loading fails: " << argv[1] << std::endl;
+    return 1;
+  }
+  if (!loadJson(argv[2], currentRoot)) {
+    std::cout << "Benchmark results loading fails: " << argv[2] << std::endl;
+    return 1;
+  }
+  // 参考图的spp不同时误差不可比
+  const JsonValue* baseReference = baselineRoot.find("reference_spp");
+  const JsonValue* curReference = currentRoot.find("reference_spp");
+  if (baseReference != nullptr && curReference != nullptr &&
+      baseReference->number != curReference->number) {
+    std::cout << "Reference spp differs: " << baseReference->number << " vs "
+              << curReference->number << std::endl;
+    return 1;
+  }
+  std::map<std::string, Measurement> baseline = collect(baselineRoot);
+  std::map<std::string, Measurement> current = collect(currentRoot);
+
+  int regressions = 0;
+  for (const auto& entry : baseline) {
+    const std::string& key = entry.first;
+    const Measurement& base = entry.second;
+    auto it = current.find(key);
+    if (it == current.end() || it->second.runs.empty()) {
+      std::cout << "MISSING  " << key << '\n';
+      regressions++;
+      continue;
+    }
+    const Measurement& cur = it->second;
+    if (base.runs.empty()) {
+      // 只有误差的基线与机器无关，不比较耗时
+      if (base.error > 0) {
+        bool worse = isWorse(base, cur, tolerance, confidence);
+        std::cout << (worse ? "REGRESS  " : "OK       ") << key << ": ";
+        printError(base, cur);
+        std::cout << '\n';
+        regressions += worse;
+      }
+      continue;
+    }
+
+    // 均值差的单侧置信下界：下界都超过容差才判为变慢
+    double mb, vb, mc, vc;
+    getMoments(base.runs, mb, vb);
+    getMoments(cur.runs, mc, vc);
+    double sb = vb / base.runs.size(), sc = vc / cur.runs.size();
+    double se = std::sqrt(sb + sc);
+    double margin = 0;
+    if (se > 0) {
+      // Welch-Satterthwaite自由度，只有一次重复的一方方差记为0
+      double df = (sb + sc) * (sb + sc) /
+                  ((base.runs.size() > 1 ? sb * sb / (base.runs.size() - 1)
+                                         : 0) +
+                   (cur.runs.size() > 1 ? sc * sc / (cur.runs.size() - 1)
+                                        : 0));
+      margin = tQuantile(confidence, std::max(df, 1.0)) * se;
+    }
+    double diff = mc - mb;
+    double change = mb > 0 ? diff / mb : 0;
+    double lower = mb > 0 ? (diff - margin) / mb : 0;
+    double upper = mb > 0 ? (diff + margin) / mb : 0;
+    bool slower = lower > tolerance;
+    bool faster = upper < -tolerance;
+    bool worse = isWorse(base, cur, tolerance, confidence);
+
+    const char* verdict =
+        slower || worse ? "REGRESS  " : faster ? "FASTER   " : "OK       ";
+    std::cout << verdict << key << ": " << mb << " -> " << mc << " (" << change * 100
+              << "%, CI [" << lower * 100 << "%, " << upper * 100 << "%])";
+    if (base.error > 0) {
+      std::cout << ", ";
+      printError(base, cur);
+    }
+    std::cout << '\n';
+    regressions += slower || worse;
+  }
+  for (const auto& entry : current) {
+    if (baseline.find(entry.first) == baseline.end()) {
+      std::cout << "NEW      " << entry.first << '\n';
+    }
+  }
+
+  std::cout << std::endl;
+  if (regressions > 0) {
+    std::cout << "Performance regression: " << regressions << " of "
+              << baseline.size() << " measurements exceed "
+              << tolerance * 100 << "% at " << confidence * 100
+              << "% confidence" << std::endl;
+    return 1;
+  }
+  std::cout << "Performance gate passed: " << baseline.size()
+            << " measurements within " << tolerance * 100 << "%" << std::endl;
+  return 0;
+}
@@ -0,0 +1,223 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/FrameBuffer.hpp"
+#include "../include/HDRFile.hpp"
+#include "../include/Random.hpp"
+#include "../include/Trace.hpp"
+
+// 时间-质量基准：在自带的示例场景上以1、2、4……spp渲染，与高spp参考图比较
+// RMSE和relMSE，输出误差-时间曲线以及效率 1 / (relMSE * 秒)
+// 参考图不存在时先渲染并保存为PFM，之后的运行直接读取
+// 用法：sre_quality [输出JSON] [参考spp] [最大spp] [example目录] [参考图目录]
+//                   [重复次数]
+// 只计渲染时间，不计场景加载；重复渲染时随机数种子相同，误差不变，时间取平均
+// 重复次数为0时只渲染一次且不输出耗时，得到与机器无关的误差基线
+// relMSE的标准误差由各像素误差的方差估计（像素的样本互相独立），
+// 作为换种子或改动采样时relMSE正常波动的范围
+
+struct Scene {
+  std::string name;
+  std::string path;
+  std::vector<std::string> models;
+  std::string config;
+};
+
+// 一个预算下的结果
+struct QualityPoint {
+  size_t samples;
+  double seconds;
+  std::vector<double> runs;  // 每次重复的秒数
+  double rmse;
+  double relMSE;
+  double relMSEError;  // relMSE的标准误差
+  double efficiency;
+};
+
+// 参考图使用的随机数种子，与被测渲染的样本不相关
+static const uint64_t REFERENCE_SEED = 0x5eed;
+// relMSE分母中的偏移，避免暗像素主导误差
+static const double REL_EPSILON = 1e-2;
+
+static bool readReference(const std::string& fileName, int width, int height,
+                          std::vector<float>& reference) {
+  sre::HDRReader reader;
+  if (!reader.open(fileName) || reader.getWidth() != width ||
+      reader.getHeight() != height) {
+    return false;
+  }
+  size_t n = static_cast<size_t>(width) * height;
+  reference.resize(n * 3);
+  for (int y = 0; y < height; y++) {
+    float* row = &reference[static_cast<size_t>(y) * width];
+    if (!reader.readLine(y, row, row + n, row + 2 * n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  std::string outName = argc > 1 ? argv[1] : "sre_quality.json";
+  size_t referenceSamples = argc > 2 ? std::atol(argv[2]) : 1024;
+  size_t maxSamples = argc > 3 ? std::atol(argv[3]) : 64;
+  std::string exampleDir = argc > 4 ? argv[4] : "../example/";
+  std::string referenceDir = argc > 5 ? argv[5] : "./";
+  size_t repeats = argc > 6 ? std::max(std::atol(argv[6]), 0l) : 1;
+  bool timed = repeats > 0;
+  if (!exampleDir.empty() && exampleDir.back() != '/') {
+    exampleDir += '/';
+  }
+  if (!referenceDir.empty() && referenceDir.back() != '/') {
+    referenceDir += '/';
+  }
+
+  std::vector<Scene> scenes = {
+      {"simple-cornell-box",
+       "simple cornell-box/",
+       {"floor.obj", "light.obj", "left.obj", "right.obj", "shortbox.obj",
+        "tallbox.obj"},
+       "cornell-box.xml"},
+      {"veach-mis", "veach-mis/", {"veach-mis.obj"}, "veach-mis.xml"},
+      {"staircase", "staircase/", {"stairscase.obj"}, "staircase.xml"},
+      {"wood-block", "wood-block/", {"wood-block.obj"}, "wood-block.xml"},
+  };
+
+  std::ofstream ofs(outName);
+  if (!ofs.is_open()) {
+    std::cout << "Benchmark file opening fails: " << outName << std::endl;
+    return 1;
+  }
+  ofs << "{\n"
+      << "  \"benchmark\": \"sre_quality\",\n"
+      << "  \"reference_spp\": " << referenceSamples << ",\n"
+      << "  \"repeats\": " << repeats << ",\n"
+      << "  \"scenes\": [";
+
+  bool firstScene = true;
+  for (const Scene& scene : scenes) {
+    std::string path = exampleDir + scene.path;
+    // 每个预算都新建Tracer，场景缓存让重复加载只需映射文件
+    std::string cacheName = referenceDir + scene.name + ".cache";
+    std::string referenceName = referenceDir + scene.name + "-" +
+                                std::to_string(referenceSamples) + "spp.pfm";
+
+    std::vector<float> reference;
+    int width = 0, height = 0;
+    {
+      sre::Tracer tracer(3, referenceSamples);
+      tracer.setSceneCache(cacheName);
+      tracer.load(path, scene.models, scene.config);
+      if (tracer.getMesh().getTriangleNum() == 0) {
+        std::cout << "Benchmark scene loading fails: " << scene.name
+                  << std::endl;
+        continue;
+      }
+      width = tracer.getCamera().getWidth();
+      height = tracer.getCamera().getHeight();
+      if (!readReference(referenceName, width, height, reference)) {
+        std::cout << "Rendering reference: " << referenceName << std::endl;
+        sre::setRandomSeed(REFERENCE_SEED);
+        if (!tracer.render(referenceName) ||
+            !readReference(referenceName, width, height, reference)) {
+          std::cout << "Reference writing fails: " << referenceName
+                    << std::endl;
+          continue;
+        }
+      }
+    }
+
+    std::vector<QualityPoint> curve;
+    size_t n = static_cast<size_t>(width) * height;
+    for (size_t spp = 1; spp <= maxSamples; spp *= 2) {
+      sre::Tracer tracer(3, spp);
+      tracer.setSceneCache(cacheName);
+      tracer.load(path, scene.models, scene.config);
+      QualityPoint point;
+      point.samples = spp;
+      point.seconds = 0;
+      sre::FrameBuffer frame;
+      for (size_t r = 0; r < std::max<size_t>(repeats, 1); r++) {
+        sre::setRandomSeed(1);
+        auto start = std::chrono::steady_clock::now();
+        tracer.render(frame);
+        point.runs.push_back(std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count());
+        point.seconds += point.runs.back() / std::max<size_t>(repeats, 1);
+      }
+
+      // 三个通道来自同一条路径，以像素为单位统计relMSE的方差
+      double squared = 0, relative = 0, relativeSquared = 0;
+      for (size_t i = 0; i < n; i++) {
+        double pixel = 0;
+        for (int c = 0; c < 3; c++) {
+          double ref = reference[c * n + i];
+          double d = frame.getColorPlane(c)[i] - ref;
+          squared += d * d;
+          pixel += d * d / (ref * ref + REL_EPSILON) / 3;
+        }
+        relative += pixel;
+        relativeSquared += pixel * pixel;
+      }
+      point.rmse = std::sqrt(squared / (3 * n));
+      point.relMSE = relative / n;
+      double variance =
+          n > 1 ? (relativeSquared - relative * relative / n) / (n - 1) : 0;
+      point.relMSEError = std::sqrt(std::max(variance, 0.0) / n);
+      point.efficiency = point.relMSE > 0 && point.seconds > 0
+                             ? 1 / (point.relMSE * point.seconds)
+                             : 0;
+      curve.push_back(point);
+    }
+
+    std::cout << "quality " << scene.name << '\n';
+    ofs << (firstScene ? "\n" : ",\n") << "    {\n"
+        << "      \"name\": \"" << scene.name << "\",\n";
+    if (timed) {
+      ofs << "      \"reference\": \"" << referenceName << "\",\n";
+    }
+    ofs << "      \"width\": " << width << ",\n"
+        << "      \"height\": " << height << ",\n"
+        << "      \"curve\": [";
+    firstScene = false;
+    for (size_t k = 0; k < curve.size(); k++) {
+      const QualityPoint& p = curve[k];
+      std::cout << p.samples << " spp: " << p.seconds << "s, RMSE " << p.rmse
+                << ", relMSE " << p.relMSE << " +- " << p.relMSEError
+                << ", efficiency " << p.efficiency << '\n';
+      ofs << (k == 0 ? "\n" : ",\n") << "        {"
+          << "\"spp\": " << p.samples << ", ";
+      if (timed) {
+        ofs << "\"seconds\": " << p.seconds << ", ";
+      }
+      ofs << "\"rmse\": " << p.rmse << ", "
+          << "\"relmse\": " << p.relMSE << ", "
+          << "\"relmse_stderr\": " << p.relMSEError;
+      if (timed) {
+        ofs << ", \"efficiency\": " << p.efficiency << ", \"runs_s\": [";
+        for (size_t j = 0; j < p.runs.size(); j++) {
+          ofs << (j == 0 ? "" : ", ") << p.runs[j];
+        }
+        ofs << "]";
+      }
+      ofs << "}";
+    }
+    ofs << "\n      ]\n    }";
+    std::cout << std::endl;
+  }
+  ofs << "\n  ]\n}\n";
+  ofs.close();
+  if (!ofs.good()) {
+    std::cout << "Benchmark file writing fails: " << outName << std::endl;
+    return 1;
+  }
+  std::cout << "Benchmark results: " << outName << std::endl;
+  return 0;
+}
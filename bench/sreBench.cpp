@@ -0,0 +1,281 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/AABB.hpp"
+#include "../include/BVH.hpp"
+#include "../include/Light.hpp"
+#include "../include/Random.hpp"
+#include "../include/Trace.hpp"
+
+// 求交与遍历内核的微基准：在自带的示例场景上用固定的光线集合测量
+// 光线-三角形、光线-包围盒、最近交点遍历（首次击中、漫反射反弹）和遮挡遍历，
+// 结果（Mrays/s、ns/ray及分位数）写成JSON，便于逐次提交对比
+// 用法：sre_bench [输出JSON] [光线数] [重复次数] [example目录]
+// 单线程运行，数值只和内核本身有关
+
+struct Scene {
+  std::string name;
+  std::string path;
+  std::vector<std::string> models;
+  std::string config;
+};
+
+// 一个内核的测量结果，ns/ray按块统计分位数
+struct KernelResult {
+  std::string name;
+  size_t rays;
+  size_t hits;
+  double mraysPerSecond;
+  double nsPerRay;
+  double p50, p90, p99;
+  std::vector<double> runs;  // 每次重复的ns/ray
+};
+
+// 每块的光线数，块的耗时远大于计时器的开销
+static const size_t BLOCK_SIZE = 256;
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t k = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+  return values[k];
+}
+
+// kernel(i)处理第i条光线并返回是否命中；按块计时，重复repeats次
+static KernelResult measure(const std::string& name, size_t rayNum,
+                            size_t repeats,
+                            const std::function<bool(size_t)>& kernel) {
+  KernelResult result;
+  result.name = name;
+  result.rays = rayNum;
+  result.hits = 0;
+  std::vector<double> blocks;
+  double total = 0;
+  for (size_t r = 0; r < repeats; r++) {
+    size_t hits = 0;
+    double elapsed = 0;
+    for (size_t first = 0; first < rayNum; first += BLOCK_SIZE) {
+      size_t last = std::min(first + BLOCK_SIZE, rayNum);
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = first; i < last; i++) {
+        hits += kernel(i);
+      }
+      double ns = std::chrono::duration<double, std::nano>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+      blocks.push_back(ns / (last - first));
+      elapsed += ns;
+    }
+    result.hits = hits;
+    result.runs.push_back(rayNum > 0 ? elapsed / rayNum : 0);
+    total += elapsed;
+  }
+  double rays = static_cast<double>(rayNum) * repeats;
+  result.nsPerRay = rays > 0 ? total / rays : 0;
+  result.mraysPerSecond = total > 0 ? rays / total * 1e3 : 0;
+  result.p50 = percentile(blocks, 0.5);
+  result.p90 = percentile(blocks, 0.9);
+  result.p99 = percentile(blocks, 0.99);
+  return result;
+}
+
+int main(int argc, char** argv) {
+  std::string outName = argc > 1 ? argv[1] : "sre_bench.json";
+  size_t rayNum = argc > 2 ? std::atol(argv[2]) : 100000;
+  size_t repeats = argc > 3 ? std::atol(argv[3]) : 5;
+  std::string exampleDir = argc > 4 ? argv[4] : "../example/";
+  if (!exampleDir.empty() && exampleDir.back() != '/') {
+    exampleDir += '/';
+  }
+
+  std::vector<Scene> scenes = {
+      {"simple-cornell-box",
+       "simple cornell-box/",
+       {"floor.obj", "light.obj", "left.obj", "right.obj", "shortbox.obj",
+        "tallbox.obj"},
+       "cornell-box.xml"},
+      {"veach-mis", "veach-mis/", {"veach-mis.obj"}, "veach-mis.xml"},
+      {"staircase", "staircase/", {"stairscase.obj"}, "staircase.xml"},
+      {"wood-block", "wood-block/", {"wood-block.obj"}, "wood-block.xml"},
+  };
+
+  std::ofstream ofs(outName);
+  if (!ofs.is_open()) {
+    std::cout << "Benchmark file opening fails: " << outName << std::endl;
+    return 1;
+  }
+  ofs << "{\n"
+      << "  \"benchmark\": \"sre_bench\",\n"
+      << "  \"rays\": " << rayNum << ",\n"
+      << "  \"repeats\": " << repeats << ",\n"
+      << "  \"block_size\": " << BLOCK_SIZE << ",\n"
+      << "  \"scenes\": [";
+
+  bool firstScene = true;
+  for (const Scene& scene : scenes) {
+    sre::Tracer tracer;
+    tracer.load(exampleDir + scene.path, scene.models, scene.config);
+    const sre::LinearBVH* bvh = tracer.getBVH();
+    if (bvh == nullptr || bvh->getNodeNum() == 0) {
+      std::cout << "Benchmark scene loading fails: " << scene.name
+                << std::endl;
+      continue;
+    }
+    const sre::Camera& camera = tracer.getCamera();
+    const sre::Mesh& mesh = tracer.getMesh();
+    const std::vector<sre::Triangle>& triangles = mesh.getTriangles();
+
+    // 固定的光线集合：种子固定，每条光线按编号设置随机数状态
+    sre::setRandomSeed(1);
+    std::vector<sre::Ray> primary(rayNum);
+    std::vector<sre::HitResult> primaryHits(rayNum);
+    size_t pixels = static_cast<size_t>(camera.getWidth()) * camera.getHeight();
+    for (size_t i = 0; i < rayNum; i++) {
+      sre::seedRandom(i, 0, 0);
+      size_t pixel = i * 7919 % pixels;
+      primary[i] = camera.getRay(pixel / camera.getWidth(),
+                                 pixel % camera.getWidth());
+      bvh->hit(primary[i], primaryHits[i]);
+    }
+
+    // 首次击中点处余弦加权的反弹光线，以及指向光源采样点的阴影光线
+    sre::Light light;
+    for (const sre::Triangle& triangle : triangles) {
+      if (triangle.getMaterial().isEmissive()) {
+        light.setLight(triangle);
+      }
+    }
+    std::vector<sre::Ray> bounce, shadow;
+    for (size_t i = 0; i < rayNum; i++) {
+      const sre::HitResult& res = primaryHits[i];
+      if (!res.isHit) {
+        continue;
+      }
+      sre::seedRandom(i, 0, 1);
+      sre::Vec3<float> p = res.hitPoint + res.normal * 1e-4f;
+      bounce.emplace_back(p, sre::cosineDir(res.normal));
+      if (!light.empty() && !res.material->isEmissive()) {
+        sre::LightSample s;
+        light.sample(res.hitPoint, s);
+        shadow.push_back(sre::shadowRay(p, s.position));
+      }
+    }
+
+    // 光线-三角形：光线从三角形正面射向三角形上的随机点；光线-包围盒：BVH节点的包围盒
+    std::vector<sre::Ray> triangleRays(rayNum);
+    std::vector<size_t> triangleIds(rayNum);
+    for (size_t i = 0; i < rayNum; i++) {
+      sre::seedRandom(i, 0, 2);
+      size_t t = sre::randInt(static_cast<int>(triangles.size()));
+      const sre::TriangleIndex& index = mesh.getIndex(t);
+      float u = sre::randFloat(1), v = sre::randFloat(1);
+      if (u + v > 1) {
+        u = 1 - u;
+        v = 1 - v;
+      }
+      const sre::Vec3<float>& a = mesh.getPosition(index.v[0]);
+      sre::Vec3<float> target = a + (mesh.getPosition(index.v[1]) - a) * u +
+                                (mesh.getPosition(index.v[2]) - a) * v;
+      sre::Vec3<float> origin =
+          target + (mesh.getNormal(index.n) +
+                    sre::Vec3<float>(sre::randFloat(0.5f, -0.5f),
+                                     sre::randFloat(0.5f, -0.5f),
+                                     sre::randFloat(0.5f, -0.5f))) *
+                       (1 + sre::randFloat(4));
+      triangleRays[i] = sre::Ray(origin, target - origin);
+      triangleIds[i] = t;
+    }
+    const sre::LinearBVHNode* nodes = bvh->getNodes();
+    std::vector<sre::AABB> boxes;
+    for (size_t k = 0; k < bvh->getNodeNum(); k++) {
+      boxes.emplace_back(
+          sre::Vec3<float>(nodes[k].minXYZ[0], nodes[k].minXYZ[1],
+                           nodes[k].minXYZ[2]),
+          sre::Vec3<float>(nodes[k].maxXYZ[0], nodes[k].maxXYZ[1],
+                           nodes[k].maxXYZ[2]));
+    }
+
+    std::vector<KernelResult> results;
+    results.push_back(measure("ray-triangle", rayNum, repeats, [&](size_t i) {
+      sre::HitResult res;
+      triangles[triangleIds[i]].hit(triangleRays[i], res);
+      return res.isHit;
+    }));
+    results.push_back(measure("ray-aabb", rayNum, repeats, [&](size_t i) {
+      sre::HitResult res;
+      boxes[i % boxes.size()].hit(primary[i], res);
+      return res.isHit;
+    }));
+    results.push_back(
+        measure("closest-hit-primary", rayNum, repeats, [&](size_t i) {
+          sre::HitResult res;
+          bvh->hit(primary[i], res);
+          return res.isHit;
+        }));
+    results.push_back(
+        measure("closest-hit-bounce", bounce.size(), repeats, [&](size_t i) {
+          sre::HitResult res;
+          bvh->hit(bounce[i], res);
+          return res.isHit;
+        }));
+    // 与渲染器相同：阴影光线停在光源采样点之前，有交点即为被遮挡
+    if (!shadow.empty()) {
+      results.push_back(
+          measure("occlusion", shadow.size(), repeats, [&](size_t i) {
+            sre::HitResult res;
+            bvh->hit(shadow[i], res);
+            return res.isHit;
+          }));
+    }
+
+    const sre::BVHReport& report = tracer.getBVHReport();
+    std::cout << "benchmark " << scene.name << '\n';
+    ofs << (firstScene ? "\n" : ",\n") << "    {\n"
+        << "      \"name\": \"" << scene.name << "\",\n"
+        << "      \"triangles\": " << triangles.size() << ",\n"
+        << "      \"bvh_nodes\": " << bvh->getNodeNum() << ",\n"
+        << "      \"bvh_sah_cost\": " << report.sahCost << ",\n"
+        << "      \"bvh_max_depth\": " << report.maxDepth << ",\n"
+        << "      \"bvh_overlap_ratio\": " << report.overlapRatio << ",\n"
+        << "      \"kernels\": [";
+    firstScene = false;
+    for (size_t k = 0; k < results.size(); k++) {
+      const KernelResult& r = results[k];
+      std::cout << r.name << ": " << r.mraysPerSecond << " Mrays/s, "
+                << r.nsPerRay << " ns/ray (p50 " << r.p50 << ", p90 "
+                << r.p90 << ", p99 " << r.p99 << ")" << '\n';
+      ofs << (k == 0 ? "\n" : ",\n") << "        {"
+          << "\"name\": \"" << r.name << "\", "
+          << "\"rays\": " << r.rays << ", "
+          << "\"hits\": " << r.hits << ", "
+          << "\"mrays_per_s\": " << r.mraysPerSecond << ", "
+          << "\"ns_per_ray\": " << r.nsPerRay << ", "
+          << "\"p50_ns\": " << r.p50 << ", "
+          << "\"p90_ns\": " << r.p90 << ", "
+          << "\"p99_ns\": " << r.p99 << ", "
+          << "\"runs_ns\": [";
+      for (size_t j = 0; j < r.runs.size(); j++) {
+        ofs << (j == 0 ? "" : ", ") << r.runs[j];
+      }
+      ofs << "]}";
+    }
+    ofs << "\n      ]\n    }";
+    std::cout << std::endl;
+  }
+  ofs << "\n  ]\n}\n";
+  ofs.close();
+  if (!ofs.good()) {
+    std::cout << "Benchmark file writing fails: " << outName << std::endl;
+    return 1;
+  }
+  std::cout << "Benchmark results: " << outName << std::endl;
+  return 0;
+}
@@ -3,7 +3,10 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <string>
 #include <vector>
 
 #include "AABB.hpp"
@@ -12,6 +15,7 @@
 
 namespace sre {
 class BVHNode;
+class Mesh;
 
 typedef BVHNode BVH;
 
@@ -45,6 +49,143 @@ class BVHNode : public Hittable {
   virtual void hit(const Ray &ray, HitResult &res) const override;
 };
 
+// 扁平化的BVH节点（32字节），按深度优先顺序存放，左孩子紧跟在父节点之后
+struct LinearBVHNode {
+  float minXYZ[3];
+  float maxXYZ[3];
+  int offset;  // 叶节点：首个图元在primitives中的下标；内部节点：右孩子下标
+  int count;   // 叶节点的图元数，内部节点为0
+};
+
+// 只由包围盒构建的子树，图元用下标表示，之后再由LinearBVH拼接成整棵树
+struct LinearBVHSubtree {
+  std::vector<LinearBVHNode> nodes;
+  std::vector<int> primitiveIds;
+};
+
+// BVH质量诊断
+// SAH代价按根包围盒表面积归一化，遍历一个内部节点和求交一个图元的代价都记为1；
+// 兄弟重叠率为左右孩子包围盒交集与父节点的表面积之比，空白率为父节点体积中
+// 不被任何孩子覆盖的比例，两者都是内部节点上的平均值（退化的包围盒不计）
+struct BVHReport {
+  size_t nodeNum;
+  size_t leafNum;
+  size_t primitiveNum;
+  size_t maxDepth;
+  double meanLeafDepth;
+  double sahCost;
+  double overlapRatio;
+  double emptyRatio;
+  size_t memory;                          // 字节，节点与图元指针
+  std::vector<size_t> depthHistogram;     // 下标为深度，值为该深度的叶节点数
+  std::vector<size_t> leafSizeHistogram;  // 下标为叶节点的图元数
+
+  BVHReport();
+
+  bool write(const std::string &fileName) const;
+
+  // print.
+  void printStatus() const;
+};
+
+class LinearBVH : public Hittable {
+ private:
+  std::vector<LinearBVHNode> storage;
+  const LinearBVHNode *nodes;  // 指向storage，或外部（如映射的缓存文件）内存
+  size_t nodeNum;
+  std::vector<Hittable *> primitives;  // 按叶节点顺序排列的图元
+
+ private:
+  // ids与bounds一起按划分结果重排，叶节点的offset为ids中的下标
+  static int build(std::vector<LinearBVHNode> &storage, std::vector<int> &ids,
+                   std::vector<AABB> &bounds, int low, int high,
+                   size_t maxLeafSize);
+  // 复制顶层的第index个节点，叶节点替换为对应的子树，返回新节点的下标
+  int splice(const std::vector<LinearBVHNode> &top,
+             const std::vector<int> &topIds, int index,
+             const std::vector<LinearBVHSubtree> &subtrees,
+             const std::vector<size_t> &bases,
+             const std::vector<Hittable *> &objects);
+
+ public:
+  // 按最长轴中位数划分构建
+  LinearBVH(const std::vector<Hittable *> &objects, size_t maxLeafSize = 2);
+  // 在各子树的根之上按同样的规则构建顶层，
+  // 子树k中下标为i的图元是objects[bases[k] + i]；只有一棵子树时与直接构建的结果相同
+  LinearBVH(const std::vector<LinearBVHSubtree> &subtrees,
+            const std::vector<size_t> &bases,
+            const std::vector<Hittable *> &objects);
+  // 使用已构建好的节点，节点内存由调用者管理
+  LinearBVH(const LinearBVHNode *_nodes, size_t _nodeNum,
+            const std::vector<Hittable *> &_primitives);
+  ~LinearBVH() = default;
+
+ public:
+  // 只需要图元的包围盒，可以在图元对象创建之前构建
+  static void buildSubtree(const std::vector<AABB> &bounds,
+                           LinearBVHSubtree &subtree, size_t maxLeafSize = 2);
+
+  // getter.
+  virtual Vec3<float> getMinXYZ() const override;
+  virtual Vec3<float> getMaxXYZ() const override;
+  const LinearBVHNode *getNodes() const;
+  size_t getNodeNum() const;
+  const std::vector<Hittable *> &getPrimitives() const;
+  // 遍历整棵树统计质量指标
+  BVHReport getReport() const;
+
+  // print.
+  virtual void printStatus() const override;
+
+ public:
+  virtual void hit(const Ray &ray, HitResult &res) const override;
+};
+
+// 压缩的4叉BVH节点（64字节，一个缓存行），孩子包围盒相对本节点包围盒量化为8位：
+// 第k轴上 孩子边界 = origin[k] + q * 2^exponent[k]，量化时下界向下、上界向上取整，
+// 解码出的包围盒总是包含原包围盒，求交结果与未压缩时一致
+struct alignas(64) CompressedBVHNode {
+  float origin[3];     // 本节点包围盒的最小点
+  int8_t exponent[3];  // 各轴的量化步长（2的幂）
+  uint8_t childNum;
+  uint8_t qMin[3][4];  // [轴][孩子]
+  uint8_t qMax[3][4];
+  int32_t child[4];    // 内部节点：孩子节点下标；叶节点：首个图元下标
+  uint8_t count[4];    // 叶节点的图元数，内部节点为0
+};
+
+// 由LinearBVH合并为4叉树：每次展开表面积最大的内部孩子，直到凑满4个孩子；
+// 只有两个叶孩子的小子树合并为一个叶节点
+// 给出mesh时图元必须是mesh中的三角形（id为下标），叶节点中的三角形4路一起求交
+class CompressedBVH : public Hittable {
+ private:
+  std::vector<CompressedBVHNode> nodes;
+  std::vector<Hittable *> primitives;  // 与LinearBVH的图元顺序相同
+  const Mesh *mesh;
+  float minXYZ[3], maxXYZ[3];
+
+ private:
+  int build(const LinearBVHNode *binary, int index);
+
+ public:
+  CompressedBVH(const LinearBVH &bvh, const Mesh *_mesh = nullptr);
+  ~CompressedBVH() = default;
+
+ public:
+  // getter.
+  virtual Vec3<float> getMinXYZ() const override;
+  virtual Vec3<float> getMaxXYZ() const override;
+  const std::vector<CompressedBVHNode> &getNodes() const;
+  size_t getNodeNum() const;
+  size_t getMemorySize() const;
+
+  // print.
+  virtual void printStatus() const override;
+
+ public:
+  virtual void hit(const Ray &ray, HitResult &res) const override;
+};
+
 }  // namespace sre
 
 #endif
@@ -35,6 +35,10 @@ class Camera {
   Vec3<float> getEye() const;
   Vec3<float> getLookAt() const;
   Vec3<float> getAxisZ() const;
+  Vec3<float> getUp() const;
+  float getFovy() const;
+  // 单个像素对应的光锥张角
+  float getSpreadAngle() const;
 
   // setter.
   void setWidth(const int& w);
@@ -0,0 +1,57 @@
+#ifndef SRE_CHECKPOINT_HPP
+#define SRE_CHECKPOINT_HPP
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "FrameBuffer.hpp"
+
+namespace sre {
+
+struct CheckpointHeader {
+  char magic[8];  // "SRECKPT"
+  uint32_t version;
+  uint32_t headerSize;
+  int32_t width, height;
+  uint64_t seed;        // 随机数种子，与已完成的遍数一起确定之后的随机序列
+  uint64_t configHash;  // 影响样本的渲染参数
+  uint64_t passes;      // 已完成的遍数，每遍为每个像素累加一个样本
+};
+
+// 渲染检查点：帧缓冲的累加均值、AOV、方差二阶矩和每个像素的样本数
+// 写入在后台线程中进行，渲染线程只负责拷贝一份帧缓冲
+class Checkpoint {
+ private:
+  std::string fileName;
+  std::future<bool> pending;
+  bool lastResult;
+
+ public:
+  static const uint32_t VERSION = 1;
+
+ public:
+  Checkpoint();
+  ~Checkpoint();
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+
+  // 拷贝帧缓冲后在后台写入临时文件再改名，中途被杀掉也不会损坏已有的检查点；
+  // 上一次写入还没完成时跳过本次并返回false
+  bool save(const FrameBuffer &frame, const CheckpointHeader &header);
+  // 等待后台写入完成，返回最近一次写入是否成功
+  bool wait();
+  // header中的尺寸、种子和参数哈希与文件一致时读入帧缓冲并填写passes
+  bool load(FrameBuffer &frame, CheckpointHeader &header) const;
+
+  // setter.
+  void setFileName(const std::string &name);
+
+  // getter.
+  const std::string &getFileName() const;
+  bool isEnabled() const;
+};
+}  // namespace sre
+
+#endif
@@ -0,0 +1,151 @@
+#ifndef SRE_CHUNKEDSCENE_HPP
+#define SRE_CHUNKEDSCENE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "BVH.hpp"
+#include "Hittable.hpp"
+#include "Mesh.hpp"
+#include "SceneCache.hpp"
+
+namespace sre {
+
+// 一个几何块在文件中的位置与内容，块数据按CHUNK_ALIGNMENT对齐，可以单独映射
+// 块内依次为：顶点、法向量、纹理坐标（float数组），块内材质编号到全局材质的映射，
+// 三角形下标（材质为块内编号），BVH节点（叶节点的图元即同序号的三角形）
+struct ChunkRecord {
+  float minXYZ[3];
+  float maxXYZ[3];
+  uint64_t offset, size;
+  uint64_t firstTriangle;  // 块内第一个三角形的全局编号
+  uint32_t positionNum, normalNum, texcoordNum, materialNum;
+  uint32_t triangleNum, nodeNum;
+};
+
+struct ChunkedSceneHeader {
+  char magic[8];  // "SRECHUNK"
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t sourceHash;
+  uint64_t stringOffset, stringSize;
+  uint64_t materialOffset, materialNum;  // MaterialRecord
+  uint64_t chunkOffset, chunkNum;        // ChunkRecord
+  uint64_t triangleNum;
+  // 光源三角形单独组成一块常驻内存，lightIdOffset处是它们的全局编号
+  ChunkRecord lights;
+  uint64_t lightIdOffset;
+};
+
+// 核外几何：场景按空间划分为若干块，每块带有自己的BVH存放在磁盘上
+// 常驻内存的只有材质、块的包围盒与顶层BVH；块在用到时用mmap映射并重建为Mesh，
+// 总占用超过预算时换出最久未使用的块
+// 求交结果中的id为全局三角形编号，材质指向常驻的材质表
+class ChunkedScene : public Hittable {
+ private:
+  struct Chunk {
+    void *mapped;
+    size_t mappedSize;
+    Mesh mesh;
+    std::vector<Hittable *> primitives;
+    std::unique_ptr<LinearBVH> bvh;  // 节点指向映射内存
+    const uint32_t *materialIds;     // 块内材质编号 -> 全局编号
+    size_t bytes;
+
+    Chunk();
+    ~Chunk();
+  };
+  // 一个块的驻留状态，chunk为空表示未加载或已被换出
+  // 换入时只锁这一块的mutex，不同块的缺失可以并行读取
+  struct Slot {
+    std::shared_ptr<const Chunk> chunk;
+    std::atomic<uint64_t> lastUse;
+    std::mutex loading;
+  };
+
+  int fd;
+  size_t budget;  // 字节，为0时不限制
+  std::vector<Material> materials;
+  std::vector<ChunkRecord> records;
+  std::vector<LinearBVHNode> topNodes;  // 块包围盒上的顶层BVH
+  std::vector<int> topIds;
+  std::unique_ptr<Slot[]> slots;
+  std::unique_ptr<Chunk> lights;  // 常驻的光源块
+  std::vector<uint32_t> lightIds;
+  uint64_t triangleNum;
+  mutable std::mutex loadMutex;  // 保护换出，只在记账和选择换出块时持有
+  mutable std::atomic<size_t> usedBytes;
+  mutable std::atomic<uint64_t> clock;
+  mutable std::atomic<uint64_t> loads, evictions, batches;
+
+ private:
+  bool loadChunk(const ChunkRecord &record, Chunk &chunk) const;
+  std::shared_ptr<const Chunk> acquire(size_t k) const;
+  void evict(size_t keep) const;
+  // 与光线相交的块及其进入距离，按距离从近到远排列
+  void getCandidates(const Ray &ray,
+                     std::vector<std::pair<float, uint32_t>> &candidates) const;
+  // 块内求交结果换成全局编号和常驻材质
+  void toGlobal(const ChunkRecord &record, const Chunk &chunk,
+                HitResult &res) const;
+  // 全局三角形编号所在的块
+  size_t findChunk(size_t id) const;
+
+ public:
+  static const uint32_t VERSION = 1;
+  static const size_t CHUNK_ALIGNMENT = 65536;
+
+ public:
+  ChunkedScene();
+  ~ChunkedScene();
+  ChunkedScene(const ChunkedScene &) = delete;
+  ChunkedScene &operator=(const ChunkedScene &) = delete;
+
+  // 按三角形质心做中位数划分，直到每块不超过chunkTriangles个三角形；
+  // 写入临时文件后改名
+  static bool write(const std::string &fileName, uint64_t hash,
+                    const Mesh &mesh, size_t chunkTriangles);
+
+  // 读取文件头、材质和块表，版本、哈希不一致或数据越界时返回false
+  bool open(const std::string &fileName, uint64_t hash);
+  void close();
+  bool isOpen() const;
+
+  // 成批求交：每条光线按进入距离依次排到相交的块的队列中，
+  // 每次处理一个块的整个队列（优先已驻留的块，其次排队最多的块），
+  // 一次换入由排队的所有光线共享；光线之后可能再排回处理过的块，
+  // 预算不足时该块可能已被换出，所以这只减少重复换入，不保证每块只换入一次
+  void intersect(const std::vector<Ray> &rays,
+                 std::vector<HitResult> &results) const;
+
+  // setter.
+  void setBudget(size_t bytes);
+
+  // getter.
+  virtual Vec3<float> getMinXYZ() const override;
+  virtual Vec3<float> getMaxXYZ() const override;
+  size_t getTriangleNum() const;
+  size_t getChunkNum() const;
+  size_t getUsedBytes() const;
+  // 光源三角形常驻内存，lightIds为它们的全局编号
+  const std::vector<Triangle> &getLightTriangles() const;
+  const std::vector<uint32_t> &getLightIds() const;
+  const std::vector<Material> &getMaterials() const;
+  // 全局编号为id的三角形在p处的纹理坐标与纹素比例，需要时换入所在的块
+  Vec2<float> getTexCoord(size_t id, const Vec3<float> &p) const;
+  float getTexelScale(size_t id) const;
+
+  // print.
+  virtual void printStatus() const override;
+
+ public:
+  // 逐条求交，按距离依次换入相交的块，找到交点后不再访问更远的块
+  virtual void hit(const Ray &ray, HitResult &res) const override;
+};
+}  // namespace sre
+
+#endif
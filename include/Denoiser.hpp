@@ -0,0 +1,41 @@
+#ifndef SRE_DENOISER_HPP
+#define SRE_DENOISER_HPP
+
+#include <vector>
+
+#include "FrameBuffer.hpp"
+
+namespace sre {
+
+// 边缘保持的À-Trous小波降噪
+// 先用反照率解调颜色得到辐照度，再以法向量、深度和亮度方差为引导逐级滤波，
+// 第i轮的采样间隔为2^i，最后乘回反照率
+class Denoiser {
+ private:
+  size_t iterations;  // 滤波轮数
+  float sigmaColor;   // 亮度权重，以标准差为单位
+  float sigmaNormal;  // 法向量权重指数（取2的幂）
+  float sigmaDepth;   // 相对深度差容忍度
+
+ public:
+  Denoiser(size_t _iterations = 5, float _sigmaColor = 4.0f,
+           float _sigmaNormal = 128.0f, float _sigmaDepth = 0.02f);
+  ~Denoiser() = default;
+
+  // setter.
+  void setIterations(size_t n);
+
+  // print.
+  void printStatus() const;
+
+  void denoise(FrameBuffer& frame) const;
+
+ private:
+  void filter(int width, int height, int step,
+              const std::vector<float> (&in)[3], const std::vector<float>& var,
+              const std::vector<float> (&n)[3], const std::vector<float>& z,
+              std::vector<float> (&out)[3], std::vector<float>& outVar) const;
+};
+}  // namespace sre
+
+#endif
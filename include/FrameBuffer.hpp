@@ -0,0 +1,62 @@
+#ifndef SRE_FRAMEBUFFER_HPP
+#define SRE_FRAMEBUFFER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "Vec.hpp"
+
+namespace sre {
+
+// 首次击中点的辅助信息（AOV）
+struct AOVSample {
+  Vec3<float> albedo;  // 反照率
+  Vec3<float> normal;  // 法向量
+  float depth;         // 击中距离，未击中为0
+
+  AOVSample() : albedo(0, 0, 0), normal(0, 0, 0), depth(0) {}
+};
+
+// 浮点帧缓冲，各通道按平面（SoA）存储，便于多线程与向量化处理
+// 每个像素保存逐样本更新的均值，以及亮度的Welford二阶矩用于估计方差
+class FrameBuffer {
+ private:
+  int width, height;
+  std::vector<float> color[3];
+  std::vector<float> albedo[3];
+  std::vector<float> normal[3];
+  std::vector<float> depth;
+  std::vector<float> lumM2;
+  std::vector<unsigned int> sampleCount;
+
+  friend class Checkpoint;
+
+ public:
+  FrameBuffer(int w = 0, int h = 0);
+  ~FrameBuffer() = default;
+
+  void resize(int w, int h);
+  void addSample(int row, int col, const Vec3<float>& c, const AOVSample& aov);
+
+  // getter.
+  int getWidth() const;
+  int getHeight() const;
+  unsigned int getSampleCount(int row, int col) const;
+  Vec3<float> getColor(int row, int col) const;
+  // 像素均值的亮度方差
+  float getVariance(int row, int col) const;
+  const float* getColorPlane(int c) const;
+  const float* getAlbedoPlane(int c) const;
+  const float* getNormalPlane(int c) const;
+  const float* getDepthPlane() const;
+  float* getColorPlane(int c);
+
+  // 伽马校正后输出8位图像，见ToneMapper
+  cv::Mat toImage() const;
+};
+
+float luminance(const Vec3<float>& c);
+
+}  // namespace sre
+
+#endif
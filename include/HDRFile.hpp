@@ -0,0 +1,73 @@
+#ifndef SRE_HDRFILE_HPP
+#define SRE_HDRFILE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sre {
+
+// 浮点RGB图像文件：PFM，或不压缩、FLOAT通道的扫描线OpenEXR，按扩展名选择
+// 两种格式中每个像素的位置都是固定的，数据按本机（小端）字节序存放
+enum class HDRFormat { PFM, EXR };
+
+// 流式写入：打开时写好文件头并预留整幅图像的空间，
+// 之后每完成一块就直接写到文件中对应的位置，块可以按任意顺序、从多个线程写入
+class HDRWriter {
+ private:
+  int fd;
+  HDRFormat format;
+  int width, height;
+  uint64_t dataOffset;  // 第一个像素（PFM）或第一个扫描线块（EXR）的位置
+  std::atomic<bool> failed;
+
+ private:
+  bool writeHeader();
+  bool writeAt(uint64_t offset, const void *bytes, size_t n);
+
+ public:
+  HDRWriter();
+  ~HDRWriter();
+  HDRWriter(const HDRWriter &) = delete;
+  HDRWriter &operator=(const HDRWriter &) = delete;
+
+  bool open(const std::string &fileName, int w, int h);
+  // rgb为块内按行存放的RGB浮点数，共w*h个像素
+  bool writeTile(int x0, int y0, int w, int h, const float *rgb);
+  // 返回所有写入是否成功
+  bool close();
+};
+
+// 按扫描线读取HDRWriter写出的文件
+class HDRReader {
+ private:
+  int fd;
+  HDRFormat format;
+  int width, height;
+  uint64_t dataOffset;
+  std::vector<uint64_t> lineOffsets;  // EXR扫描线块的位置
+  std::vector<float> line;
+
+ private:
+  bool readPFMHeader();
+  bool readEXRHeader();
+
+ public:
+  HDRReader();
+  ~HDRReader();
+  HDRReader(const HDRReader &) = delete;
+  HDRReader &operator=(const HDRReader &) = delete;
+
+  bool open(const std::string &fileName);
+  void close();
+  // 读取第y行（从上往下），按通道平面输出
+  bool readLine(int y, float *r, float *g, float *b);
+
+  // getter.
+  int getWidth() const;
+  int getHeight() const;
+};
+}  // namespace sre
+
+#endif
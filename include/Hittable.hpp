@@ -13,9 +13,9 @@ struct HitResult {
   float distance;
   Vec3<float> hitPoint;
   Vec3<float> normal;
-  Material material;
+  const Material* material;  // 指向Mesh中的材质，未击中时无效
 
-  HitResult() : isHit(false), distance(-1) {}
+  HitResult() : isHit(false), distance(-1), material(nullptr) {}
 };
 
 class Hittable {
@@ -35,6 +35,8 @@ class Hittable {
   virtual Vec2<float> getTexCoord(const Vec3<float>& coord) const {
     return Vec2<float>(0, 0);
   }
+  // 单位世界长度对应的纹理坐标长度
+  virtual float getTexelScale() const { return 0; }
 
   // print.
   virtual void printStatus() const {}
@@ -10,22 +10,50 @@
 
 namespace sre {
 
+// 光源上的一个采样点
+struct LightSample {
+  size_t id;              // 所在三角形id
+  Vec3<float> position;   // 采样点
+  Vec3<float> normal;     // 光源法向量
+  Vec3<float> radiance;   // 光源辐射
+  float pdf;              // 面积测度下的概率密度
+
+  LightSample() : id(-1), pdf(0) {}
+};
+
 class Light {
  private:
   std::unordered_map<Vec3<float>, int> lightIds;
   std::vector<std::vector<Triangle>> lightTriangles;
+  std::vector<std::vector<size_t>> lightTriangleIds;  // 求交结果中的三角形id
   std::vector<float> lightAreas;
+  std::vector<std::vector<float>> lightCdfs;  // 各光源内三角形面积的前缀和
+  std::vector<Vec3<float>> lightRadiances;
+  std::vector<float> powerCdf;  // 各光源 亮度*面积 的前缀和
+  bool solidAngleSampling;      // 对三角形按立体角采样
+
+ private:
+  size_t getRandomLight(float& pdf) const;
+  size_t getRandomTriangle(size_t idx) const;
 
  public:
-  Light() = default;
+  Light();
   ~Light() = default;
 
   // getter
-  void getRandomPoint(size_t& id, Vec3<float>& pos, Vec3<float>& radiance,
-                      float& area) const;
+  // 按功率选择光源、按面积选择三角形，再从着色点p按立体角采样三角形；
+  // 立体角过小（很小或很远的三角形）时退回按面积均匀采样
+  void sample(const Vec3<float>& p, LightSample& s) const;
+  // 按功率采样一个发射点，返回位置、法向量和该点对应的光通量
+  void getRandomEmission(Vec3<float>& pos, Vec3<float>& normal,
+                         Vec3<float>& flux) const;
+  bool empty() const;
+  bool getSolidAngleSampling() const;
 
   // setter
-  void setLight(const Triangle& triangle);
+  // id为求交时该三角形的编号，默认与triangle.getId()相同
+  void setLight(const Triangle& triangle, size_t id = -1);
+  void setSolidAngleSampling(bool enable);
 
   void printStatus() const;
 };
@@ -25,6 +25,8 @@ class Material {
   Texture* diffuseTexture;    // map_Kd 纹理
   Texture* specularTexture;   // map_Ks 纹理
 
+  friend class SceneCache;
+
  public:
   Material();
   ~Material();
@@ -32,9 +34,15 @@ class Material {
   // getter.
   std::string getName() const;
   Vec3<float> getEmission() const;
-  Vec3<float> getAmbience(const Vec2<float>& texCoord) const;
-  Vec3<float> getDiffusion(const Vec2<float>& texCoord) const;
-  Vec3<float> getSpecularity(const Vec2<float>& texCoord) const;
+  // footprint为纹理坐标下的采样宽度，用于选择mipmap层级
+  Vec3<float> getAmbience(const Vec2<float>& texCoord,
+                          float footprint = 0) const;
+  Vec3<float> getDiffusion(const Vec2<float>& texCoord,
+                           float footprint = 0) const;
+  // 不查纹理的Kd，场景中没有纹理时使用
+  Vec3<float> getDiffusion() const;
+  Vec3<float> getSpecularity(const Vec2<float>& texCoord,
+                             float footprint = 0) const;
   Vec3<float> getTransmittance() const;
   float getShiness() const;
   float getRefraction() const;
@@ -42,6 +50,8 @@ class Material {
   bool isDiffusive() const;
   bool isSpecular() const;
   bool isTransmissive() const;
+  // 是否有漫反射纹理
+  bool isTextured() const;
 
   // setter.
   void setName(const std::string& n);
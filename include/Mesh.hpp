@@ -0,0 +1,74 @@
+#ifndef SRE_MESH_HPP
+#define SRE_MESH_HPP
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Material.hpp"
+#include "Triangle.hpp"
+#include "Vec.hpp"
+
+namespace sre {
+
+// 三角形在共享缓冲中的下标，按值可以直接写入场景缓存
+struct TriangleIndex {
+  uint32_t v[3];        // 顶点坐标
+  uint32_t vt[3];       // 纹理坐标
+  uint32_t n;           // 法向量
+  uint32_t materialId;  // 材质
+};
+
+// 场景中所有三角形共享的顶点、法向量、纹理坐标和材质缓冲
+// 加载时按位去重，三角形只保存下标，Triangle对象只是指向这里的视图
+class Mesh {
+ private:
+  std::vector<Vec3<float>> positions;
+  std::vector<Vec3<float>> normals;
+  std::vector<Vec2<float>> texcoords;
+  std::vector<Material> materials;
+  std::vector<TriangleIndex> indices;
+  std::vector<Triangle> triangles;
+  // 去重表只在加载期间使用，finalize后释放
+  std::unordered_map<Vec3<float>, uint32_t> positionIds;
+  std::unordered_map<Vec3<float>, uint32_t> normalIds;
+  std::unordered_map<uint64_t, uint32_t> texcoordIds;
+
+  friend class SceneCache;
+  friend class ChunkedScene;
+
+ public:
+  Mesh() = default;
+  ~Mesh() = default;
+  // 三角形视图保存了本对象的地址，不能拷贝
+  Mesh(const Mesh &) = delete;
+  Mesh &operator=(const Mesh &) = delete;
+
+  // 返回去重后的下标，法向量先归一化
+  uint32_t addPosition(const Vec3<float> &position);
+  uint32_t addNormal(const Vec3<float> &normal);
+  uint32_t addTexCoord(const Vec2<float> &texcoord);
+  uint32_t addMaterial(const Material &material);
+  void addTriangle(const TriangleIndex &index);
+  // 释放去重表、收缩缓冲并生成三角形视图，之后不能再添加
+  void finalize();
+  void clear();
+
+  // getter.
+  const Vec3<float> &getPosition(uint32_t i) const { return positions[i]; }
+  const Vec3<float> &getNormal(uint32_t i) const { return normals[i]; }
+  const Vec2<float> &getTexCoord(uint32_t i) const { return texcoords[i]; }
+  const Material &getMaterial(uint32_t i) const { return materials[i]; }
+  const TriangleIndex &getIndex(size_t i) const { return indices[i]; }
+  const std::vector<Triangle> &getTriangles() const { return triangles; }
+  size_t getTriangleNum() const { return indices.size(); }
+  size_t getMaterialNum() const { return materials.size(); }
+  // 几何数据和三角形视图占用的字节数
+  size_t getMemorySize() const;
+
+  // print.
+  void printStatus() const;
+};
+}  // namespace sre
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SRE_OBJLOADER_HPP
+#define SRE_OBJLOADER_HPP
+
+#include <string>
+#include <vector>
+
+#include "Vec.hpp"
+
+namespace sre {
+
+// 三角形一个角的顶点、纹理坐标、法向量下标，缺失时为-1
+struct MeshIndex {
+  int v, vt, vn;
+};
+
+// OBJ解析结果：顶点属性数组，以及每个三角形3个角的下标和材质下标
+struct MeshBuffer {
+  std::vector<Vec3<float>> positions;
+  std::vector<Vec3<float>> normals;
+  std::vector<Vec2<float>> texcoords;
+  std::vector<MeshIndex> indices;       // 长度为三角形数的3倍
+  std::vector<int> materialIds;         // 下标对应materialNames，-1为无材质
+  std::vector<std::string> materialNames;  // usemtl按首次出现顺序编号
+  std::vector<std::string> mtlLibs;
+
+  size_t getTriangleNum() const { return materialIds.size(); }
+};
+
+// 并行OBJ解析：mmap整个文件，按行边界切块，第一遍各块统计元素个数，
+// 前缀和得到每块的写入位置后，第二遍各块直接写入预分配好的数组
+class ObjLoader {
+ private:
+  size_t bytes;      // 最近一次加载的文件大小
+  size_t triangles;  // 最近一次加载的三角形数
+  double seconds;    // 最近一次加载的耗时
+
+ public:
+  ObjLoader();
+  ~ObjLoader() = default;
+
+  // 多边形按扇形三角化，支持负下标
+  bool load(const std::string &fileName, MeshBuffer &mesh);
+
+  // print.
+  void printStatus() const;
+};
+}  // namespace sre
+
+#endif
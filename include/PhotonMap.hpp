@@ -0,0 +1,52 @@
+#ifndef SRE_PHOTONMAP_HPP
+#define SRE_PHOTONMAP_HPP
+
+#include <vector>
+
+#include "Hittable.hpp"
+#include "Light.hpp"
+#include "Vec.hpp"
+
+namespace sre {
+
+struct Photon {
+  Vec3<float> position;   // 落点
+  Vec3<float> direction;  // 入射方向
+  Vec3<float> flux;       // 光通量
+};
+
+// 光子图：从光源三角形发射光子，记录至少经过一次漫反射后的落点（间接光），
+// 以哈希网格组织，查询时在半径r内做密度估计
+class PhotonMap {
+ private:
+  std::vector<Photon> photons;
+  std::vector<unsigned int> cellStart;  // 哈希桶起始下标，长度为桶数+1
+  float radius;                         // 收集半径
+  float cellSize;
+  size_t maxBounce;
+
+ private:
+  size_t hashCell(int x, int y, int z) const;
+  int getCell(float v) const;
+
+ public:
+  PhotonMap(size_t _maxBounce = 8);
+  ~PhotonMap() = default;
+
+  // radius <= 0 时按场景包围盒对角线自动选择
+  void build(const Hittable *scene, const std::vector<Hittable *> &objects,
+             const Light &light, size_t photonNum, float r = 0);
+  void clear();
+
+  // getter.
+  size_t size() const;
+  float getRadius() const;
+  // 法向量为n的表面点p处的入射辐照度
+  Vec3<float> getIrradiance(const Vec3<float> &p, const Vec3<float> &n) const;
+
+  // print.
+  void printStatus() const;
+};
+}  // namespace sre
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SRE_PROFILER_HPP
+#define SRE_PROFILER_HPP
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// 编译时定义SRE_PROFILE才记录，否则SRE_PROFILE_SCOPE不参与编译
+#define SRE_PROFILE_CONCAT_(a, b) a##b
+#define SRE_PROFILE_CONCAT(a, b) SRE_PROFILE_CONCAT_(a, b)
+#ifdef SRE_PROFILE
+#define SRE_PROFILE_SCOPE(...) \
+  sre::ProfileScope SRE_PROFILE_CONCAT(profileScope, __LINE__)(__VA_ARGS__)
+#else
+#define SRE_PROFILE_SCOPE(...)
+#endif
+
+namespace sre {
+
+// 一段计时区间，时间为相对Profiler创建时刻的纳秒数
+struct ProfileEvent {
+  const char *name;    // 字符串常量
+  std::string detail;  // 附加信息，如文件名、块号
+  int64_t start;
+  int64_t duration;
+};
+
+// 每个线程把区间追加到自己的缓冲中，记录时不加锁；
+// 写出时合并所有线程的缓冲，生成Chrome Trace Event格式的JSON
+// （chrome://tracing或Perfetto可以直接打开），每个线程一行
+class Profiler {
+ public:
+  struct ThreadEvents {
+    int id;
+    std::vector<ProfileEvent> events;
+  };
+
+ private:
+  std::chrono::steady_clock::time_point epoch;
+  std::mutex mutex;
+  std::vector<ThreadEvents *> threads;
+  std::vector<ThreadEvents> retired;  // 已退出线程的区间
+  int threadNum;
+
+ private:
+  Profiler();
+  ~Profiler() = default;
+
+ public:
+  static Profiler &getInstance();
+
+  // 线程第一次记录时登记缓冲，退出时把缓冲移入retired
+  void registerThread(ThreadEvents *events);
+  void unregisterThread(ThreadEvents *events);
+
+  int64_t now() const;
+  void record(const char *name, std::string detail, int64_t start,
+              int64_t end);
+  // 写出时其他线程不能正在记录
+  bool write(const std::string &fileName);
+  void clear();
+};
+
+// 作用域计时，析构时记录
+class ProfileScope {
+ private:
+  const char *name;
+  std::string detail;
+  int64_t start;
+
+ public:
+  explicit ProfileScope(const char *_name, std::string _detail = "");
+  ~ProfileScope();
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+};
+}  // namespace sre
+
+#endif
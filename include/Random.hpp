@@ -1,14 +1,23 @@
 #ifndef SRE_RANDOM_HPP
 #define SRE_RANDOM_HPP
 
+#include <cstdint>
 #include <cstdlib>
 
 namespace sre {
 
+// 每个线程有独立的随机数状态，不再共享全局的rand()
+// 渲染时每个样本开始前用seedRandom按(种子, 像素, 遍数)重置状态，
+// 样本的随机序列与线程调度无关，中断后从检查点继续可以得到相同的结果
+void setRandomSeed(uint64_t seed);
+uint64_t getRandomSeed();
+// stream用于区分同一像素同一遍中的不同阶段
+void seedRandom(uint64_t key, uint64_t pass, uint64_t stream = 0);
+
 int randInt(int max, int min = 0);
 
 float randFloat(float max, float min = 0);
 
 }  // namespace sre
 
-#endif
\ No newline at end of file
+#endif
@@ -1,28 +1,53 @@
 #ifndef SRE_RAY_HPP
 #define SRE_RAY_HPP
 
+#include <limits>
+
 #include "Random.hpp"
 #include "Vec.hpp"
 
 namespace sre {
+// 光线只在距离区间[tMin, tMax]内有效；方向的倒数和各分量的符号在构造时算好，
+// 包围盒的slab测试不需要除法和分支
 class Ray {
  private:
   Vec3<float> origin;
   Vec3<float> direction;
+  Vec3<float> invDirection;  // 分量为0时为±inf
+  int sign[3];               // 方向分量为负（包括-0）时为1
+  float tMin, tMax;
+
+ public:
+  // 默认的最小距离，避免与出发点所在的表面自相交
+  static constexpr float DEFAULT_T_MIN = 0.1f;
 
  public:
   Ray() = default;
   ~Ray() = default;
-  Ray(const Vec3<float> &org, const Vec3<float> &dir);
+  Ray(const Vec3<float> &org, const Vec3<float> &dir,
+      float _tMin = DEFAULT_T_MIN,
+      float _tMax = std::numeric_limits<float>::infinity());
 
   // getter.
   Vec3<float> getOrigin() const;
   Vec3<float> getDirection() const;
+  Vec3<float> getInvDirection() const;
+  const int *getSign() const;
+  float getTMin() const;
+  float getTMax() const;
   Vec3<float> getPointAt(const float &t) const;
+
+  // setter.
+  // 求最近交点时随已找到的交点收缩区间
+  void setTMax(float t);
 };
 
+// 从p射向q的阴影光线，在到达q之前停止：区间内有交点即为被遮挡
+Ray shadowRay(const Vec3<float> &p, const Vec3<float> &q);
 // 漫反射光线方向
 Vec3<float> diffuseDir(const Vec3<float> &wi, const Vec3<float> &n);
+// 余弦加权的半球方向，pdf = cos / PI
+Vec3<float> cosineDir(const Vec3<float> &n);
 // 镜面反射光线方向
 Vec3<float> mirrorDir(const Vec3<float> &wi, const Vec3<float> &n);
 // 折射光线方向
@@ -0,0 +1,77 @@
+#ifndef SRE_RENDERSTATS_HPP
+#define SRE_RENDERSTATS_HPP
+
+#include <atomic>
+#include <cstdint>
+
+// 编译时定义SRE_STATS才统计，否则SRE_STAT中的语句不参与编译，没有任何开销
+#ifdef SRE_STATS
+#define SRE_STAT(stmt) stmt
+#else
+#define SRE_STAT(stmt)
+#endif
+
+namespace sre {
+
+// 渲染计数，每个线程各有一份，渲染结束后合并
+struct alignas(64) RenderStats {
+  // 路径长度（击中的表面数）直方图的格数，最后一格包含更长的路径
+  static const int PATH_LENGTH_BINS = 16;
+
+  uint64_t primaryRays;
+  uint64_t shadowRays;
+  uint64_t bounceRays;
+  // BVH节点访问数，按光线-包围盒测试计：每测试一个节点的包围盒计1次，
+  // 二叉BVH一个内部节点的两个孩子计2次，4叉BVH一个节点的k个孩子计k次，
+  // 不同布局的BVH之间可以直接比较
+  uint64_t nodesVisited;
+  uint64_t triangleTests;  // 光线-三角形求交次数
+  uint64_t rouletteTerminations;
+  uint64_t textureLookups;
+  uint64_t pathLengths[PATH_LENGTH_BINS];
+
+  RenderStats();
+
+  void clear();
+  void merge(const RenderStats &other);
+  void addPath(uint64_t length);
+
+  // print.
+  void printStatus() const;
+};
+
+// 光线遍历的开销，热度图按像素累计
+struct TraversalCost {
+  uint64_t nodes;      // BVH节点访问数，定义同RenderStats::nodesVisited
+  uint64_t triangles;  // 光线-三角形求交次数
+
+  TraversalCost() : nodes(0), triangles(0) {}
+};
+
+// 当前线程的计数
+RenderStats &getThreadStats();
+// 当前线程之后的遍历开销累加到cost中，为nullptr时不记录
+void setThreadCost(TraversalCost *cost);
+// 累加到当前线程的遍历开销中，由addTraversal在有线程记录时调用
+void addThreadCost(uint64_t nodes, uint64_t triangles);
+// 正在记录遍历开销的线程数，只有热度图渲染时不为0
+extern std::atomic<int> threadCostUsers;
+
+// BVH求交结束时调用，计入统计和当前线程的遍历开销；
+// 不统计也不画热度图时只剩一次原子读和一个总是不跳转的分支，不访问线程局部变量
+inline void addTraversal(uint64_t nodes, uint64_t triangles) {
+  SRE_STAT(RenderStats &stats = getThreadStats());
+  SRE_STAT(stats.nodesVisited += nodes);
+  SRE_STAT(stats.triangleTests += triangles);
+  if (threadCostUsers.load(std::memory_order_relaxed) != 0) {
+    addThreadCost(nodes, triangles);
+  }
+}
+// 合并所有线程（包括已退出的线程）的计数
+void collectStats(RenderStats &total);
+// 清零所有线程的计数，只能在没有线程计数时调用
+void resetStats();
+
+}  // namespace sre
+
+#endif
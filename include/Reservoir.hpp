@@ -0,0 +1,24 @@
+#ifndef SRE_RESERVOIR_HPP
+#define SRE_RESERVOIR_HPP
+
+#include "Light.hpp"
+
+namespace sre {
+
+// 加权蓄水池采样：从一串带权候选中流式地保留一个样本
+struct Reservoir {
+  LightSample sample;  // 当前保留的光源样本
+  float wSum;          // 候选权重之和
+  float M;             // 已见过的候选数
+  float W;             // 保留样本的无偏贡献权重
+
+  Reservoir() : wSum(0), M(0), W(0) {}
+
+  // 加入一个权重为w、代表m个候选的样本，返回是否替换了当前样本
+  bool update(const LightSample& s, float w, float m = 1);
+  // 根据保留样本的目标函数值计算W
+  void finalize(float pHat);
+};
+}  // namespace sre
+
+#endif
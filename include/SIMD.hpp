@@ -0,0 +1,172 @@
+#ifndef SRE_SIMD_HPP
+#define SRE_SIMD_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SRE_SSE2
+#endif
+
+#include "Vec.hpp"
+
+namespace sre {
+
+// 4路单精度浮点向量，x86-64上对应一个SSE寄存器，其他平台退化为数组上的循环
+// 比较运算的结果是逐路掩码，与select、moveMask配合使用；有NaN参与的比较为假
+struct alignas(16) Float4 {
+#ifdef SRE_SSE2
+  __m128 v;
+
+  Float4() = default;
+  Float4(__m128 _v) : v(_v) {}
+  explicit Float4(float a) : v(_mm_set1_ps(a)) {}
+  Float4(float a, float b, float c, float d) : v(_mm_setr_ps(a, b, c, d)) {}
+
+  static Float4 load(const float *p) { return _mm_loadu_ps(p); }
+  // 4个无符号字节转换为浮点数
+  static Float4 loadBytes(const uint8_t *p) {
+    int32_t bytes;
+    memcpy(&bytes, p, sizeof(bytes));
+    __m128i zero = _mm_setzero_si128();
+    __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+  }
+  void store(float *p) const { _mm_storeu_ps(p, v); }
+
+  Float4 operator+(const Float4 &o) const { return _mm_add_ps(v, o.v); }
+  Float4 operator-(const Float4 &o) const { return _mm_sub_ps(v, o.v); }
+  Float4 operator*(const Float4 &o) const { return _mm_mul_ps(v, o.v); }
+  Float4 operator/(const Float4 &o) const { return _mm_div_ps(v, o.v); }
+  Float4 operator>(const Float4 &o) const { return _mm_cmpgt_ps(v, o.v); }
+  Float4 operator<(const Float4 &o) const { return _mm_cmplt_ps(v, o.v); }
+  Float4 operator>=(const Float4 &o) const { return _mm_cmpge_ps(v, o.v); }
+  Float4 operator<=(const Float4 &o) const { return _mm_cmple_ps(v, o.v); }
+
+  // 与标量的 a > b ? a : b 相同：a为NaN时取b
+  static Float4 max(const Float4 &a, const Float4 &b) {
+    return _mm_max_ps(a.v, b.v);
+  }
+  // 与标量的 a < b ? a : b 相同：a为NaN时取b
+  static Float4 min(const Float4 &a, const Float4 &b) {
+    return _mm_min_ps(a.v, b.v);
+  }
+  // mask ? a : b
+  static Float4 select(const Float4 &mask, const Float4 &a, const Float4 &b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+  }
+  // 第i路为真时返回值的第i位为1
+  static int moveMask(const Float4 &mask) { return _mm_movemask_ps(mask.v); }
+#else
+  float v[4];
+
+  Float4() = default;
+  explicit Float4(float a) : v{a, a, a, a} {}
+  Float4(float a, float b, float c, float d) : v{a, b, c, d} {}
+
+  static Float4 load(const float *p) { return Float4(p[0], p[1], p[2], p[3]); }
+  static Float4 loadBytes(const uint8_t *p) {
+    return Float4(p[0], p[1], p[2], p[3]);
+  }
+  void store(float *p) const { memcpy(p, v, sizeof(v)); }
+
+  Float4 operator+(const Float4 &o) const {
+    return Float4(v[0] + o.v[0], v[1] + o.v[1], v[2] + o.v[2], v[3] + o.v[3]);
+  }
+  Float4 operator-(const Float4 &o) const {
+    return Float4(v[0] - o.v[0], v[1] - o.v[1], v[2] - o.v[2], v[3] - o.v[3]);
+  }
+  Float4 operator*(const Float4 &o) const {
+    return Float4(v[0] * o.v[0], v[1] * o.v[1], v[2] * o.v[2], v[3] * o.v[3]);
+  }
+  Float4 operator/(const Float4 &o) const {
+    return Float4(v[0] / o.v[0], v[1] / o.v[1], v[2] / o.v[2], v[3] / o.v[3]);
+  }
+  Float4 operator>(const Float4 &o) const {
+    Float4 r;
+    for (int i = 0; i < 4; i++) {
+      r.v[i] = v[i] > o.v[i] ? 1.0f : 0.0f;
+    }
+    return r;
+  }
+  Float4 operator<(const Float4 &o) const { return o > *this; }
+  Float4 operator>=(const Float4 &o) const {
+    Float4 r;
+    for (int i = 0; i < 4; i++) {
+      r.v[i] = v[i] >= o.v[i] ? 1.0f : 0.0f;
+    }
+    return r;
+  }
+  Float4 operator<=(const Float4 &o) const { return o >= *this; }
+
+  static Float4 max(const Float4 &a, const Float4 &b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) {
+      r.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+    }
+    return r;
+  }
+  static Float4 min(const Float4 &a, const Float4 &b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) {
+      r.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+    }
+    return r;
+  }
+  static Float4 select(const Float4 &mask, const Float4 &a, const Float4 &b) {
+    Float4 r;
+    for (int i = 0; i < 4; i++) {
+      r.v[i] = mask.v[i] != 0 ? a.v[i] : b.v[i];
+    }
+    return r;
+  }
+  static int moveMask(const Float4 &mask) {
+    int bits = 0;
+    for (int i = 0; i < 4; i++) {
+      bits |= (mask.v[i] != 0) << i;
+    }
+    return bits;
+  }
+#endif
+};
+
+// 宽度为F的一组三维向量按分量存放（SoA），如4个包围盒的角点或4条光线的方向，
+// 一次运算处理所有路
+template <typename F>
+struct Vec3Lanes {
+  F x, y, z;
+
+  // 构造与析构
+  Vec3Lanes() = default;
+  ~Vec3Lanes() = default;
+  Vec3Lanes(const F &a, const F &b, const F &c) : x(a), y(b), z(c) {}
+  // 同一个向量广播到所有路
+  explicit Vec3Lanes(const Vec3<float> &v) : x(v.x), y(v.y), z(v.z) {}
+
+  // 运算符
+  Vec3Lanes<F> operator-(const Vec3Lanes<F> &other) const {
+    return Vec3Lanes<F>(x - other.x, y - other.y, z - other.z);
+  }
+  Vec3Lanes<F> operator+(const Vec3Lanes<F> &other) const {
+    return Vec3Lanes<F>(x + other.x, y + other.y, z + other.z);
+  }
+  Vec3Lanes<F> operator*(const Vec3Lanes<F> &other) const {
+    return Vec3Lanes<F>(x * other.x, y * other.y, z * other.z);
+  }
+  Vec3Lanes<F> operator*(const F &k) const {
+    return Vec3Lanes<F>(x * k, y * k, z * k);
+  }
+
+  static F dot(const Vec3Lanes<F> &v1, const Vec3Lanes<F> &v2) {
+    return v1.x * v2.x + v1.y * v2.y + v1.z * v2.z;
+  }
+
+  static Vec3Lanes<F> cross(const Vec3Lanes<F> &v1, const Vec3Lanes<F> &v2) {
+    return Vec3Lanes<F>(v1.y * v2.z - v1.z * v2.y, v1.z * v2.x - v1.x * v2.z,
+                        v1.x * v2.y - v1.y * v2.x);
+  }
+};
+}  // namespace sre
+
+#endif
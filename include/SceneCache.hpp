@@ -0,0 +1,94 @@
+#ifndef SRE_SCENECACHE_HPP
+#define SRE_SCENECACHE_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "BVH.hpp"
+#include "Hittable.hpp"
+#include "Mesh.hpp"
+
+namespace sre {
+
+// 缓存文件头，各段按64字节对齐，数据按本机字节序存放
+struct SceneCacheHeader {
+  char magic[8];  // "SRECACHE"
+  uint32_t version;
+  uint32_t headerSize;
+  uint64_t sourceHash;  // OBJ/MTL/XML源文件内容的哈希
+  uint64_t stringOffset, stringSize;
+  uint64_t materialOffset, materialNum;
+  uint64_t positionOffset, positionNum;
+  uint64_t normalOffset, normalNum;
+  uint64_t texcoordOffset, texcoordNum;
+  uint64_t triangleOffset, triangleNum;  // TriangleIndex
+  uint64_t nodeOffset, nodeNum;
+  uint64_t primitiveOffset, primitiveNum;
+};
+
+struct MaterialRecord {
+  float emission[3];
+  float ambience[3];
+  float diffusion[3];
+  float specularity[3];
+  float transmittance[3];
+  float shiness;
+  float refraction;
+  uint32_t emissive;
+  // 字符串表中的偏移，NO_STRING表示没有
+  uint32_t name;
+  uint32_t ambientTexture;
+  uint32_t diffuseTexture;
+  uint32_t specularTexture;
+};
+
+// 场景二进制缓存：材质（纹理只保存路径）、Mesh的共享缓冲和三角形下标、
+// 构建好的扁平BVH
+// 打开时用mmap映射整个文件，BVH节点直接在映射内存上使用，不做拷贝
+class SceneCache {
+ private:
+  int fd;
+  void *data;
+  size_t size;
+  const SceneCacheHeader *header;
+
+ public:
+  static const uint32_t VERSION = 2;
+  static const uint32_t NO_STRING = 0xffffffffu;
+
+ public:
+  SceneCache();
+  ~SceneCache();
+  SceneCache(const SceneCache &) = delete;
+  SceneCache &operator=(const SceneCache &) = delete;
+
+  // 源文件哈希，包括配置文件、模型文件以及模型引用的mtllib
+  static uint64_t hashSources(const std::string &pathName,
+                              const std::vector<std::string> &modelNames,
+                              const std::string &configName);
+  // 写入临时文件后改名，失败时不影响已有的缓存
+  static bool write(const std::string &cacheName, uint64_t hash,
+                    const Mesh &mesh, const LinearBVH &bvh);
+  // 材质与MaterialRecord互相转换，名称和纹理路径放在字符串表strings中
+  static void packMaterials(const std::vector<Material> &materials,
+                            std::vector<MaterialRecord> &records,
+                            std::string &strings);
+  static void unpackMaterials(const MaterialRecord *records, size_t num,
+                              const char *strings, size_t stringSize,
+                              std::vector<Material> &materials);
+
+  // 映射缓存文件，版本、哈希不一致或数据越界时返回false
+  bool open(const std::string &cacheName, uint64_t hash);
+  void close();
+  bool isOpen() const;
+  // 重建mesh并把其中的三角形依次放入objects（id与下标一致），
+  // 返回的BVH节点指向映射内存，其生命周期不能超过本对象
+  LinearBVH *restore(Mesh &mesh, std::vector<Hittable *> &objects) const;
+
+  // print.
+  void printStatus() const;
+};
+}  // namespace sre
+
+#endif
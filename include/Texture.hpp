@@ -1,29 +1,75 @@
 #ifndef SRE_TEXTURE_HPP
 #define SRE_TEXTURE_HPP
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "Vec.hpp"
 
 namespace sre {
+// 纹理在加载时转换为线性空间的浮点RGB并生成mipmap，
+// 每一级按8x8分块存放，块内按Morton顺序排列，相邻纹素在内存中也相邻
+// 纹理在第一次访问时才读取，各级mipmap由TextureCache按内存预算换入换出
 class Texture {
  private:
-  cv::Mat img;
+  struct Texel {
+    float r, g, b;
+  };
+  struct Level {
+    int width, height;
+    int tilesX;  // 每行的块数
+    std::vector<Texel> texels;
+  };
+  // 一级mipmap的驻留状态，level为空表示未加载或已被换出
+  struct Slot {
+    std::shared_ptr<const Level> level;
+    std::atomic<uint64_t> lastUse;
+    size_t bytes;  // 每一级的大小是确定的，准备好之后不再改变
+  };
+
+  std::string name;
+  mutable std::mutex loadMutex;
+  mutable std::atomic<bool> ready;
+  mutable int width, height;
+  mutable size_t levelNum;
+  mutable std::unique_ptr<Slot[]> slots;
+  static std::mutex instanceMutex;
   static std::unordered_map<std::string, Texture*> textures;
 
+  friend class TextureCache;
+
  private:
-  Texture() = default;
+  Texture();
   ~Texture() = default;
 
+  // 读取图像并生成前count级mipmap，count为0时生成完整的mipmap链
+  bool decode(std::vector<Level>& levels, size_t count) const;
+  void prepare() const;
+  std::shared_ptr<const Level> getLevel(size_t l) const;
+  size_t getIndex(const Level& level, int x, int y) const;
+  const Texel& fetch(const Level& level, int x, int y) const;
+  Vec3<float> bilinear(const Level& level, float u, float v) const;
+
  public:
   static Texture* getInstance(const std::string& texName);
   static void realeaseAllInstances();
+  // 提前读取图像并生成mipmap，渲染时第一次访问不再等待解码
+  void prefetch() const;
 
   // getter.
-  Vec3<float> getColorAt(const Vec2<float>& pos);
+  std::string getName() const;
+  int getWidth() const;
+  int getHeight() const;
+  size_t getLevelNum() const;
+  // footprint为采样点在纹理坐标下的宽度（如光锥在表面的投影），
+  // 为0时在最精细一级做双线性插值，否则在相邻两级间做三线性插值
+  Vec3<float> getColorAt(const Vec2<float>& pos, float footprint = 0) const;
 };
 }  // namespace sre
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,55 @@
+#ifndef SRE_TEXTURECACHE_HPP
+#define SRE_TEXTURECACHE_HPP
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include "Texture.hpp"
+
+namespace sre {
+
+// 全局纹理缓存：以mipmap的一级为单位驻留，超出内存预算时换出最久未使用的一级
+// 使用时间用一个只在缺失时递增的全局时钟近似，命中时几乎不产生写操作
+class TextureCache {
+ private:
+  size_t budget;  // 字节，为0时不限制
+  std::atomic<size_t> usedBytes;
+  std::atomic<uint64_t> clock;
+  std::atomic<uint64_t> hits, misses, evictions;
+  std::mutex mutex;
+  std::vector<Texture *> textures;
+
+ private:
+  TextureCache();
+  ~TextureCache() = default;
+
+  void evict();
+
+ public:
+  static TextureCache &getInstance();
+
+  void registerTexture(Texture *texture);
+  void unregisterAll();
+  // 命中时更新使用时间，命中计数按线程攒够一批再累加
+  void recordHit(Texture::Slot &slot);
+  // 新加载的一级放入槽位，必要时换出其他级
+  void insert(Texture::Slot &slot, std::shared_ptr<const Texture::Level> level);
+
+  // setter.
+  void setBudget(size_t bytes);
+
+  // getter.
+  size_t getBudget() const;
+  size_t getUsedBytes() const;
+  uint64_t getHits() const;
+  uint64_t getMisses() const;
+  uint64_t getEvictions() const;
+  bool empty();
+
+  // print.
+  void printStatus();
+};
+}  // namespace sre
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef SRE_TONEMAPPER_HPP
+#define SRE_TONEMAPPER_HPP
+
+#include <opencv2/opencv.hpp>
+#include <string>
+
+#include "FrameBuffer.hpp"
+
+namespace sre {
+
+// 把线性HDR颜色映射为8位：out = min(255, 255 * c^exponent)（向下取整）
+// 映射是单调的，预先求出每个输出值对应的最小输入，逐像素只需在256项的
+// 阈值表上做无分支的二分查找，结果与逐像素调用pow完全一致
+class ToneMapper {
+ private:
+  double exponent;  // 与原先 pow(c, 0.6) 中的double常量相同，不经过float舍入
+  float thresholds[256];  // thresholds[k]：输出不小于k的最小输入
+
+ private:
+  unsigned char map(float c) const;
+
+ public:
+  ToneMapper(double _exponent = 0.6);
+  ~ToneMapper() = default;
+
+  // 通道平面存储的n个像素，按B、G、R交错写入bgr
+  void apply(const float *r, const float *g, const float *b, size_t n,
+             unsigned char *bgr) const;
+  cv::Mat apply(const FrameBuffer &frame) const;
+  // 逐行读取HDR文件（PFM/EXR）并写出8位二进制PPM，整幅图像不需要驻留内存
+  bool apply(const std::string &hdrName, const std::string &ppmName) const;
+
+  // getter.
+  double getExponent() const;
+};
+}  // namespace sre
+
+#endif
@@ -2,36 +2,210 @@
 #define SRE_TRACE_HPP
 
 #include <iostream>
+#include <map>
 #include <opencv2/opencv.hpp>
 #include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "BVH.hpp"
 #include "Camera.hpp"
+#include "Checkpoint.hpp"
+#include "ChunkedScene.hpp"
+#include "Denoiser.hpp"
+#include "FrameBuffer.hpp"
 #include "Light.hpp"
+#include "Mesh.hpp"
+#include "ObjLoader.hpp"
+#include "PhotonMap.hpp"
 #include "Ray.hpp"
+#include "RenderStats.hpp"
+#include "Reservoir.hpp"
+#include "SceneCache.hpp"
 #include "Vec.hpp"
 
 namespace sre {
+// 迭代积分器配置
+struct IntegratorConfig {
+  bool iterative;     // 使用迭代积分器代替递归的trace
+  size_t rrDepth;     // 从该深度起按路径吞吐量做俄罗斯轮盘
+  size_t splitDepth;  // 前splitDepth次反弹允许分裂
+  float splitFactor;  // 分裂数 = splitFactor * 吞吐量
+  size_t maxSplit;    // 单次反弹的最大分裂数
+  bool autoTune;      // 渲染前试渲染，自动选择rrDepth和splitFactor
+
+  IntegratorConfig()
+      : iterative(false),
+        rrDepth(2),
+        splitDepth(1),
+        splitFactor(1),
+        maxSplit(8),
+        autoTune(false) {}
+};
+
+// 重采样直接光照（ReSTIR）配置
+struct ResamplingConfig {
+  size_t candidates;        // 每个着色点的候选光源样本数，为0时不重采样
+  bool temporalReuse;       // 复用上一遍同一像素的蓄水池
+  bool spatialReuse;        // 合并邻近像素的蓄水池
+  size_t spatialNeighbors;  // 合并的邻居数
+  int spatialRadius;        // 邻居的像素半径
+
+  ResamplingConfig()
+      : candidates(0),
+        temporalReuse(false),
+        spatialReuse(false),
+        spatialNeighbors(4),
+        spatialRadius(16) {}
+};
+
+// 影响积分器分支的场景特性，渲染前检测一次，积分器按特性组合在编译时实例化，
+// 场景中没有的特性对应的分支不进入内核
+enum SceneFeature : unsigned {
+  SCENE_TEXTURED = 1,    // 有材质使用漫反射纹理
+  SCENE_PHOTON_MAP = 2,  // 间接光使用光子图
+  SCENE_RESAMPLED = 4,   // 直接光照使用重采样
+  SCENE_FEATURE_NUM = 8  // 特性组合的个数
+};
+
+// 解析好但尚未并入共享Mesh的模型
+struct ModelData {
+  ObjLoader loader;
+  MeshBuffer buffer;
+  std::map<std::string, int> materialMap;  // MTL中的材质名 -> materials下标
+  std::vector<Material> materials;
+  std::vector<std::string> textureNames;  // 材质引用的纹理，加载时预取
+};
+
+// 已经求得的首次击中点信息，着色时不再重复求交和采样直接光照
+struct PrimarySample {
+  HitResult hit;
+  Vec3<float> diffusion;
+  Vec3<float> direct;
+};
+
 class Tracer {
  private:
-  BVH *scenes;
-  std::vector<Hittable *> objects;
+  // 一条相机光线的积分器内核
+  typedef Vec3<float> (Tracer::*Kernel)(const Ray &, AOVSample *,
+                                        const PrimarySample *);
+  // 首次击中点的着色
+  typedef void (Tracer::*PrimaryShader)(const Ray &, PrimarySample &) const;
+
+ private:
+  LinearBVH *scenes;
+  CompressedBVH *compressedScenes;
+  BVHReport bvhReport;  // 加载后统计的BVH质量指标
+  const Hittable *accelerator;  // 求交使用的加速结构
+  bool compressBVH;
+  Mesh mesh;                        // 所有模型共享的几何与材质缓冲
+  std::vector<Hittable *> objects;  // 指向mesh中的三角形，下标即id
+  // 加载的OBJ/MTL/XML源文件，以及它们内容的哈希；哈希需要完整读一遍源文件，
+  // 只在用到场景缓存、分块文件或检查点时由getSourceHash求一次
+  std::string sourcePath;
+  std::vector<std::string> sourceModels;
+  std::string sourceConfig;
+  uint64_t sourceHash;
+  bool sourceHashed;
+  std::string cacheName;  // 场景缓存文件，为空时不使用缓存
+  SceneCache sceneCache;
+  std::string chunkName;  // 核外几何的分块文件，为空时整个场景常驻内存
+  size_t chunkBudget;
+  size_t chunkTriangles;
+  ChunkedScene chunkedScene;
   Camera camera;
   Light light;
   size_t maxDepth;
   size_t samples;
   float thresholdP;
+  bool denoise;
+  Denoiser denoiser;
+  PhotonMap photonMap;
+  size_t photonNum;    // 发射光子数，为0时不使用光子图
+  size_t gatherDepth;  // 从该深度起用光子图代替递归求间接光
+  float photonRadius;
+  IntegratorConfig integrator;
+  ResamplingConfig resampling;
+  Checkpoint checkpoint;
+  double checkpointInterval;  // 两次检查点之间的秒数
+  RenderStats stats;          // 最近一次渲染的计数，定义SRE_STATS时才统计
+  unsigned features;          // SceneFeature的组合
+  Kernel kernel;              // 按features和积分器选出的内核
+  PrimaryShader primaryShader;  // 按features选出的首次击中着色
 
  private:
   bool loadConfiguration(
       const std::string &configName,
       std::unordered_map<std::string, Vec3<float>> &lightRadiances);
-  bool loadModel(
+  // 只读取文件，不修改Tracer，可以对多个模型并发调用
+  bool parseModel(
       const std::string &modelName, const std::string &pathName,
+      const std::unordered_map<std::string, Vec3<float>> &lightRadiances,
+      ModelData &model) const;
+  // 并入共享Mesh，三角形按模型中的顺序追加
+  void appendModel(const ModelData &model);
+  // 加载所有模型到mesh并构建scenes
+  bool loadModels(
+      const std::string &pathName, const std::vector<std::string> &modelNames,
       const std::unordered_map<std::string, Vec3<float>> &lightRadiances);
-  Vec3<float> trace(const Ray &ray, size_t depth);
+  // 核外几何时一遍的渲染：首次求交按批进行，同一块的光线一起处理
+  void renderBatched(FrameBuffer &frame, size_t pass);
+  // 在已求得的首次击中点g.hit上计算漫反射率和直接光照，按features分派
+  void shadePrimary(const Ray &ray, PrimarySample &g) const;
+  template <unsigned F>
+  void shadePrimary(const Ray &ray, PrimarySample &g) const;
+  void renderResampled(FrameBuffer &frame);
+  Vec3<float> sample(const Ray &ray, AOVSample *aov,
+                     const PrimarySample *primary = nullptr);
+  // 检测场景特性并选出对应的内核，每次渲染前调用一次
+  void selectKernel();
+  template <size_t... F>
+  static Kernel getKernel(unsigned mask, bool iterative,
+                          std::index_sequence<F...>);
+  template <size_t... F>
+  static PrimaryShader getPrimaryShader(unsigned mask,
+                                        std::index_sequence<F...>);
+  // F为SceneFeature的组合
+  // coneWidth为光锥在光线起点处的宽度，用于选择纹理的mipmap层级
+  template <unsigned F>
+  Vec3<float> trace(const Ray &ray, size_t depth, AOVSample *aov = nullptr,
+                    const PrimarySample *primary = nullptr,
+                    float coneWidth = 0);
+  template <unsigned F>
+  Vec3<float> traceRecursive(const Ray &ray, AOVSample *aov,
+                             const PrimarySample *primary);
+  template <unsigned F>
+  Vec3<float> traceIterative(const Ray &ray, AOVSample *aov,
+                             const PrimarySample *primary);
+  // 击中点的漫反射率，coneWidth为击中点处光锥的宽度
+  template <unsigned F>
+  Vec3<float> getDiffusion(const HitResult &res, const Ray &ray,
+                           float coneWidth) const;
+  // 击中三角形的纹理坐标与纹素比例，核外几何时需要换入三角形所在的块
+  Vec2<float> getTexCoord(const HitResult &res) const;
+  float getTexelScale(const HitResult &res) const;
+  // 击中点处光锥在纹理坐标下的宽度，coneWidth为击中点处光锥的宽度
+  float getFootprint(const HitResult &res, const Ray &ray,
+                     float coneWidth) const;
+  template <unsigned F>
+  Vec3<float> sampleDirect(const Vec3<float> &p, const Vec3<float> &N,
+                           const Vec3<float> &diffusion) const;
+  // 光源样本对着色点的贡献（不含pdf），shadow为true时检查遮挡
+  Vec3<float> evalLight(const Vec3<float> &p, const Vec3<float> &N,
+                        const Vec3<float> &diffusion, const LightSample &s,
+                        bool shadow) const;
+  Reservoir sampleReservoir(const Vec3<float> &p, const Vec3<float> &N,
+                            const Vec3<float> &diffusion) const;
+  void combineReservoir(Reservoir &dst, const Reservoir &src,
+                        const Vec3<float> &p, const Vec3<float> &N,
+                        const Vec3<float> &diffusion) const;
+  // 渲染前的预处理：光子图、积分器参数调整
+  void prepare();
+  void tuneIntegrator();
+  // 影响样本的场景与渲染参数的哈希，不一致的检查点不能继续
+  uint64_t getSourceHash();
+  uint64_t getConfigHash();
   void printStatus();
 
  public:
@@ -40,7 +214,48 @@ class Tracer {
 
   void load(const std::string &pathName, const std::vector<std::string> &modelNames,
             const std::string &configName);
+  // getter.
+  const Camera &getCamera() const;
+  const Mesh &getMesh() const;
+  // 场景的扁平BVH，核外几何时为空
+  const LinearBVH *getBVH() const;
+  // 加载后的BVH诊断，可用write导出JSON比较不同的构建方式
+  const BVHReport &getBVHReport() const;
+  // 最近一次渲染各线程合并后的计数（不含光子图和参数调整）
+  const RenderStats &getStats() const;
+  // setter.
+  // 缓存加载好的三角形和BVH，源文件未改动时下次直接映射缓存文件
+  void setSceneCache(const std::string &fileName);
+  // 求交改用由scenes合并量化得到的4叉BVH，节点更小，结果不变
+  void setCompressedBVH(bool enable);
+  // 核外几何：场景按空间划分为每块不超过chunkTriangles个三角形的块写入文件，
+  // 渲染时按需映射，常驻的块不超过budget字节；文件不存在或源文件改动时先完整加载一次再写出
+  // 开启后不使用场景缓存、压缩BVH和光子图
+  void setOutOfCore(const std::string &fileName, size_t budget = 1 << 30,
+                    size_t chunkTriangles = 1 << 16);
+  // 纹理缓存的内存预算（字节），为0时不限制
+  void setTextureBudget(size_t bytes);
+  void setDenoise(bool enable, size_t iterations = 5);
+  // gatherDepth为0时直接在首次击中点查询光子图，为1时做一次最终聚集
+  void setPhotonMap(size_t num, size_t gatherDepth = 1, float radius = 0);
+  void setIntegrator(const IntegratorConfig &config);
+  void setResampling(const ResamplingConfig &config);
+  // 光源三角形按立体角采样（默认开启），关闭时按面积采样
+  void setSolidAngleSampling(bool enable);
+  // 逐遍渲染时每隔interval秒在后台把帧缓冲写入检查点文件，最后一遍完成后也写一次；
+  // 文件存在且参数一致时从中断处继续，结果与不中断渲染相同的样本数一致
+  void setCheckpoint(const std::string &fileName, double interval = 600);
+
   cv::Mat render();
+  // 渲染并返回浮点帧缓冲（颜色均值及AOV）
+  void render(FrameBuffer &frame);
+  // 按块渲染，每块完成后直接写入HDR文件（.exr或.pfm），不保留整帧；
+  // 不做降噪和蓄水池复用，输出为线性颜色，8位图像由ToneMapper另行生成
+  bool render(const std::string &fileName, int tileSize = 64);
+  // 遍历开销热度图：每个像素首次光线和整条路径（含阴影光线）访问的BVH节点数与
+  // 三角形求交数，取samples个样本的平均；写出baseName-primary.pfm和baseName-path.pfm
+  // （R为节点数，G为三角形数），以及同名.png的节点数伪彩色图（按99%分位数归一化）
+  bool renderHeatmap(const std::string &baseName, size_t samples = 1);
 };
 }  // namespace sre
 
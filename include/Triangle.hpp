@@ -8,22 +8,16 @@
 
 namespace sre {
 
+class Mesh;
+
+// 三角形视图，顶点、法向量、纹理坐标和材质都保存在Mesh的共享缓冲中，
+// id即三角形在Mesh中的下标
 class Triangle : public Hittable {
  private:
-  Vec3<float> v1, v2, v3;     // 顶点坐标
-  Vec2<float> vt1, vt2, vt3;  // 纹理坐标
-  Vec3<float> normal;         // 法向量
-  Material material;          // 材质
+  const Mesh* mesh;
 
  public:
-  Triangle(size_t id, const Vec3<float>& _v1, const Vec3<float>& _v2,
-           const Vec3<float>& _v3, const Material& _m);
-  Triangle(size_t id, const Vec3<float>& _v1, const Vec3<float>& _v2,
-           const Vec3<float>& _v3, const Vec3<float>& _n, const Material& _m);
-  Triangle(size_t id, const Vec3<float>& _v1, const Vec3<float>& _v2,
-           const Vec3<float>& _v3, const Vec2<float>& _vt1,
-           const Vec2<float>& _vt2, const Vec2<float>& _vt3,
-           const Vec3<float>& _n, const Material& _m);
+  Triangle(size_t id, const Mesh* _mesh);
   ~Triangle();
 
  public:
@@ -31,8 +25,14 @@ class Triangle : public Hittable {
   virtual Vec3<float> getMinXYZ() const override;
   virtual Vec3<float> getMaxXYZ() const override;
   virtual Vec2<float> getTexCoord(const Vec3<float>& coord) const override;
+  virtual float getTexelScale() const override;
   Vec3<float> getRandomPoint() const;
-  Material getMaterial() const;
+  // 在从p看到的球面三角形上按立体角均匀采样，pdf为立体角测度
+  // 立体角过小或过大（数值不稳定）时返回false
+  bool getRandomPoint(const Vec3<float>& p, Vec3<float>& point,
+                      float& pdf) const;
+  Vec3<float> getNormal() const;
+  const Material& getMaterial() const;
   float getSize() const;
 
   // print
@@ -3,6 +3,7 @@
 
 #include <cmath>
 #include <functional>
+#include <type_traits>
 
 #define PI M_PI
 
@@ -68,9 +69,15 @@ struct Vec3 {
   Vec3<T> operator*(const Vec3<T>& other) const {
     return Vec3<T>(x * other.x, y * other.y, z * other.z);
   }
+  // 浮点向量除以标量时求一次倒数，再做三次乘法
   template <typename K>
   Vec3<T> operator/(const K& k) const {
-    return Vec3<T>(x / k, y / k, z / k);
+    if constexpr (std::is_floating_point<T>::value) {
+      T inv = static_cast<T>(1) / static_cast<T>(k);
+      return Vec3<T>(x * inv, y * inv, z * inv);
+    } else {
+      return Vec3<T>(x / k, y / k, z / k);
+    }
   }
   Vec3<T>& operator-=(const Vec3<T>& other) {
     x -= other.x;
@@ -93,25 +100,24 @@ struct Vec3 {
   }
   template <typename K>
   Vec3<T>& operator/=(const K& k) {
-    x /= k;
-    y /= k;
-    z /= k;
+    *this = *this / k;
     return *this;
   }
 
+  // std::sqrt对float取单精度版本，不经过double
   Vec3<T>& normalize() {
-    float d = sqrt(x * x + y * y + z * z);
-    x /= d;
-    y /= d;
-    z /= d;
+    T inv = static_cast<T>(1) / std::sqrt(x * x + y * y + z * z);
+    x *= inv;
+    y *= inv;
+    z *= inv;
     return *this;
   }
 
-  T length() const { return sqrt(x * x + y * y + z * z); }
+  T length() const { return std::sqrt(x * x + y * y + z * z); }
 
   static Vec3<T> normalize(const Vec3<T>& v) {
-    float d = sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
-    return Vec3<T>(v.x / d, v.y / d, v.z / d);
+    T inv = static_cast<T>(1) / std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+    return Vec3<T>(v.x * inv, v.y * inv, v.z * inv);
   }
 
   static Vec3<T> cross(const Vec3<T>& v1, const Vec3<T>& v2) {
@@ -124,7 +130,7 @@ struct Vec3 {
   }
 
   static T distance(const Vec3<T>& v1, const Vec3<T>& v2) {
-    return sqrt((v1.x - v2.x) * (v1.x - v2.x) + (v1.y - v2.y) * (v1.y - v2.y) +
+    return std::sqrt((v1.x - v2.x) * (v1.x - v2.x) + (v1.y - v2.y) * (v1.y - v2.y) +
                 (v1.z - v2.z) * (v1.z - v2.z));
   }
 };
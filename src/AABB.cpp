@@ -37,65 +37,29 @@ void AABB::printStatus() const {
 }
 
 void AABB::hit(const Ray& ray, HitResult& res) const {
+  // slab测试：按方向的符号选出近、远平面，乘以预先求好的方向倒数；
+  // 方向分量为0且原点恰在平面上时为NaN，此时不收缩区间
+  const int* sign = ray.getSign();
   Vec3<float> origin = ray.getOrigin();
-  Vec3<float> direction = ray.getDirection();
-  Vec3<float> tMin, tMax;
+  Vec3<float> invDir = ray.getInvDirection();
+  Vec3<float> nearXYZ(sign[0] ? maxXYZ.x : minXYZ.x,
+                      sign[1] ? maxXYZ.y : minXYZ.y,
+                      sign[2] ? maxXYZ.z : minXYZ.z);
+  Vec3<float> farXYZ(sign[0] ? minXYZ.x : maxXYZ.x,
+                     sign[1] ? minXYZ.y : maxXYZ.y,
+                     sign[2] ? minXYZ.z : maxXYZ.z);
+  Vec3<float> tNear = (nearXYZ - origin) * invDir;
+  Vec3<float> tFar = (farXYZ - origin) * invDir;
 
-  if (fabs(direction.x) < 0.000001f) {
-    // 若射线方向矢量的x轴分量为0且原点不在盒体内
-    if (!(minXYZ.x <= origin.x && origin.x <= maxXYZ.x)) {
-      res.isHit = false;
-      return;
-    }
-  } else {
-    if (direction.x >= 0) {
-      tMin.x = (minXYZ.x - origin.x) / direction.x;
-      tMax.x = (maxXYZ.x - origin.x) / direction.x;
-    } else {
-      tMin.x = (maxXYZ.x - origin.x) / direction.x;
-      tMax.x = (minXYZ.x - origin.x) / direction.x;
-    }
-  }
-
-  if (fabs(direction.y) < 0.000001f) {
-    // 若射线方向矢量的x轴分量为0且原点不在盒体内
-    if (!(minXYZ.y <= origin.y && origin.y <= maxXYZ.y)) {
-      res.isHit = false;
-      return;
-    }
-  } else {
-    if (direction.y >= 0) {
-      tMin.y = (minXYZ.y - origin.y) / direction.y;
-      tMax.y = (maxXYZ.y - origin.y) / direction.y;
-    } else {
-      tMin.y = (maxXYZ.y - origin.y) / direction.y;
-      tMax.y = (minXYZ.y - origin.y) / direction.y;
-    }
-  }
-
-  if (fabs(direction.z) < 0.000001f) {
-    // 若射线方向矢量的x轴分量为0且原点不在盒体内
-    if (!(minXYZ.z <= origin.z && origin.z <= maxXYZ.z)) {
-      res.isHit = false;
-      return;
-    }
-  } else {
-    if (direction.z >= 0) {
-      tMin.z = (minXYZ.z - origin.z) / direction.z;
-      tMax.z = (maxXYZ.z - origin.z) / direction.z;
-    } else {
-      tMin.z = (maxXYZ.z - origin.z) / direction.z;
-      tMax.z = (minXYZ.z - origin.z) / direction.z;
-    }
-  }
-
-  float t0, t1;
-  // 光线进入平面处（最靠近的平面）的最大t值
-  t0 = std::max(tMin.z, std::max(tMin.y, tMin.x));
-  // 光线离开平面处（最远离的平面）的最小t值
-  t1 = std::min(tMax.z, std::min(tMax.y, tMax.x));
+  float t0 = ray.getTMin(), t1 = ray.getTMax();
+  t0 = tNear.x > t0 ? tNear.x : t0;
+  t0 = tNear.y > t0 ? tNear.y : t0;
+  t0 = tNear.z > t0 ? tNear.z : t0;
+  t1 = tFar.x < t1 ? tFar.x : t1;
+  t1 = tFar.y < t1 ? tFar.y : t1;
+  t1 = tFar.z < t1 ? tFar.z : t1;
   // 当光线 aabb特别薄时，等号也需要成立
   res.isHit = t0 <= t1;
-  return;
+  res.distance = t0;
 }
 }  // namespace sre
@@ -1,5 +1,14 @@
 #include "../include/BVH.hpp"
 
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+#include "../include/Mesh.hpp"
+#include "../include/Profiler.hpp"
+#include "../include/RenderStats.hpp"
+#include "../include/SIMD.hpp"
+
 namespace sre {
 BVHNode::BVHNode(Hittable *object) {
   assert(object != nullptr);
@@ -109,4 +118,835 @@ void BVHNode::hit(const Ray &ray, HitResult &res) const {
     res.isHit = false;
   }
 }
+
+LinearBVH::LinearBVH(const std::vector<Hittable *> &objects,
+                     size_t maxLeafSize)
+    : nodes(nullptr), nodeNum(0), primitives(objects) {
+  SRE_PROFILE_SCOPE("buildBVH");
+  assert(maxLeafSize > 0);
+  if (primitives.empty()) {
+    return;
+  }
+
+  std::vector<AABB> bounds;
+  bounds.reserve(primitives.size());
+  for (const Hittable *object : primitives) {
+    bounds.emplace_back(object);
+  }
+  std::vector<int> ids(primitives.size());
+  for (size_t i = 0; i < ids.size(); i++) {
+    ids[i] = i;
+  }
+  storage.reserve(2 * primitives.size());
+  build(storage, ids, bounds, 0, ids.size(), maxLeafSize);
+  for (size_t i = 0; i < ids.size(); i++) {
+    primitives[i] = objects[ids[i]];
+  }
+  nodes = storage.data();
+  nodeNum = storage.size();
+}
+
+LinearBVH::LinearBVH(const std::vector<LinearBVHSubtree> &subtrees,
+                     const std::vector<size_t> &bases,
+                     const std::vector<Hittable *> &objects)
+    : nodes(nullptr), nodeNum(0) {
+  SRE_PROFILE_SCOPE("buildTopLevel");
+  assert(subtrees.size() == bases.size());
+  // 顶层的图元是各子树的根
+  std::vector<int> topIds;
+  std::vector<AABB> rootBounds;
+  size_t totalNodes = 0, totalPrimitives = 0;
+  for (size_t k = 0; k < subtrees.size(); k++) {
+    if (subtrees[k].nodes.empty()) {
+      continue;
+    }
+    const LinearBVHNode &root = subtrees[k].nodes[0];
+    topIds.push_back(k);
+    rootBounds.emplace_back(
+        Vec3<float>(root.minXYZ[0], root.minXYZ[1], root.minXYZ[2]),
+        Vec3<float>(root.maxXYZ[0], root.maxXYZ[1], root.maxXYZ[2]));
+    totalNodes += subtrees[k].nodes.size();
+    totalPrimitives += subtrees[k].primitiveIds.size();
+  }
+  if (topIds.empty()) {
+    return;
+  }
+
+  std::vector<LinearBVHNode> top;
+  top.reserve(2 * topIds.size());
+  build(top, topIds, rootBounds, 0, topIds.size(), 1);
+  storage.reserve(top.size() + totalNodes);
+  primitives.reserve(totalPrimitives);
+  splice(top, topIds, 0, subtrees, bases, objects);
+  nodes = storage.data();
+  nodeNum = storage.size();
+}
+
+void LinearBVH::buildSubtree(const std::vector<AABB> &bounds,
+                             LinearBVHSubtree &subtree, size_t maxLeafSize) {
+  assert(maxLeafSize > 0);
+  subtree.nodes.clear();
+  subtree.primitiveIds.resize(bounds.size());
+  if (bounds.empty()) {
+    return;
+  }
+  for (size_t i = 0; i < bounds.size(); i++) {
+    subtree.primitiveIds[i] = i;
+  }
+  std::vector<AABB> sortedBounds(bounds);
+  subtree.nodes.reserve(2 * bounds.size());
+  build(subtree.nodes, subtree.primitiveIds, sortedBounds, 0, bounds.size(),
+        maxLeafSize);
+}
+
+int LinearBVH::splice(const std::vector<LinearBVHNode> &top,
+                      const std::vector<int> &topIds, int index,
+                      const std::vector<LinearBVHSubtree> &subtrees,
+                      const std::vector<size_t> &bases,
+                      const std::vector<Hittable *> &objects) {
+  int out = storage.size();
+  const LinearBVHNode &node = top[index];
+  if (node.count == 0) {
+    storage.push_back(node);
+    splice(top, topIds, index + 1, subtrees, bases, objects);
+    int right = splice(top, topIds, node.offset, subtrees, bases, objects);
+    storage[out].offset = right;
+    return out;
+  }
+
+  // 子树整体搬到out处，内部节点的右孩子和叶节点的图元下标分别加上偏移
+  int k = topIds[node.offset];
+  const LinearBVHSubtree &subtree = subtrees[k];
+  int primitiveBase = primitives.size();
+  for (LinearBVHNode child : subtree.nodes) {
+    child.offset += child.count > 0 ? primitiveBase : out;
+    storage.push_back(child);
+  }
+  for (int id : subtree.primitiveIds) {
+    primitives.push_back(objects[bases[k] + id]);
+  }
+  return out;
+}
+
+LinearBVH::LinearBVH(const LinearBVHNode *_nodes, size_t _nodeNum,
+                     const std::vector<Hittable *> &_primitives)
+    : nodes(_nodes), nodeNum(_nodeNum), primitives(_primitives) {}
+
+int LinearBVH::build(std::vector<LinearBVHNode> &storage,
+                     std::vector<int> &ids, std::vector<AABB> &bounds,
+                     int low, int high, size_t maxLeafSize) {
+  int index = storage.size();
+  storage.emplace_back();
+
+  Vec3<float> minXYZ = bounds[low].getMinXYZ(),
+              maxXYZ = bounds[low].getMaxXYZ();
+  Vec3<float> minC = (minXYZ + maxXYZ) * 0.5f, maxC = minC;
+  for (int i = low + 1; i < high; i++) {
+    Vec3<float> a = bounds[i].getMinXYZ(), b = bounds[i].getMaxXYZ();
+    Vec3<float> c = (a + b) * 0.5f;
+    minXYZ = Vec3<float>(std::min(minXYZ.x, a.x), std::min(minXYZ.y, a.y),
+                         std::min(minXYZ.z, a.z));
+    maxXYZ = Vec3<float>(std::max(maxXYZ.x, b.x), std::max(maxXYZ.y, b.y),
+                         std::max(maxXYZ.z, b.z));
+    minC = Vec3<float>(std::min(minC.x, c.x), std::min(minC.y, c.y),
+                       std::min(minC.z, c.z));
+    maxC = Vec3<float>(std::max(maxC.x, c.x), std::max(maxC.y, c.y),
+                       std::max(maxC.z, c.z));
+  }
+
+  LinearBVHNode node;
+  node.minXYZ[0] = minXYZ.x, node.minXYZ[1] = minXYZ.y,
+  node.minXYZ[2] = minXYZ.z;
+  node.maxXYZ[0] = maxXYZ.x, node.maxXYZ[1] = maxXYZ.y,
+  node.maxXYZ[2] = maxXYZ.z;
+
+  if (static_cast<size_t>(high - low) <= maxLeafSize) {
+    node.offset = low;
+    node.count = high - low;
+    storage[index] = node;
+    return index;
+  }
+
+  // 沿质心分布最长的轴按中位数划分
+  Vec3<float> extent = maxC - minC;
+  int axis = 0;
+  if (extent.y > extent.x) {
+    axis = 1;
+  }
+  if (extent.z > (axis == 0 ? extent.x : extent.y)) {
+    axis = 2;
+  }
+  int mid = low + (high - low) / 2;
+  std::vector<int> order(high - low);
+  for (int i = 0; i < high - low; i++) {
+    order[i] = low + i;
+  }
+  auto centroid = [&](int i) {
+    Vec3<float> c = bounds[i].getMinXYZ() + bounds[i].getMaxXYZ();
+    return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+  };
+  std::nth_element(order.begin(), order.begin() + (mid - low), order.end(),
+                   [&](int a, int b) { return centroid(a) < centroid(b); });
+  std::vector<int> sortedIds(high - low);
+  std::vector<AABB> sortedBounds(high - low);
+  for (int i = 0; i < high - low; i++) {
+    sortedIds[i] = ids[order[i]];
+    sortedBounds[i] = bounds[order[i]];
+  }
+  std::copy(sortedIds.begin(), sortedIds.end(), ids.begin() + low);
+  std::copy(sortedBounds.begin(), sortedBounds.end(), bounds.begin() + low);
+
+  // 左孩子紧跟在父节点之后，只需记录右孩子下标
+  build(storage, ids, bounds, low, mid, maxLeafSize);
+  node.offset = build(storage, ids, bounds, mid, high, maxLeafSize);
+  node.count = 0;
+  storage[index] = node;
+  return index;
+}
+
+// getter.
+Vec3<float> LinearBVH::getMinXYZ() const {
+  if (nodeNum == 0) {
+    return Vec3<float>(0, 0, 0);
+  }
+  return Vec3<float>(nodes[0].minXYZ[0], nodes[0].minXYZ[1],
+                     nodes[0].minXYZ[2]);
+}
+Vec3<float> LinearBVH::getMaxXYZ() const {
+  if (nodeNum == 0) {
+    return Vec3<float>(0, 0, 0);
+  }
+  return Vec3<float>(nodes[0].maxXYZ[0], nodes[0].maxXYZ[1],
+                     nodes[0].maxXYZ[2]);
+}
+const LinearBVHNode *LinearBVH::getNodes() const { return nodes; }
+size_t LinearBVH::getNodeNum() const { return nodeNum; }
+const std::vector<Hittable *> &LinearBVH::getPrimitives() const {
+  return primitives;
+}
+
+// print.
+void LinearBVH::printStatus() const {
+  std::cout << "linear BVH" << '\n'
+            << "nodes: " << nodeNum << '\n'
+            << "primitives: " << primitives.size() << '\n'
+            << "memory: " << nodeNum * sizeof(LinearBVHNode) / 1024 << "KB"
+            << '\n';
+  std::cout << std::endl;
+}
+
+static float surfaceArea(const float minXYZ[3], const float maxXYZ[3]) {
+  float d[3];
+  for (int k = 0; k < 3; k++) {
+    d[k] = std::max(maxXYZ[k] - minXYZ[k], 0.0f);
+  }
+  return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+}
+
+static float volume(const float minXYZ[3], const float maxXYZ[3]) {
+  float v = 1;
+  for (int k = 0; k < 3; k++) {
+    v *= std::max(maxXYZ[k] - minXYZ[k], 0.0f);
+  }
+  return v;
+}
+
+BVHReport::BVHReport()
+    : nodeNum(0),
+      leafNum(0),
+      primitiveNum(0),
+      maxDepth(0),
+      meanLeafDepth(0),
+      sahCost(0),
+      overlapRatio(0),
+      emptyRatio(0),
+      memory(0) {}
+
+BVHReport LinearBVH::getReport() const {
+  BVHReport report;
+  report.nodeNum = nodeNum;
+  report.primitiveNum = primitives.size();
+  report.memory = nodeNum * sizeof(LinearBVHNode) +
+                  primitives.size() * sizeof(Hittable *);
+  if (nodeNum == 0) {
+    return report;
+  }
+
+  float rootArea = surfaceArea(nodes[0].minXYZ, nodes[0].maxXYZ);
+  double sah = 0, overlap = 0, empty = 0, leafDepth = 0;
+  size_t overlapNum = 0, emptyNum = 0;
+  std::vector<std::pair<int, size_t>> stack = {{0, 0}};
+  while (!stack.empty()) {
+    int index = stack.back().first;
+    size_t depth = stack.back().second;
+    stack.pop_back();
+    const LinearBVHNode &node = nodes[index];
+    float area = surfaceArea(node.minXYZ, node.maxXYZ);
+    report.maxDepth = std::max(report.maxDepth, depth);
+
+    if (node.count > 0) {
+      report.leafNum++;
+      leafDepth += depth;
+      sah += static_cast<double>(area) * node.count;
+      if (report.depthHistogram.size() <= depth) {
+        report.depthHistogram.resize(depth + 1, 0);
+      }
+      report.depthHistogram[depth]++;
+      if (report.leafSizeHistogram.size() <= static_cast<size_t>(node.count)) {
+        report.leafSizeHistogram.resize(node.count + 1, 0);
+      }
+      report.leafSizeHistogram[node.count]++;
+      continue;
+    }
+
+    sah += area;
+    const LinearBVHNode &left = nodes[index + 1], &right = nodes[node.offset];
+    float lo[3], hi[3];
+    for (int k = 0; k < 3; k++) {
+      lo[k] = std::max(left.minXYZ[k], right.minXYZ[k]);
+      hi[k] = std::min(left.maxXYZ[k], right.maxXYZ[k]);
+    }
+    bool intersects = lo[0] <= hi[0] && lo[1] <= hi[1] && lo[2] <= hi[2];
+    if (area > 0) {
+      overlap += intersects ? surfaceArea(lo, hi) / area : 0;
+      overlapNum++;
+    }
+    float v = volume(node.minXYZ, node.maxXYZ);
+    if (v > 0) {
+      float covered = volume(left.minXYZ, left.maxXYZ) +
+                      volume(right.minXYZ, right.maxXYZ) -
+                      (intersects ? volume(lo, hi) : 0);
+      empty += std::max(1 - covered / v, 0.0f);
+      emptyNum++;
+    }
+    stack.push_back({node.offset, depth + 1});
+    stack.push_back({index + 1, depth + 1});
+  }
+  report.sahCost = rootArea > 0 ? sah / rootArea : 0;
+  report.meanLeafDepth = report.leafNum > 0 ? leafDepth / report.leafNum : 0;
+  report.overlapRatio = overlapNum > 0 ? overlap / overlapNum : 0;
+  report.emptyRatio = emptyNum > 0 ? empty / emptyNum : 0;
+  return report;
+}
+
+bool BVHReport::write(const std::string &fileName) const {
+  std::ofstream ofs(fileName);
+  if (!ofs.is_open()) {
+    return false;
+  }
+  auto writeArray = [&ofs](const std::vector<size_t> &values) {
+    ofs << '[';
+    for (size_t i = 0; i < values.size(); i++) {
+      ofs << (i == 0 ? "" : ", ") << values[i];
+    }
+    ofs << ']';
+  };
+  ofs << "{\n"
+      << "  \"nodes\": " << nodeNum << ",\n"
+      << "  \"leaves\": " << leafNum << ",\n"
+      << "  \"primitives\": " << primitiveNum << ",\n"
+      << "  \"max_depth\": " << maxDepth << ",\n"
+      << "  \"mean_leaf_depth\": " << meanLeafDepth << ",\n"
+      << "  \"sah_cost\": " << sahCost << ",\n"
+      << "  \"overlap_ratio\": " << overlapRatio << ",\n"
+      << "  \"empty_ratio\": " << emptyRatio << ",\n"
+      << "  \"memory_bytes\": " << memory << ",\n"
+      << "  \"leaf_depths\": ";
+  writeArray(depthHistogram);
+  ofs << ",\n  \"leaf_sizes\": ";
+  writeArray(leafSizeHistogram);
+  ofs << "\n}\n";
+  ofs.close();
+  return ofs.good();
+}
+
+void BVHReport::printStatus() const {
+  std::cout << "BVH report" << '\n'
+            << "nodes: " << nodeNum << '\n'
+            << "leaves: " << leafNum << '\n'
+            << "SAH cost: " << sahCost << '\n'
+            << "depth: max " << maxDepth << ", mean leaf " << meanLeafDepth
+            << '\n'
+            << "sibling overlap: " << overlapRatio * 100 << '%' << '\n'
+            << "empty space: " << emptyRatio * 100 << '%' << '\n'
+            << "memory: " << memory / 1024 << "KB" << '\n'
+            << "leaf depths:";
+  for (size_t d = 0; d < depthHistogram.size(); d++) {
+    if (depthHistogram[d] > 0) {
+      std::cout << ' ' << d << ':' << depthHistogram[d];
+    }
+  }
+  std::cout << '\n' << "leaf sizes:";
+  for (size_t s = 0; s < leafSizeHistogram.size(); s++) {
+    if (leafSizeHistogram[s] > 0) {
+      std::cout << ' ' << s << ':' << leafSizeHistogram[s];
+    }
+  }
+  std::cout << '\n';
+  std::cout << std::endl;
+}
+
+// 光线与节点包围盒的slab测试，返回进入距离，与[tMin, tMax]不相交时返回false
+// 按方向的符号直接选出近、远平面，没有除法和分支
+static bool hitNode(const LinearBVHNode &node, const float origin[3],
+                    const float invDir[3], const int sign[3], float tMin,
+                    float tMax, float &tEnter) {
+  float t0 = tMin, t1 = tMax;
+  for (int k = 0; k < 3; k++) {
+    const float *nearXYZ = sign[k] ? node.maxXYZ : node.minXYZ;
+    const float *farXYZ = sign[k] ? node.minXYZ : node.maxXYZ;
+    float tNear = (nearXYZ[k] - origin[k]) * invDir[k];
+    float tFar = (farXYZ[k] - origin[k]) * invDir[k];
+    // 方向分量为0且原点恰在平面上时为NaN，此时不收缩区间
+    t0 = tNear > t0 ? tNear : t0;
+    t1 = tFar < t1 ? tFar : t1;
+  }
+  tEnter = t0;
+  return t0 <= t1;
+}
+
+// 左右孩子的slab测试放在Float4的0、1两路（2、3两路重复），逐路与hitNode相同；
+// 返回击中的孩子的位掩码，tEnter为各路的进入距离
+static int hitChildren(const LinearBVHNode &left, const LinearBVHNode &right,
+                       const Vec3Lanes<Float4> &origin,
+                       const Vec3Lanes<Float4> &invDir, const int sign[3],
+                       float tMin, float tMax, float tEnter[4]) {
+  Float4 nearXYZ[3], farXYZ[3];
+  for (int k = 0; k < 3; k++) {
+    float leftNear = sign[k] ? left.maxXYZ[k] : left.minXYZ[k];
+    float leftFar = sign[k] ? left.minXYZ[k] : left.maxXYZ[k];
+    float rightNear = sign[k] ? right.maxXYZ[k] : right.minXYZ[k];
+    float rightFar = sign[k] ? right.minXYZ[k] : right.maxXYZ[k];
+    nearXYZ[k] = Float4(leftNear, rightNear, leftNear, rightNear);
+    farXYZ[k] = Float4(leftFar, rightFar, leftFar, rightFar);
+  }
+  Vec3Lanes<Float4> tNear =
+      (Vec3Lanes<Float4>(nearXYZ[0], nearXYZ[1], nearXYZ[2]) - origin) * invDir;
+  Vec3Lanes<Float4> tFar =
+      (Vec3Lanes<Float4>(farXYZ[0], farXYZ[1], farXYZ[2]) - origin) * invDir;
+  // 方向分量为0且原点恰在平面上时为NaN，max、min取原有的值，不收缩区间
+  Float4 t0(tMin), t1(tMax);
+  t0 = Float4::max(tNear.x, t0);
+  t0 = Float4::max(tNear.y, t0);
+  t0 = Float4::max(tNear.z, t0);
+  t1 = Float4::min(tFar.x, t1);
+  t1 = Float4::min(tFar.y, t1);
+  t1 = Float4::min(tFar.z, t1);
+  t0.store(tEnter);
+  return ~Float4::moveMask(t0 > t1) & 3;
+}
+
+void LinearBVH::hit(const Ray &ray, HitResult &res) const {
+  res.isHit = false;
+  if (nodeNum == 0) {
+    return;
+  }
+
+  Vec3<float> o = ray.getOrigin(), inv = ray.getInvDirection();
+  float origin[3] = {o.x, o.y, o.z};
+  float invDir[3] = {inv.x, inv.y, inv.z};
+  Vec3Lanes<Float4> originLanes(o), invDirLanes(inv);
+  const int *sign = ray.getSign();
+  // 区间的上界随最近交点收缩，更远的节点和图元直接被剔除
+  Ray clipped = ray;
+  float closest = ray.getTMax();
+  // 按测试的包围盒计数：根节点1次，之后每个内部节点的两个孩子各1次
+  uint64_t visited = 1, tested = 0;
+
+  // 根节点单独测试，之后每个内部节点的两个孩子一起测试，击中的孩子与
+  // 进入距离一起压栈，左孩子先出栈；按进入距离排序的分支难以预测，实测更慢
+  int stack[64];
+  float enter[64];
+  int top = 0;
+  if (!hitNode(nodes[0], origin, invDir, sign, ray.getTMin(), closest,
+               enter[0])) {
+    addTraversal(visited, tested);
+    return;
+  }
+  stack[top++] = 0;
+  while (top > 0) {
+    top--;
+    if (enter[top] > closest) {
+      continue;
+    }
+    const LinearBVHNode &node = nodes[stack[top]];
+
+    if (node.count > 0) {
+      tested += node.count;
+      for (int i = node.offset; i < node.offset + node.count; i++) {
+        HitResult pres;
+        primitives[i]->hit(clipped, pres);
+        if (pres.isHit && pres.distance < closest) {
+          closest = pres.distance;
+          clipped.setTMax(closest);
+          res = pres;
+        }
+      }
+    } else {
+      int left = &node - nodes + 1, right = node.offset;
+      float t0[4];
+      int hits = hitChildren(nodes[left], nodes[right], originLanes,
+                             invDirLanes, sign, ray.getTMin(), closest, t0);
+      visited += 2;
+      assert(top + 2 <= 64);
+      if (hits & 2) {
+        stack[top] = right;
+        enter[top++] = t0[1];
+      }
+      if (hits & 1) {
+        stack[top] = left;
+        enter[top++] = t0[0];
+      }
+    }
+  }
+  addTraversal(visited, tested);
+}
+// 2^e，直接构造浮点数的指数位
+static float exp2i(int e) {
+  uint32_t bits = static_cast<uint32_t>(e + 127) << 23;
+  float f;
+  memcpy(&f, &bits, sizeof(f));
+  return f;
+}
+
+// q * scale不超过255位有效数字的2的幂倍，总是精确的，构建和遍历时结果一致
+static float dequantize(float origin, uint8_t q, float scale) {
+  return origin + q * scale;
+}
+
+// 4路的slab裁剪，逐路与hitNode相同：NaN时不收缩区间
+static void clipSlab(const Float4 &tNear, const Float4 &tFar, Float4 &t0,
+                     Float4 &t1) {
+  t0 = Float4::max(tNear, t0);
+  t1 = Float4::min(tFar, t1);
+}
+
+// 合并后叶节点的最大图元数，不超过4路求交的宽度
+static const int MAX_MERGED_LEAF_SIZE = 4;
+
+// 叶节点中的count（不超过4）个三角形一起求交，逐路与Triangle::hit的运算顺序相同，
+// 判断结果也相同；返回最近的击中三角形在叶中的序号，距离相同时取靠前的，没有时返回-1
+static int hitTriangles(const Mesh &mesh, Hittable *const *triangles,
+                        int count, const Ray &ray) {
+  // [顶点][轴][路]，不足4个时用第一个三角形补齐，补齐的路不参与结果
+  alignas(16) float v[3][3][4];
+  alignas(16) float n[3][4];
+  for (int c = 0; c < 4; c++) {
+    const TriangleIndex &index =
+        mesh.getIndex(triangles[c < count ? c : 0]->getId());
+    for (int k = 0; k < 3; k++) {
+      const Vec3<float> &p = mesh.getPosition(index.v[k]);
+      v[k][0][c] = p.x;
+      v[k][1][c] = p.y;
+      v[k][2][c] = p.z;
+    }
+    const Vec3<float> &normal = mesh.getNormal(index.n);
+    n[0][c] = normal.x;
+    n[1][c] = normal.y;
+    n[2][c] = normal.z;
+  }
+  Vec3Lanes<Float4> v1(Float4::load(v[0][0]), Float4::load(v[0][1]),
+                       Float4::load(v[0][2]));
+  Vec3Lanes<Float4> v2(Float4::load(v[1][0]), Float4::load(v[1][1]),
+                       Float4::load(v[1][2]));
+  Vec3Lanes<Float4> v3(Float4::load(v[2][0]), Float4::load(v[2][1]),
+                       Float4::load(v[2][2]));
+  Vec3Lanes<Float4> normal(Float4::load(n[0]), Float4::load(n[1]),
+                           Float4::load(n[2]));
+  Vec3Lanes<Float4> origin(ray.getOrigin());
+  Vec3Lanes<Float4> direction(ray.getDirection());
+
+  Float4 cosine = Vec3Lanes<Float4>::dot(normal, direction);
+  Float4 t = Vec3Lanes<Float4>::dot(normal, v1 - origin) / cosine;
+  Vec3Lanes<Float4> pe = origin + direction * t - v1;
+  Vec3Lanes<Float4> e1 = v2 - v1;
+  Vec3Lanes<Float4> e2 = v3 - v1;
+  Float4 c1 = Vec3Lanes<Float4>::dot(pe, e1);
+  Float4 c2 = Vec3Lanes<Float4>::dot(pe, e2);
+  Float4 c3 = Vec3Lanes<Float4>::dot(e1, e1);
+  Float4 c4 = Vec3Lanes<Float4>::dot(e2, e2);
+  Float4 c5 = Vec3Lanes<Float4>::dot(e1, e2);
+  Float4 inv = Float4(1.0f) / (c3 * c4 - c5 * c5);
+  Float4 x = (c1 * c4 - c2 * c5) * inv;
+  Float4 y = (c2 * c3 - c1 * c5) * inv;
+
+  // 与标量的判断一致：NaN的重心坐标不会被判为在三角形外
+  Float4 zero(0.0f);
+  int hit = Float4::moveMask(cosine < zero) &
+            Float4::moveMask(t >= Float4(ray.getTMin())) &
+            Float4::moveMask(t <= Float4(ray.getTMax())) &
+            ~Float4::moveMask(x < zero) & ~Float4::moveMask(y < zero) &
+            ~Float4::moveMask(x + y > Float4(1.0f)) & ((1 << count) - 1);
+  if (hit == 0) {
+    return -1;
+  }
+  alignas(16) float distances[4];
+  t.store(distances);
+  int best = -1;
+  for (int c = 0; c < count; c++) {
+    if ((hit & (1 << c)) && (best < 0 || distances[c] < distances[best])) {
+      best = c;
+    }
+  }
+  return best;
+}
+
+static float getSurfaceArea(const LinearBVHNode &node) {
+  float dx = node.maxXYZ[0] - node.minXYZ[0];
+  float dy = node.maxXYZ[1] - node.minXYZ[1];
+  float dz = node.maxXYZ[2] - node.minXYZ[2];
+  return dx * dy + dy * dz + dz * dx;
+}
+
+CompressedBVH::CompressedBVH(const LinearBVH &bvh, const Mesh *_mesh)
+    : primitives(bvh.getPrimitives()),
+      mesh(_mesh),
+      minXYZ{0, 0, 0},
+      maxXYZ{0, 0, 0} {
+  SRE_PROFILE_SCOPE("buildCompressedBVH");
+  if (bvh.getNodeNum() == 0) {
+    return;
+  }
+  const LinearBVHNode *binary = bvh.getNodes();
+  for (int k = 0; k < 3; k++) {
+    minXYZ[k] = binary[0].minXYZ[k];
+    maxXYZ[k] = binary[0].maxXYZ[k];
+  }
+  nodes.reserve(bvh.getNodeNum() / 2 + 1);
+  build(binary, 0);
+}
+
+int CompressedBVH::build(const LinearBVHNode *binary, int index) {
+  int nodeIndex = nodes.size();
+  nodes.emplace_back();
+
+  // 收集至多4个孩子，根节点本身是叶节点时只有它自己
+  int children[4];
+  int childNum = 0;
+  const LinearBVHNode &parent = binary[index];
+  if (parent.count > 0) {
+    children[childNum++] = index;
+  } else {
+    children[childNum++] = index + 1;
+    children[childNum++] = parent.offset;
+    while (childNum < 4) {
+      int best = -1;
+      float bestArea = -1;
+      for (int c = 0; c < childNum; c++) {
+        const LinearBVHNode &node = binary[children[c]];
+        if (node.count == 0 && getSurfaceArea(node) > bestArea) {
+          best = c;
+          bestArea = getSurfaceArea(node);
+        }
+      }
+      if (best < 0) {
+        break;
+      }
+      int expanded = children[best];
+      children[best] = expanded + 1;
+      children[childNum++] = binary[expanded].offset;
+    }
+  }
+
+  CompressedBVHNode node;
+  memset(&node, 0, sizeof(node));
+  node.childNum = childNum;
+  for (int k = 0; k < 3; k++) {
+    float lo = parent.minXYZ[k], hi = parent.maxXYZ[k];
+    node.origin[k] = lo;
+    // 选最小的步长使255步能覆盖整个包围盒
+    int e = -126;
+    if (hi > lo) {
+      int exp;
+      std::frexp((hi - lo) / 255, &exp);
+      e = std::max(exp - 1, -126);
+    }
+    while (e < 127 && dequantize(lo, 255, exp2i(e)) < hi) {
+      e++;
+    }
+    node.exponent[k] = e;
+    float scale = exp2i(e);
+
+    for (int c = 0; c < childNum; c++) {
+      const LinearBVHNode &child = binary[children[c]];
+      float qlo = std::floor((child.minXYZ[k] - lo) / scale);
+      float qhi = std::ceil((child.maxXYZ[k] - lo) / scale);
+      int qMin = static_cast<int>(std::min(std::max(qlo, 0.0f), 255.0f));
+      int qMax = static_cast<int>(std::min(std::max(qhi, 0.0f), 255.0f));
+      // 修正浮点舍入，保证解码结果向外
+      while (qMin > 0 && dequantize(lo, qMin, scale) > child.minXYZ[k]) {
+        qMin--;
+      }
+      while (qMax < 255 && dequantize(lo, qMax, scale) < child.maxXYZ[k]) {
+        qMax++;
+      }
+      node.qMin[k][c] = qMin;
+      node.qMax[k][c] = qMax;
+    }
+  }
+
+  for (int c = 0; c < childNum; c++) {
+    const LinearBVHNode &child = binary[children[c]];
+    if (child.count > 0) {
+      assert(child.count <= 255);
+      node.child[c] = child.offset;
+      node.count[c] = child.count;
+      continue;
+    }
+    // 只有两个叶孩子的小子树直接合并为一个叶节点，两段图元在primitives中相邻
+    const LinearBVHNode &left = binary[children[c] + 1];
+    const LinearBVHNode &right = binary[child.offset];
+    if (left.count > 0 && right.count > 0 &&
+        left.count + right.count <= MAX_MERGED_LEAF_SIZE) {
+      assert(left.offset + left.count == right.offset);
+      node.child[c] = left.offset;
+      node.count[c] = left.count + right.count;
+    } else {
+      node.child[c] = build(binary, children[c]);
+      node.count[c] = 0;
+    }
+  }
+  nodes[nodeIndex] = node;
+  return nodeIndex;
+}
+
+// getter.
+Vec3<float> CompressedBVH::getMinXYZ() const {
+  return Vec3<float>(minXYZ[0], minXYZ[1], minXYZ[2]);
+}
+Vec3<float> CompressedBVH::getMaxXYZ() const {
+  return Vec3<float>(maxXYZ[0], maxXYZ[1], maxXYZ[2]);
+}
+const std::vector<CompressedBVHNode> &CompressedBVH::getNodes() const {
+  return nodes;
+}
+size_t CompressedBVH::getNodeNum() const { return nodes.size(); }
+size_t CompressedBVH::getMemorySize() const {
+  return nodes.size() * sizeof(CompressedBVHNode);
+}
+
+// print.
+void CompressedBVH::printStatus() const {
+  std::cout << "compressed BVH" << '\n'
+            << "nodes: " << nodes.size() << '\n'
+            << "primitives: " << primitives.size() << '\n'
+            << "memory: " << getMemorySize() / 1024 << "KB" << '\n';
+  std::cout << std::endl;
+}
+
+void CompressedBVH::hit(const Ray &ray, HitResult &res) const {
+  res.isHit = false;
+  if (nodes.empty()) {
+    return;
+  }
+
+  Vec3Lanes<Float4> origin(ray.getOrigin());
+  Vec3Lanes<Float4> invDir(ray.getInvDirection());
+  const int *sign = ray.getSign();
+  Ray clipped = ray;
+  float closest = ray.getTMax();
+  uint64_t visited = 0, tested = 0;
+
+  // 每个节点最多压入3个孩子，深度不超过二叉树深度
+  int stack[192];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const CompressedBVHNode &node = nodes[stack[--top]];
+    // 与LinearBVH相同，按测试的包围盒计数，空着的路不算
+    visited += node.childNum;
+
+    // 4个孩子的包围盒一起解码并做slab测试，与dequantize的运算顺序相同；
+    // 按方向的符号选出各轴的近、远平面
+    Vec3Lanes<Float4> base(Vec3<float>(node.origin[0], node.origin[1],
+                                       node.origin[2]));
+    Vec3Lanes<Float4> scale(Vec3<float>(exp2i(node.exponent[0]),
+                                        exp2i(node.exponent[1]),
+                                        exp2i(node.exponent[2])));
+    const uint8_t *qNear[3], *qFar[3];
+    for (int k = 0; k < 3; k++) {
+      qNear[k] = sign[k] ? node.qMax[k] : node.qMin[k];
+      qFar[k] = sign[k] ? node.qMin[k] : node.qMax[k];
+    }
+    Vec3Lanes<Float4> nearXYZ =
+        base + Vec3Lanes<Float4>(Float4::loadBytes(qNear[0]),
+                                 Float4::loadBytes(qNear[1]),
+                                 Float4::loadBytes(qNear[2])) *
+                   scale;
+    Vec3Lanes<Float4> farXYZ =
+        base + Vec3Lanes<Float4>(Float4::loadBytes(qFar[0]),
+                                 Float4::loadBytes(qFar[1]),
+                                 Float4::loadBytes(qFar[2])) *
+                   scale;
+    Vec3Lanes<Float4> tNear = (nearXYZ - origin) * invDir;
+    Vec3Lanes<Float4> tFar = (farXYZ - origin) * invDir;
+    Float4 tEnter(ray.getTMin()), tExit(closest);
+    clipSlab(tNear.x, tFar.x, tEnter, tExit);
+    clipSlab(tNear.y, tFar.y, tEnter, tExit);
+    clipSlab(tNear.z, tFar.z, tEnter, tExit);
+    int missed = Float4::moveMask(tEnter > tExit);
+    float t0[4];
+    tEnter.store(t0);
+
+    // 击中的孩子按进入距离排序，叶节点由近到远立即求交
+    int order[4];
+    int hitNum = 0;
+    for (int c = 0; c < node.childNum; c++) {
+      if (missed & (1 << c)) {
+        continue;
+      }
+      int i = hitNum++;
+      while (i > 0 && t0[order[i - 1]] > t0[c]) {
+        order[i] = order[i - 1];
+        i--;
+      }
+      order[i] = c;
+    }
+    for (int i = 0; i < hitNum; i++) {
+      int c = order[i];
+      if (node.count[c] == 0 || t0[c] > closest) {
+        continue;
+      }
+      tested += node.count[c];
+      if (mesh != nullptr && node.count[c] > 1 &&
+          node.count[c] <= MAX_MERGED_LEAF_SIZE) {
+        // 只对选出的三角形再做一次标量求交来填写交点信息
+        int best = hitTriangles(*mesh, &primitives[node.child[c]],
+                                node.count[c], clipped);
+        if (best < 0) {
+          continue;
+        }
+        HitResult pres;
+        primitives[node.child[c] + best]->hit(clipped, pres);
+        if (pres.isHit) {
+          if (pres.distance < closest) {
+            closest = pres.distance;
+            clipped.setTMax(closest);
+            res = pres;
+          }
+          continue;
+        }
+        // 编译器把标量运算收缩为乘加等情况下两者可能不一致，退回逐个求交
+      }
+      for (int j = node.child[c]; j < node.child[c] + node.count[c]; j++) {
+        HitResult pres;
+        primitives[j]->hit(clipped, pres);
+        if (pres.isHit && pres.distance < closest) {
+          closest = pres.distance;
+          clipped.setTMax(closest);
+          res = pres;
+        }
+      }
+    }
+    // 内部节点由远到近压栈，近的先出栈
+    for (int i = hitNum - 1; i >= 0; i--) {
+      int c = order[i];
+      if (node.count[c] == 0 && t0[c] <= closest) {
+        assert(top < 192);
+        stack[top++] = node.child[c];
+      }
+    }
+  }
+  addTraversal(visited, tested);
+}
 }  // namespace sre
@@ -16,6 +16,11 @@ int Camera::getHeight() const { return height; }
 Vec3<float> Camera::getEye() const { return eye; }
 Vec3<float> Camera::getLookAt() const { return lookat; }
 Vec3<float> Camera::getAxisZ() const { return axisZ; }
+Vec3<float> Camera::getUp() const { return up; }
+float Camera::getFovy() const { return static_cast<float>(fovy); }
+float Camera::getSpreadAngle() const {
+  return actualWidth / static_cast<float>(width) / actualDepth;
+}
 
 // setter.
 void Camera::setWidth(const int& w) {
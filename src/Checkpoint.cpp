@@ -0,0 +1,137 @@
+#include "../include/Checkpoint.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "../include/Profiler.hpp"
+
+namespace sre {
+
+static const char MAGIC[8] = {'S', 'R', 'E', 'C', 'K', 'P', 'T', '\0'};
+
+Checkpoint::Checkpoint() : lastResult(true) {}
+
+Checkpoint::~Checkpoint() { wait(); }
+
+bool Checkpoint::save(const FrameBuffer &frame, const CheckpointHeader &h) {
+  if (pending.valid()) {
+    if (pending.wait_for(std::chrono::seconds(0)) !=
+        std::future_status::ready) {
+      return false;
+    }
+    lastResult = pending.get();
+  }
+
+  // 平面依次为color、albedo、normal各3个，depth、lumM2，最后是样本数
+  size_t n = static_cast<size_t>(frame.width) * frame.height;
+  std::vector<const float *> planes;
+  for (int c = 0; c < 3; c++) {
+    planes.push_back(frame.color[c].data());
+  }
+  for (int c = 0; c < 3; c++) {
+    planes.push_back(frame.albedo[c].data());
+  }
+  for (int c = 0; c < 3; c++) {
+    planes.push_back(frame.normal[c].data());
+  }
+  planes.push_back(frame.depth.data());
+  planes.push_back(frame.lumM2.data());
+  auto snapshot = std::make_shared<std::vector<char>>(
+      sizeof(CheckpointHeader) +
+      n * (planes.size() * sizeof(float) + sizeof(unsigned int)));
+  CheckpointHeader header = h;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.headerSize = sizeof(CheckpointHeader);
+  header.width = frame.width;
+  header.height = frame.height;
+  char *p = snapshot->data();
+  memcpy(p, &header, sizeof(header));
+  p += sizeof(header);
+  for (const float *plane : planes) {
+    memcpy(p, plane, n * sizeof(float));
+    p += n * sizeof(float);
+  }
+  memcpy(p, frame.sampleCount.data(), n * sizeof(unsigned int));
+
+  std::string name = fileName;
+  pending = std::async(std::launch::async, [name, snapshot]() {
+    SRE_PROFILE_SCOPE("writeCheckpoint", name);
+    std::string tmpName = name + ".tmp";
+    std::ofstream ofs(tmpName, std::ios::binary | std::ios::trunc);
+    if (!ofs.is_open()) {
+      return false;
+    }
+    ofs.write(snapshot->data(), snapshot->size());
+    ofs.close();
+    if (!ofs.good() || std::rename(tmpName.c_str(), name.c_str()) != 0) {
+      std::remove(tmpName.c_str());
+      return false;
+    }
+    return true;
+  });
+  return true;
+}
+
+bool Checkpoint::wait() {
+  if (pending.valid()) {
+    lastResult = pending.get();
+  }
+  return lastResult;
+}
+
+bool Checkpoint::load(FrameBuffer &frame, CheckpointHeader &h) const {
+  std::ifstream ifs(fileName, std::ios::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  CheckpointHeader header;
+  if (!ifs.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+      memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+      header.version != VERSION ||
+      header.headerSize != sizeof(CheckpointHeader) ||
+      header.width != h.width || header.height != h.height ||
+      header.seed != h.seed || header.configHash != h.configHash) {
+    return false;
+  }
+
+  FrameBuffer loaded(header.width, header.height);
+  size_t n = static_cast<size_t>(header.width) * header.height;
+  std::vector<float *> planes;
+  for (int c = 0; c < 3; c++) {
+    planes.push_back(loaded.color[c].data());
+  }
+  for (int c = 0; c < 3; c++) {
+    planes.push_back(loaded.albedo[c].data());
+  }
+  for (int c = 0; c < 3; c++) {
+    planes.push_back(loaded.normal[c].data());
+  }
+  planes.push_back(loaded.depth.data());
+  planes.push_back(loaded.lumM2.data());
+  for (float *plane : planes) {
+    if (!ifs.read(reinterpret_cast<char *>(plane), n * sizeof(float))) {
+      return false;
+    }
+  }
+  if (!ifs.read(reinterpret_cast<char *>(loaded.sampleCount.data()),
+                n * sizeof(unsigned int))) {
+    return false;
+  }
+  frame = std::move(loaded);
+  h.passes = header.passes;
+  return true;
+}
+
+// setter.
+void Checkpoint::setFileName(const std::string &name) {
+  wait();
+  fileName = name;
+}
+
+// getter.
+const std::string &Checkpoint::getFileName() const { return fileName; }
+bool Checkpoint::isEnabled() const { return !fileName.empty(); }
+}  // namespace sre
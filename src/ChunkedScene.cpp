@@ -0,0 +1,804 @@
+#include "../include/ChunkedScene.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+
+#include "../include/Profiler.hpp"
+
+namespace sre {
+
+static const char MAGIC[8] = {'S', 'R', 'E', 'C', 'H', 'U', 'N', 'K'};
+static const size_t ALIGNMENT = 64;
+
+static uint64_t alignUp(uint64_t n, uint64_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+// 块内各段相对块起点的偏移
+struct ChunkLayout {
+  uint64_t positions, normals, texcoords, materialIds, triangles, nodes, end;
+};
+
+static ChunkLayout getLayout(const ChunkRecord &r) {
+  ChunkLayout l;
+  l.positions = 0;
+  l.normals = alignUp(l.positions + r.positionNum * 3 * sizeof(float),
+                      ALIGNMENT);
+  l.texcoords = alignUp(l.normals + r.normalNum * 3 * sizeof(float),
+                        ALIGNMENT);
+  l.materialIds = alignUp(l.texcoords + r.texcoordNum * 2 * sizeof(float),
+                          ALIGNMENT);
+  l.triangles = alignUp(l.materialIds + r.materialNum * sizeof(uint32_t),
+                        ALIGNMENT);
+  l.nodes = alignUp(l.triangles + r.triangleNum * sizeof(TriangleIndex),
+                    ALIGNMENT);
+  l.end = l.nodes + r.nodeNum * sizeof(LinearBVHNode);
+  return l;
+}
+
+ChunkedScene::Chunk::Chunk()
+    : mapped(nullptr), mappedSize(0), materialIds(nullptr), bytes(0) {}
+
+ChunkedScene::Chunk::~Chunk() {
+  // BVH节点指向映射内存，先释放BVH
+  bvh.reset();
+  if (mapped != nullptr) {
+    munmap(mapped, mappedSize);
+  }
+}
+
+// 默认预算1GB
+ChunkedScene::ChunkedScene()
+    : fd(-1),
+      budget(static_cast<size_t>(1) << 30),
+      triangleNum(0),
+      usedBytes(0),
+      clock(0),
+      loads(0),
+      evictions(0),
+      batches(0) {}
+
+ChunkedScene::~ChunkedScene() { close(); }
+
+bool ChunkedScene::write(const std::string &fileName, uint64_t hash,
+                         const Mesh &mesh, size_t chunkTriangles) {
+  SRE_PROFILE_SCOPE("writeChunks", fileName);
+  assert(chunkTriangles > 0);
+  size_t n = mesh.indices.size();
+  std::vector<AABB> bounds(n);
+  for (size_t i = 0; i < n; i++) {
+    const TriangleIndex &index = mesh.indices[i];
+    const Vec3<float> &a = mesh.positions[index.v[0]];
+    const Vec3<float> &b = mesh.positions[index.v[1]];
+    const Vec3<float> &c = mesh.positions[index.v[2]];
+    bounds[i] = AABB(Vec3<float>(std::min(a.x, std::min(b.x, c.x)),
+                                 std::min(a.y, std::min(b.y, c.y)),
+                                 std::min(a.z, std::min(b.z, c.z))),
+                     Vec3<float>(std::max(a.x, std::max(b.x, c.x)),
+                                 std::max(a.y, std::max(b.y, c.y)),
+                                 std::max(a.z, std::max(b.z, c.z))));
+  }
+
+  // 沿质心分布最长的轴按中位数划分，块按深度优先顺序排列
+  std::vector<uint32_t> order(n);
+  for (size_t i = 0; i < n; i++) {
+    order[i] = i;
+  }
+  auto centroid = [&](uint32_t i, int axis) {
+    Vec3<float> c = bounds[i].getMinXYZ() + bounds[i].getMaxXYZ();
+    return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+  };
+  std::vector<std::pair<size_t, size_t>> ranges, stack;
+  if (n > 0) {
+    stack.emplace_back(0, n);
+  }
+  while (!stack.empty()) {
+    auto [low, high] = stack.back();
+    stack.pop_back();
+    if (high - low <= chunkTriangles) {
+      ranges.emplace_back(low, high);
+      continue;
+    }
+    float minC[3], maxC[3];
+    for (int k = 0; k < 3; k++) {
+      minC[k] = std::numeric_limits<float>::max();
+      maxC[k] = std::numeric_limits<float>::lowest();
+    }
+    for (size_t i = low; i < high; i++) {
+      for (int k = 0; k < 3; k++) {
+        minC[k] = std::min(minC[k], centroid(order[i], k));
+        maxC[k] = std::max(maxC[k], centroid(order[i], k));
+      }
+    }
+    int axis = 0;
+    for (int k = 1; k < 3; k++) {
+      if (maxC[k] - minC[k] > maxC[axis] - minC[axis]) {
+        axis = k;
+      }
+    }
+    size_t mid = low + (high - low) / 2;
+    std::nth_element(order.begin() + low, order.begin() + mid,
+                     order.begin() + high, [&](uint32_t a, uint32_t b) {
+                       return centroid(a, axis) < centroid(b, axis);
+                     });
+    stack.emplace_back(mid, high);
+    stack.emplace_back(low, mid);
+  }
+
+  // 把一组三角形打包为一块：先建BVH并按叶节点顺序重排三角形，
+  // 再按首次使用的顺序收集块内的顶点属性和材质
+  auto pack = [&](std::vector<uint32_t> &triangles, ChunkRecord &record,
+                  std::vector<char> &data) {
+    std::vector<AABB> localBounds(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+      localBounds[i] = bounds[triangles[i]];
+    }
+    LinearBVHSubtree subtree;
+    LinearBVH::buildSubtree(localBounds, subtree);
+    std::vector<uint32_t> sorted(triangles.size());
+    for (size_t i = 0; i < sorted.size(); i++) {
+      sorted[i] = triangles[subtree.primitiveIds[i]];
+    }
+    triangles.swap(sorted);
+
+    std::unordered_map<uint32_t, uint32_t> positionIds, normalIds,
+        texcoordIds, materialIds;
+    std::vector<float> positions, normals, texcoords;
+    std::vector<uint32_t> materials;
+    std::vector<TriangleIndex> indices(triangles.size());
+    auto remap = [](std::unordered_map<uint32_t, uint32_t> &ids, uint32_t id,
+                    bool &added) {
+      auto itr = ids.emplace(id, static_cast<uint32_t>(ids.size()));
+      added = itr.second;
+      return itr.first->second;
+    };
+    bool added;
+    for (size_t i = 0; i < triangles.size(); i++) {
+      const TriangleIndex &global = mesh.indices[triangles[i]];
+      TriangleIndex &local = indices[i];
+      for (int k = 0; k < 3; k++) {
+        local.v[k] = remap(positionIds, global.v[k], added);
+        if (added) {
+          const Vec3<float> &p = mesh.positions[global.v[k]];
+          positions.insert(positions.end(), {p.x, p.y, p.z});
+        }
+        local.vt[k] = remap(texcoordIds, global.vt[k], added);
+        if (added) {
+          const Vec2<float> &vt = mesh.texcoords[global.vt[k]];
+          texcoords.insert(texcoords.end(), {vt.u, vt.v});
+        }
+      }
+      local.n = remap(normalIds, global.n, added);
+      if (added) {
+        const Vec3<float> &normal = mesh.normals[global.n];
+        normals.insert(normals.end(), {normal.x, normal.y, normal.z});
+      }
+      local.materialId = remap(materialIds, global.materialId, added);
+      if (added) {
+        materials.push_back(global.materialId);
+      }
+    }
+
+    memset(&record, 0, sizeof(record));
+    if (!subtree.nodes.empty()) {
+      memcpy(record.minXYZ, subtree.nodes[0].minXYZ, sizeof(record.minXYZ));
+      memcpy(record.maxXYZ, subtree.nodes[0].maxXYZ, sizeof(record.maxXYZ));
+    }
+    record.positionNum = positions.size() / 3;
+    record.normalNum = normals.size() / 3;
+    record.texcoordNum = texcoords.size() / 2;
+    record.materialNum = materials.size();
+    record.triangleNum = indices.size();
+    record.nodeNum = subtree.nodes.size();
+    ChunkLayout l = getLayout(record);
+    data.assign(l.end, 0);
+    memcpy(&data[l.positions], positions.data(),
+           positions.size() * sizeof(float));
+    memcpy(&data[l.normals], normals.data(), normals.size() * sizeof(float));
+    memcpy(&data[l.texcoords], texcoords.data(),
+           texcoords.size() * sizeof(float));
+    memcpy(&data[l.materialIds], materials.data(),
+           materials.size() * sizeof(uint32_t));
+    memcpy(&data[l.triangles], indices.data(),
+           indices.size() * sizeof(TriangleIndex));
+    memcpy(&data[l.nodes], subtree.nodes.data(),
+           subtree.nodes.size() * sizeof(LinearBVHNode));
+    record.size = data.size();
+  };
+
+  std::string strings;
+  std::vector<MaterialRecord> materials;
+  SceneCache::packMaterials(mesh.materials, materials, strings);
+
+  ChunkedSceneHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.headerSize = sizeof(ChunkedSceneHeader);
+  h.sourceHash = hash;
+  h.stringOffset = alignUp(sizeof(ChunkedSceneHeader), ALIGNMENT);
+  h.stringSize = strings.size();
+  h.materialOffset = alignUp(h.stringOffset + h.stringSize, ALIGNMENT);
+  h.materialNum = materials.size();
+  h.chunkOffset = alignUp(
+      h.materialOffset + h.materialNum * sizeof(MaterialRecord), ALIGNMENT);
+  h.chunkNum = ranges.size();
+  h.triangleNum = n;
+
+  std::string tmpName = fileName + ".tmp";
+  std::ofstream ofs(tmpName, std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open()) {
+    return false;
+  }
+  uint64_t written = 0;
+  auto put = [&](uint64_t offset, const void *bytes, size_t size) {
+    static const char zeros[ALIGNMENT] = {0};
+    while (written < offset) {
+      size_t k = std::min<uint64_t>(ALIGNMENT, offset - written);
+      ofs.write(zeros, k);
+      written += k;
+    }
+    ofs.write(static_cast<const char *>(bytes), size);
+    written = offset + size;
+  };
+  // 文件头和块表最后再写，这里先占位
+  put(h.chunkOffset + h.chunkNum * sizeof(ChunkRecord), nullptr, 0);
+
+  // 逐块打包并立即写出，内存中同时只有一块
+  std::vector<ChunkRecord> records(ranges.size());
+  std::vector<uint32_t> newIds(n);
+  std::vector<uint32_t> emissive;
+  std::vector<char> data;
+  uint64_t firstTriangle = 0;
+  for (size_t k = 0; k < ranges.size(); k++) {
+    std::vector<uint32_t> triangles(order.begin() + ranges[k].first,
+                                    order.begin() + ranges[k].second);
+    pack(triangles, records[k], data);
+    records[k].firstTriangle = firstTriangle;
+    records[k].offset = alignUp(written, CHUNK_ALIGNMENT);
+    put(records[k].offset, data.data(), data.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+      newIds[triangles[i]] = firstTriangle + i;
+      if (mesh.materials[mesh.indices[triangles[i]].materialId].isEmissive()) {
+        emissive.push_back(triangles[i]);
+      }
+    }
+    firstTriangle += triangles.size();
+  }
+
+  // 光源块，打包时同样会重排，之后再取对应的全局编号
+  pack(emissive, h.lights, data);
+  h.lights.offset = alignUp(written, CHUNK_ALIGNMENT);
+  put(h.lights.offset, data.data(), data.size());
+  std::vector<uint32_t> lightIds(emissive.size());
+  for (size_t i = 0; i < emissive.size(); i++) {
+    lightIds[i] = newIds[emissive[i]];
+  }
+  h.lightIdOffset = alignUp(written, ALIGNMENT);
+  put(h.lightIdOffset, lightIds.data(), lightIds.size() * sizeof(uint32_t));
+
+  ofs.seekp(0);
+  ofs.write(reinterpret_cast<const char *>(&h), sizeof(h));
+  ofs.seekp(h.stringOffset);
+  ofs.write(strings.data(), strings.size());
+  ofs.seekp(h.materialOffset);
+  ofs.write(reinterpret_cast<const char *>(materials.data()),
+            materials.size() * sizeof(MaterialRecord));
+  ofs.seekp(h.chunkOffset);
+  ofs.write(reinterpret_cast<const char *>(records.data()),
+            records.size() * sizeof(ChunkRecord));
+  ofs.close();
+  if (!ofs.good() || std::rename(tmpName.c_str(), fileName.c_str()) != 0) {
+    std::remove(tmpName.c_str());
+    return false;
+  }
+  return true;
+}
+
+// 从文件读取bytes字节，读不全时返回false
+static bool readAt(int fd, uint64_t offset, void *bytes, size_t n) {
+  char *p = static_cast<char *>(bytes);
+  while (n > 0) {
+    ssize_t k = pread(fd, p, n, offset);
+    if (k <= 0) {
+      return false;
+    }
+    p += k;
+    offset += k;
+    n -= k;
+  }
+  return true;
+}
+
+bool ChunkedScene::open(const std::string &fileName, uint64_t hash) {
+  close();
+  fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  ChunkedSceneHeader h;
+  if (fstat(fd, &st) != 0 || !readAt(fd, 0, &h, sizeof(h))) {
+    close();
+    return false;
+  }
+  uint64_t size = st.st_size;
+  auto inside = [&](uint64_t offset, uint64_t bytes, uint64_t alignment) {
+    return offset % alignment == 0 && offset <= size && bytes <= size - offset;
+  };
+  auto chunkInside = [&](const ChunkRecord &r) {
+    return inside(r.offset, r.size, CHUNK_ALIGNMENT) &&
+           getLayout(r).end <= r.size;
+  };
+  bool valid =
+      memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.version == VERSION &&
+      h.headerSize == sizeof(ChunkedSceneHeader) && h.sourceHash == hash &&
+      inside(h.stringOffset, h.stringSize, ALIGNMENT) &&
+      inside(h.materialOffset, h.materialNum * sizeof(MaterialRecord),
+             ALIGNMENT) &&
+      inside(h.chunkOffset, h.chunkNum * sizeof(ChunkRecord), ALIGNMENT) &&
+      chunkInside(h.lights) &&
+      inside(h.lightIdOffset, h.lights.triangleNum * sizeof(uint32_t),
+             ALIGNMENT);
+
+  std::string strings;
+  std::vector<MaterialRecord> materialRecords;
+  if (valid) {
+    strings.resize(h.stringSize);
+    materialRecords.resize(h.materialNum);
+    records.resize(h.chunkNum);
+    lightIds.resize(h.lights.triangleNum);
+    valid = readAt(fd, h.stringOffset, &strings[0], strings.size()) &&
+            readAt(fd, h.materialOffset, materialRecords.data(),
+                   materialRecords.size() * sizeof(MaterialRecord)) &&
+            readAt(fd, h.chunkOffset, records.data(),
+                   records.size() * sizeof(ChunkRecord)) &&
+            readAt(fd, h.lightIdOffset, lightIds.data(),
+                   lightIds.size() * sizeof(uint32_t));
+  }
+  // 块按全局编号连续排列，findChunk依赖这一点
+  uint64_t firstTriangle = 0;
+  for (size_t k = 0; valid && k < records.size(); k++) {
+    valid = chunkInside(records[k]) &&
+            records[k].firstTriangle == firstTriangle;
+    firstTriangle += records[k].triangleNum;
+  }
+  valid = valid && firstTriangle == h.triangleNum;
+  for (size_t i = 0; valid && i < lightIds.size(); i++) {
+    valid = lightIds[i] < h.triangleNum;
+  }
+  if (!valid) {
+    close();
+    return false;
+  }
+  SceneCache::unpackMaterials(materialRecords.data(), materialRecords.size(),
+                              strings.data(), strings.size(), materials);
+  triangleNum = h.triangleNum;
+
+  lights.reset(new Chunk());
+  if (!loadChunk(h.lights, *lights)) {
+    close();
+    return false;
+  }
+
+  // 顶层BVH以块为图元，每个叶节点一块
+  std::vector<AABB> bounds;
+  for (const ChunkRecord &r : records) {
+    bounds.emplace_back(Vec3<float>(r.minXYZ[0], r.minXYZ[1], r.minXYZ[2]),
+                        Vec3<float>(r.maxXYZ[0], r.maxXYZ[1], r.maxXYZ[2]));
+  }
+  LinearBVHSubtree top;
+  LinearBVH::buildSubtree(bounds, top, 1);
+  topNodes.swap(top.nodes);
+  topIds.swap(top.primitiveIds);
+
+  slots.reset(new Slot[records.size()]);
+  for (size_t k = 0; k < records.size(); k++) {
+    slots[k].lastUse = 0;
+  }
+  return true;
+}
+
+void ChunkedScene::close() {
+  slots.reset();
+  lights.reset();
+  records.clear();
+  topNodes.clear();
+  topIds.clear();
+  lightIds.clear();
+  materials.clear();
+  triangleNum = 0;
+  usedBytes = 0;
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+}
+
+bool ChunkedScene::isOpen() const { return fd >= 0; }
+
+bool ChunkedScene::loadChunk(const ChunkRecord &record, Chunk &chunk) const {
+  SRE_PROFILE_SCOPE("loadChunk");
+  if (record.triangleNum == 0) {
+    return true;
+  }
+  chunk.mapped =
+      mmap(nullptr, record.size, PROT_READ, MAP_PRIVATE, fd, record.offset);
+  if (chunk.mapped == MAP_FAILED) {
+    chunk.mapped = nullptr;
+    return false;
+  }
+  chunk.mappedSize = record.size;
+  const char *base = static_cast<const char *>(chunk.mapped);
+  ChunkLayout l = getLayout(record);
+
+  // 检查下标，损坏的块不能在遍历时越界
+  const uint32_t *materialIds =
+      reinterpret_cast<const uint32_t *>(base + l.materialIds);
+  const TriangleIndex *tis =
+      reinterpret_cast<const TriangleIndex *>(base + l.triangles);
+  const LinearBVHNode *nodes =
+      reinterpret_cast<const LinearBVHNode *>(base + l.nodes);
+  bool valid = true;
+  for (uint32_t i = 0; valid && i < record.materialNum; i++) {
+    valid = materialIds[i] < materials.size();
+  }
+  for (uint32_t i = 0; valid && i < record.triangleNum; i++) {
+    const TriangleIndex &ti = tis[i];
+    valid = ti.materialId < record.materialNum && ti.n < record.normalNum;
+    for (int k = 0; valid && k < 3; k++) {
+      valid = ti.v[k] < record.positionNum && ti.vt[k] < record.texcoordNum;
+    }
+  }
+  for (uint32_t i = 0; valid && i < record.nodeNum; i++) {
+    const LinearBVHNode &node = nodes[i];
+    valid = node.count > 0
+                ? node.offset >= 0 &&
+                      static_cast<uint64_t>(node.offset) + node.count <=
+                          record.triangleNum
+                : node.count == 0 && node.offset > static_cast<int64_t>(i) &&
+                      static_cast<uint64_t>(node.offset) < record.nodeNum;
+  }
+  if (!valid || record.nodeNum == 0) {
+    return false;
+  }
+
+  // 顶点属性和三角形拷贝到Mesh中，BVH节点直接使用映射内存
+  Mesh &mesh = chunk.mesh;
+  const float *positions = reinterpret_cast<const float *>(base + l.positions);
+  mesh.positions.resize(record.positionNum);
+  for (size_t i = 0; i < mesh.positions.size(); i++) {
+    mesh.positions[i] = Vec3<float>(positions[3 * i], positions[3 * i + 1],
+                                    positions[3 * i + 2]);
+  }
+  const float *normals = reinterpret_cast<const float *>(base + l.normals);
+  mesh.normals.resize(record.normalNum);
+  for (size_t i = 0; i < mesh.normals.size(); i++) {
+    mesh.normals[i] =
+        Vec3<float>(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+  }
+  const float *texcoords = reinterpret_cast<const float *>(base + l.texcoords);
+  mesh.texcoords.resize(record.texcoordNum);
+  for (size_t i = 0; i < mesh.texcoords.size(); i++) {
+    mesh.texcoords[i] = Vec2<float>(texcoords[2 * i], texcoords[2 * i + 1]);
+  }
+  mesh.materials.resize(record.materialNum);
+  for (size_t i = 0; i < mesh.materials.size(); i++) {
+    mesh.materials[i] = materials[materialIds[i]];
+  }
+  mesh.indices.assign(tis, tis + record.triangleNum);
+  mesh.finalize();
+  chunk.materialIds = materialIds;
+
+  for (const Triangle &triangle : mesh.getTriangles()) {
+    chunk.primitives.push_back(const_cast<Triangle *>(&triangle));
+  }
+  chunk.bvh.reset(new LinearBVH(nodes, record.nodeNum, chunk.primitives));
+  chunk.bytes = chunk.mappedSize + mesh.getMemorySize() +
+                chunk.primitives.size() * sizeof(Hittable *);
+  return true;
+}
+
+std::shared_ptr<const ChunkedScene::Chunk> ChunkedScene::acquire(
+    size_t k) const {
+  Slot &slot = slots[k];
+  std::shared_ptr<const Chunk> chunk = std::atomic_load(&slot.chunk);
+  if (chunk != nullptr) {
+    uint64_t now = clock.load(std::memory_order_relaxed);
+    if (slot.lastUse.load(std::memory_order_relaxed) != now) {
+      slot.lastUse.store(now, std::memory_order_relaxed);
+    }
+    return chunk;
+  }
+
+  // 缺失：同一块只由一个线程换入，等待它的线程之后直接使用；
+  // 读取和重建时不持有全局锁，不同块的缺失互不阻塞
+  std::lock_guard<std::mutex> slotLock(slot.loading);
+  chunk = std::atomic_load(&slot.chunk);
+  if (chunk != nullptr) {
+    return chunk;
+  }
+  std::shared_ptr<Chunk> loaded = std::make_shared<Chunk>();
+  if (!loadChunk(records[k], *loaded)) {
+    // 损坏的块当作空块，不再重复读取
+    std::cout << "Chunk loading fails: " << k << std::endl;
+    loaded = std::make_shared<Chunk>();
+  }
+  loads.fetch_add(1, std::memory_order_relaxed);
+  slot.lastUse.store(clock.fetch_add(1, std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  usedBytes.fetch_add(loaded->bytes);
+  std::atomic_store(&slot.chunk, std::shared_ptr<const Chunk>(loaded));
+  if (budget > 0 && usedBytes.load() > budget) {
+    std::lock_guard<std::mutex> lock(loadMutex);
+    evict(k);
+  }
+  return loaded;
+}
+
+void ChunkedScene::evict(size_t keep) const {
+  // 调用者持有loadMutex；正在使用被换出块的线程仍持有shared_ptr，用完后才真正释放
+  while (usedBytes.load() > budget) {
+    Slot *victim = nullptr;
+    uint64_t oldest = UINT64_MAX;
+    for (size_t k = 0; k < records.size(); k++) {
+      uint64_t lastUse = slots[k].lastUse.load(std::memory_order_relaxed);
+      if (k != keep && lastUse < oldest &&
+          std::atomic_load(&slots[k].chunk) != nullptr) {
+        oldest = lastUse;
+        victim = &slots[k];
+      }
+    }
+    if (victim == nullptr) {
+      break;
+    }
+    std::shared_ptr<const Chunk> chunk = std::atomic_exchange(
+        &victim->chunk, std::shared_ptr<const Chunk>());
+    if (chunk != nullptr) {
+      usedBytes.fetch_sub(chunk->bytes);
+      evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+// 光线与包围盒的slab测试，返回进入距离，与[tMin, tMax]不相交时返回false
+static bool hitBox(const LinearBVHNode &node, const float origin[3],
+                   const float invDir[3], const int sign[3], float tMin,
+                   float tMax, float &tEnter) {
+  float t0 = tMin, t1 = tMax;
+  for (int k = 0; k < 3; k++) {
+    const float *nearXYZ = sign[k] ? node.maxXYZ : node.minXYZ;
+    const float *farXYZ = sign[k] ? node.minXYZ : node.maxXYZ;
+    float tNear = (nearXYZ[k] - origin[k]) * invDir[k];
+    float tFar = (farXYZ[k] - origin[k]) * invDir[k];
+    t0 = tNear > t0 ? tNear : t0;
+    t1 = tFar < t1 ? tFar : t1;
+  }
+  tEnter = t0;
+  return t0 <= t1;
+}
+
+void ChunkedScene::getCandidates(
+    const Ray &ray,
+    std::vector<std::pair<float, uint32_t>> &candidates) const {
+  candidates.clear();
+  if (topNodes.empty()) {
+    return;
+  }
+  Vec3<float> o = ray.getOrigin(), inv = ray.getInvDirection();
+  float origin[3] = {o.x, o.y, o.z};
+  float invDir[3] = {inv.x, inv.y, inv.z};
+
+  int stack[64];
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const LinearBVHNode &node = topNodes[stack[--top]];
+    float tEnter;
+    if (!hitBox(node, origin, invDir, ray.getSign(), ray.getTMin(),
+                ray.getTMax(), tEnter)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (int i = node.offset; i < node.offset + node.count; i++) {
+        candidates.emplace_back(tEnter, topIds[i]);
+      }
+    } else {
+      assert(top + 2 <= 64);
+      stack[top++] = node.offset;
+      stack[top++] = &node - topNodes.data() + 1;
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+}
+
+void ChunkedScene::toGlobal(const ChunkRecord &record, const Chunk &chunk,
+                            HitResult &res) const {
+  uint32_t localMaterial = chunk.mesh.getIndex(res.id).materialId;
+  res.material = &materials[chunk.materialIds[localMaterial]];
+  res.id = record.firstTriangle + res.id;
+}
+
+size_t ChunkedScene::findChunk(size_t id) const {
+  assert(id < triangleNum);
+  auto itr = std::upper_bound(
+      records.begin(), records.end(), id,
+      [](size_t id, const ChunkRecord &r) { return id < r.firstTriangle; });
+  return itr - records.begin() - 1;
+}
+
+void ChunkedScene::hit(const Ray &ray, HitResult &res) const {
+  res.isHit = false;
+  static thread_local std::vector<std::pair<float, uint32_t>> candidates;
+  getCandidates(ray, candidates);
+  Ray clipped = ray;
+  for (const auto &[tEnter, k] : candidates) {
+    if (res.isHit && tEnter > res.distance) {
+      break;
+    }
+    std::shared_ptr<const Chunk> chunk = acquire(k);
+    if (chunk->bvh == nullptr) {
+      continue;
+    }
+    HitResult cres;
+    chunk->bvh->hit(clipped, cres);
+    if (cres.isHit && (!res.isHit || cres.distance < res.distance)) {
+      toGlobal(records[k], *chunk, cres);
+      res = cres;
+      clipped.setTMax(res.distance);
+    }
+  }
+}
+
+void ChunkedScene::intersect(const std::vector<Ray> &rays,
+                             std::vector<HitResult> &results) const {
+  size_t n = rays.size();
+  results.assign(n, HitResult());
+  std::vector<std::vector<std::pair<float, uint32_t>>> candidates(n);
+#pragma omp parallel for schedule(dynamic, 256)
+  for (long long i = 0; i < static_cast<long long>(n); i++) {
+    getCandidates(rays[i], candidates[i]);
+  }
+
+  // 每条光线只排在一个队列中，处理完当前块再排到下一个可能更近的块
+  std::vector<uint32_t> cursor(n, 0);
+  std::vector<std::vector<uint32_t>> queues(records.size());
+  for (size_t i = 0; i < n; i++) {
+    if (!candidates[i].empty()) {
+      queues[candidates[i][0].second].push_back(i);
+    }
+  }
+  std::vector<uint32_t> batch;
+  while (true) {
+    // 优先处理已驻留的块，其次是排队光线最多的块
+    int next = -1;
+    bool nextResident = false;
+    for (size_t k = 0; k < queues.size(); k++) {
+      if (queues[k].empty()) {
+        continue;
+      }
+      bool resident = std::atomic_load(&slots[k].chunk) != nullptr;
+      if (next < 0 || (resident && !nextResident) ||
+          (resident == nextResident &&
+           queues[k].size() > queues[next].size())) {
+        next = k;
+        nextResident = resident;
+      }
+    }
+    if (next < 0) {
+      break;
+    }
+    batch.clear();
+    batch.swap(queues[next]);
+    std::shared_ptr<const Chunk> chunk = acquire(next);
+    batches.fetch_add(1, std::memory_order_relaxed);
+
+    if (chunk->bvh != nullptr) {
+#pragma omp parallel for schedule(dynamic, 256)
+      for (long long j = 0; j < static_cast<long long>(batch.size()); j++) {
+        uint32_t i = batch[j];
+        // 已找到的交点之外的部分不再求交
+        Ray clipped = rays[i];
+        if (results[i].isHit) {
+          clipped.setTMax(results[i].distance);
+        }
+        HitResult cres;
+        chunk->bvh->hit(clipped, cres);
+        if (cres.isHit &&
+            (!results[i].isHit || cres.distance < results[i].distance)) {
+          toGlobal(records[next], *chunk, cres);
+          results[i] = cres;
+        }
+      }
+    }
+    for (uint32_t i : batch) {
+      // 进入距离比已有交点还远的块不必再访问
+      uint32_t c = ++cursor[i];
+      if (c < candidates[i].size() &&
+          (!results[i].isHit ||
+           candidates[i][c].first <= results[i].distance)) {
+        queues[candidates[i][c].second].push_back(i);
+      }
+    }
+  }
+}
+
+// setter.
+void ChunkedScene::setBudget(size_t bytes) {
+  std::lock_guard<std::mutex> lock(loadMutex);
+  budget = bytes;
+  if (budget > 0 && slots != nullptr && usedBytes.load() > budget) {
+    evict(records.size());
+  }
+}
+
+// getter.
+Vec3<float> ChunkedScene::getMinXYZ() const {
+  if (topNodes.empty()) {
+    return Vec3<float>(0, 0, 0);
+  }
+  return Vec3<float>(topNodes[0].minXYZ[0], topNodes[0].minXYZ[1],
+                     topNodes[0].minXYZ[2]);
+}
+Vec3<float> ChunkedScene::getMaxXYZ() const {
+  if (topNodes.empty()) {
+    return Vec3<float>(0, 0, 0);
+  }
+  return Vec3<float>(topNodes[0].maxXYZ[0], topNodes[0].maxXYZ[1],
+                     topNodes[0].maxXYZ[2]);
+}
+size_t ChunkedScene::getTriangleNum() const { return triangleNum; }
+size_t ChunkedScene::getChunkNum() const { return records.size(); }
+size_t ChunkedScene::getUsedBytes() const { return usedBytes.load(); }
+const std::vector<Triangle> &ChunkedScene::getLightTriangles() const {
+  return lights->mesh.getTriangles();
+}
+const std::vector<uint32_t> &ChunkedScene::getLightIds() const {
+  return lightIds;
+}
+const std::vector<Material> &ChunkedScene::getMaterials() const {
+  return materials;
+}
+Vec2<float> ChunkedScene::getTexCoord(size_t id, const Vec3<float> &p) const {
+  size_t k = findChunk(id);
+  std::shared_ptr<const Chunk> chunk = acquire(k);
+  if (chunk->bvh == nullptr) {
+    return Vec2<float>(0, 0);
+  }
+  return chunk->mesh.getTriangles()[id - records[k].firstTriangle]
+      .getTexCoord(p);
+}
+float ChunkedScene::getTexelScale(size_t id) const {
+  size_t k = findChunk(id);
+  std::shared_ptr<const Chunk> chunk = acquire(k);
+  if (chunk->bvh == nullptr) {
+    return 0;
+  }
+  return chunk->mesh.getTriangles()[id - records[k].firstTriangle]
+      .getTexelScale();
+}
+
+// print.
+void ChunkedScene::printStatus() const {
+  std::cout << "chunked scene" << '\n'
+            << "chunks: " << records.size() << '\n'
+            << "triangles: " << triangleNum << '\n'
+            << "budget: " << budget / (1024 * 1024) << "MB" << '\n'
+            << "resident: " << usedBytes.load() / (1024 * 1024) << "MB"
+            << '\n'
+            << "chunk loads: " << loads.load() << '\n'
+            << "evictions: " << evictions.load() << '\n'
+            << "ray batches: " << batches.load() << '\n';
+  std::cout << std::endl;
+}
+}  // namespace sre
@@ -0,0 +1,186 @@
+#include "../include/Denoiser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace sre {
+
+// B3样条核
+static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4,
+                                1.0f / 16};
+
+Denoiser::Denoiser(size_t _iterations, float _sigmaColor, float _sigmaNormal,
+                   float _sigmaDepth)
+    : iterations(_iterations),
+      sigmaColor(_sigmaColor),
+      sigmaNormal(_sigmaNormal),
+      sigmaDepth(_sigmaDepth) {}
+
+void Denoiser::setIterations(size_t n) { iterations = n; }
+
+void Denoiser::printStatus() const {
+  std::cout << "denoiser" << '\n'
+            << "iterations: " << iterations << '\n'
+            << "sigma color/normal/depth: " << sigmaColor << '\t'
+            << sigmaNormal << '\t' << sigmaDepth << '\n';
+  std::cout << std::endl;
+}
+
+void Denoiser::denoise(FrameBuffer& frame) const {
+  int width = frame.getWidth(), height = frame.getHeight();
+  size_t n = static_cast<size_t>(width) * height;
+  if (n == 0 || iterations == 0) {
+    return;
+  }
+
+  std::vector<float> irr[3], tmp[3], nrm[3], alb[3];
+  for (int c = 0; c < 3; c++) {
+    irr[c].resize(n);
+    tmp[c].resize(n);
+    nrm[c].resize(n);
+    alb[c].resize(n);
+  }
+  std::vector<float> z(frame.getDepthPlane(), frame.getDepthPlane() + n);
+  std::vector<float> var(n), tmpVar(n);
+
+  // 用反照率解调颜色，反照率接近0（光源、背景）时不解调
+#pragma omp parallel for schedule(static)
+  for (int row = 0; row < height; row++) {
+    for (int col = 0; col < width; col++) {
+      size_t i = static_cast<size_t>(row) * width + col;
+      Vec3<float> nn(frame.getNormalPlane(0)[i], frame.getNormalPlane(1)[i],
+                     frame.getNormalPlane(2)[i]);
+      for (int c = 0; c < 3; c++) {
+        float v = frame.getAlbedoPlane(c)[i];
+        alb[c][i] = v > 1e-3f ? v : 1.0f;
+        irr[c][i] = frame.getColorPlane(c)[i] / alb[c][i];
+      }
+      float len = nn.length();
+      if (len > 0) {
+        nn /= len;
+      }
+      nrm[0][i] = nn.x;
+      nrm[1][i] = nn.y;
+      nrm[2][i] = nn.z;
+      float la = luminance(Vec3<float>(alb[0][i], alb[1][i], alb[2][i]));
+      var[i] = frame.getVariance(row, col) / std::max(la * la, 1e-3f);
+    }
+  }
+
+  for (size_t it = 0; it < iterations; it++) {
+    filter(width, height, 1 << it, irr, var, nrm, z, tmp, tmpVar);
+    for (int c = 0; c < 3; c++) {
+      irr[c].swap(tmp[c]);
+    }
+    var.swap(tmpVar);
+  }
+
+  // 乘回反照率
+  for (int c = 0; c < 3; c++) {
+    float* out = frame.getColorPlane(c);
+#pragma omp parallel for simd schedule(static)
+    for (size_t i = 0; i < n; i++) {
+      out[i] = irr[c][i] * alb[c][i];
+    }
+  }
+}
+
+void Denoiser::filter(int width, int height, int step,
+                      const std::vector<float> (&in)[3],
+                      const std::vector<float>& var,
+                      const std::vector<float> (&n)[3],
+                      const std::vector<float>& z,
+                      std::vector<float> (&out)[3],
+                      std::vector<float>& outVar) const {
+  // sigmaNormal为2的幂时，pow(x, sigmaNormal)可以用连续平方代替
+  int normalPower = static_cast<int>(std::round(std::log2(sigmaNormal)));
+  float invDepth = 1.0f / (sigmaDepth * step);
+
+#pragma omp parallel
+  {
+    // 逐行累加缓冲，内层按列连续访问以便向量化
+    std::vector<float> acc[3], accVar(width), wSum(width), lumP(width),
+        sigmaP(width);
+    for (int c = 0; c < 3; c++) {
+      acc[c].resize(width);
+    }
+
+#pragma omp for schedule(static)
+    for (int row = 0; row < height; row++) {
+      size_t base = static_cast<size_t>(row) * width;
+      for (int x = 0; x < width; x++) {
+        size_t p = base + x;
+        lumP[x] = 0.2126f * in[0][p] + 0.7152f * in[1][p] + 0.0722f * in[2][p];
+        // 方差先做3x3高斯模糊，避免样本全为0的像素拒绝所有邻居
+        float v = 0, vw = 0;
+        for (int dy = -1; dy <= 1; dy++) {
+          for (int dx = -1; dx <= 1; dx++) {
+            int yy = row + dy, xx = x + dx;
+            if (yy < 0 || yy >= height || xx < 0 || xx >= width) {
+              continue;
+            }
+            float k = (dx == 0 ? 2.0f : 1.0f) * (dy == 0 ? 2.0f : 1.0f);
+            v += k * var[static_cast<size_t>(yy) * width + xx];
+            vw += k;
+          }
+        }
+        sigmaP[x] = 1.0f / (sigmaColor * std::sqrt(std::max(v / vw, 0.0f)) +
+                            1e-4f);
+        acc[0][x] = acc[1][x] = acc[2][x] = 0;
+        accVar[x] = wSum[x] = 0;
+      }
+
+      for (int ky = 0; ky < 5; ky++) {
+        int yq = row + (ky - 2) * step;
+        if (yq < 0 || yq >= height) {
+          continue;
+        }
+        for (int kx = 0; kx < 5; kx++) {
+          int offset = (kx - 2) * step;
+          int begin = std::max(0, -offset), end = std::min(width, width - offset);
+          float h = kernel[ky] * kernel[kx];
+          size_t qbase = static_cast<size_t>(yq) * width + offset;
+
+#pragma omp simd
+          for (int x = begin; x < end; x++) {
+            size_t p = base + x, q = qbase + x;
+            float wn = std::max(
+                n[0][p] * n[0][q] + n[1][p] * n[1][q] + n[2][p] * n[2][q], 0.0f);
+            for (int s = 0; s < normalPower; s++) {
+              wn *= wn;
+            }
+            float dz = std::fabs(z[p] - z[q]) / (std::max(z[p], z[q]) + 1e-6f);
+            float lq = 0.2126f * in[0][q] + 0.7152f * in[1][q] +
+                       0.0722f * in[2][q];
+            float w = h * wn * std::exp(-dz * invDepth -
+                                        std::fabs(lumP[x] - lq) * sigmaP[x]);
+            acc[0][x] += w * in[0][q];
+            acc[1][x] += w * in[1][q];
+            acc[2][x] += w * in[2][q];
+            accVar[x] += w * w * var[q];
+            wSum[x] += w;
+          }
+        }
+      }
+
+      for (int x = 0; x < width; x++) {
+        size_t p = base + x;
+        if (wSum[x] > 1e-8f) {
+          float k = 1.0f / wSum[x];
+          out[0][p] = acc[0][x] * k;
+          out[1][p] = acc[1][x] * k;
+          out[2][p] = acc[2][x] * k;
+          outVar[p] = accVar[x] * k * k;
+        } else {
+          // 背景等没有有效引导信息的像素保持原值
+          out[0][p] = in[0][p];
+          out[1][p] = in[1][p];
+          out[2][p] = in[2][p];
+          outVar[p] = var[p];
+        }
+      }
+    }
+  }
+}
+}  // namespace sre
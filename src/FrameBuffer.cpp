@@ -0,0 +1,88 @@
+#include "../include/FrameBuffer.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+#include "../include/ToneMapper.hpp"
+
+namespace sre {
+
+FrameBuffer::FrameBuffer(int w, int h) : width(0), height(0) { resize(w, h); }
+
+void FrameBuffer::resize(int w, int h) {
+  assert(w >= 0 && h >= 0);
+  width = w;
+  height = h;
+  size_t n = static_cast<size_t>(w) * h;
+  for (int c = 0; c < 3; c++) {
+    color[c].assign(n, 0);
+    albedo[c].assign(n, 0);
+    normal[c].assign(n, 0);
+  }
+  depth.assign(n, 0);
+  lumM2.assign(n, 0);
+  sampleCount.assign(n, 0);
+}
+
+void FrameBuffer::addSample(int row, int col, const Vec3<float>& c,
+                            const AOVSample& aov) {
+  assert(row >= 0 && row < height && col >= 0 && col < width);
+  size_t i = static_cast<size_t>(row) * width + col;
+  unsigned int n = ++sampleCount[i];
+  float k = 1.0f / n;
+
+  // Welford：先用旧均值求偏差，再更新均值
+  float lum = luminance(c);
+  float oldLum = luminance(Vec3<float>(color[0][i], color[1][i], color[2][i]));
+  float delta = lum - oldLum;
+
+  color[0][i] += (c.x - color[0][i]) * k;
+  color[1][i] += (c.y - color[1][i]) * k;
+  color[2][i] += (c.z - color[2][i]) * k;
+  albedo[0][i] += (aov.albedo.x - albedo[0][i]) * k;
+  albedo[1][i] += (aov.albedo.y - albedo[1][i]) * k;
+  albedo[2][i] += (aov.albedo.z - albedo[2][i]) * k;
+  normal[0][i] += (aov.normal.x - normal[0][i]) * k;
+  normal[1][i] += (aov.normal.y - normal[1][i]) * k;
+  normal[2][i] += (aov.normal.z - normal[2][i]) * k;
+  depth[i] += (aov.depth - depth[i]) * k;
+
+  lumM2[i] += delta * (lum - (oldLum + delta * k));
+}
+
+// getter.
+int FrameBuffer::getWidth() const { return width; }
+int FrameBuffer::getHeight() const { return height; }
+unsigned int FrameBuffer::getSampleCount(int row, int col) const {
+  return sampleCount[static_cast<size_t>(row) * width + col];
+}
+Vec3<float> FrameBuffer::getColor(int row, int col) const {
+  size_t i = static_cast<size_t>(row) * width + col;
+  return Vec3<float>(color[0][i], color[1][i], color[2][i]);
+}
+float FrameBuffer::getVariance(int row, int col) const {
+  size_t i = static_cast<size_t>(row) * width + col;
+  unsigned int n = sampleCount[i];
+  if (n < 2) {
+    return 0;
+  }
+  return lumM2[i] / (n - 1) / n;
+}
+const float* FrameBuffer::getColorPlane(int c) const { return color[c].data(); }
+const float* FrameBuffer::getAlbedoPlane(int c) const {
+  return albedo[c].data();
+}
+const float* FrameBuffer::getNormalPlane(int c) const {
+  return normal[c].data();
+}
+const float* FrameBuffer::getDepthPlane() const { return depth.data(); }
+float* FrameBuffer::getColorPlane(int c) { return color[c].data(); }
+
+cv::Mat FrameBuffer::toImage() const { return ToneMapper().apply(*this); }
+
+float luminance(const Vec3<float>& c) {
+  return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+}
+
+}  // namespace sre
@@ -0,0 +1,388 @@
+#include "../include/HDRFile.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace sre {
+
+static const uint32_t EXR_MAGIC = 20000630;
+static const uint32_t EXR_VERSION = 2;  // 单部分扫描线文件
+static const int32_t EXR_FLOAT = 2;
+// EXR通道按名称字母序存放
+static const char EXR_CHANNELS[3] = {'B', 'G', 'R'};
+
+static bool hasSuffix(const std::string &s, const std::string &suffix) {
+  if (s.size() < suffix.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < suffix.size(); i++) {
+    char c = s[s.size() - suffix.size() + i];
+    if (c >= 'A' && c <= 'Z') {
+      c = c - 'A' + 'a';
+    }
+    if (c != suffix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// EXR扫描线块：int32 y、int32数据长度，然后是B、G、R三个通道的一行
+static uint64_t getEXRChunkSize(int width) {
+  return 8 + static_cast<uint64_t>(width) * 3 * sizeof(float);
+}
+
+template <typename T>
+static void append(std::string &s, const T &value) {
+  s.append(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+static void appendAttribute(std::string &s, const char *name,
+                            const char *type, const std::string &value) {
+  s.append(name);
+  s.push_back('\0');
+  s.append(type);
+  s.push_back('\0');
+  append(s, static_cast<int32_t>(value.size()));
+  s.append(value);
+}
+
+HDRWriter::HDRWriter()
+    : fd(-1),
+      format(HDRFormat::PFM),
+      width(0),
+      height(0),
+      dataOffset(0),
+      failed(false) {}
+
+HDRWriter::~HDRWriter() { close(); }
+
+bool HDRWriter::writeAt(uint64_t offset, const void *bytes, size_t n) {
+  const char *p = static_cast<const char *>(bytes);
+  while (n > 0) {
+    ssize_t written = pwrite(fd, p, n, offset);
+    if (written <= 0) {
+      failed = true;
+      return false;
+    }
+    p += written;
+    offset += written;
+    n -= written;
+  }
+  return true;
+}
+
+bool HDRWriter::writeHeader() {
+  std::string header;
+  if (format == HDRFormat::PFM) {
+    // 比例因子为负表示小端
+    char buf[64];
+    snprintf(buf, sizeof(buf), "PF\n%d %d\n-1.0\n", width, height);
+    header = buf;
+    dataOffset = header.size();
+    return writeAt(0, header.data(), header.size());
+  }
+
+  append(header, EXR_MAGIC);
+  append(header, EXR_VERSION);
+  std::string channels;
+  for (char name : EXR_CHANNELS) {
+    channels.push_back(name);
+    channels.push_back('\0');
+    append(channels, EXR_FLOAT);
+    append(channels, static_cast<uint32_t>(0));  // pLinear及保留字节
+    append(channels, static_cast<int32_t>(1));   // xSampling
+    append(channels, static_cast<int32_t>(1));   // ySampling
+  }
+  channels.push_back('\0');
+  appendAttribute(header, "channels", "chlist", channels);
+  appendAttribute(header, "compression", "compression", std::string(1, '\0'));
+  std::string box;
+  append(box, static_cast<int32_t>(0));
+  append(box, static_cast<int32_t>(0));
+  append(box, static_cast<int32_t>(width - 1));
+  append(box, static_cast<int32_t>(height - 1));
+  appendAttribute(header, "dataWindow", "box2i", box);
+  appendAttribute(header, "displayWindow", "box2i", box);
+  appendAttribute(header, "lineOrder", "lineOrder", std::string(1, '\0'));
+  std::string one, center;
+  append(one, 1.0f);
+  append(center, 0.0f);
+  append(center, 0.0f);
+  appendAttribute(header, "pixelAspectRatio", "float", one);
+  appendAttribute(header, "screenWindowCenter", "v2f", center);
+  appendAttribute(header, "screenWindowWidth", "float", one);
+  header.push_back('\0');
+
+  // 不压缩时每个块只有一行，块的位置和大小都能提前算出
+  dataOffset = header.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+  uint64_t chunkSize = getEXRChunkSize(width);
+  for (int y = 0; y < height; y++) {
+    append(header, dataOffset + y * chunkSize);
+  }
+  if (!writeAt(0, header.data(), header.size())) {
+    return false;
+  }
+  for (int y = 0; y < height; y++) {
+    int32_t chunk[2] = {y, static_cast<int32_t>(chunkSize - 8)};
+    if (!writeAt(dataOffset + y * chunkSize, chunk, sizeof(chunk))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool HDRWriter::open(const std::string &fileName, int w, int h) {
+  close();
+  if (w <= 0 || h <= 0) {
+    return false;
+  }
+  format = hasSuffix(fileName, ".exr") ? HDRFormat::EXR : HDRFormat::PFM;
+  width = w;
+  height = h;
+  failed = false;
+  fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  if (!writeHeader()) {
+    close();
+    return false;
+  }
+  // 预留整个文件，尚未写入的块读出来为0
+  uint64_t dataSize =
+      format == HDRFormat::PFM
+          ? static_cast<uint64_t>(width) * height * 3 * sizeof(float)
+          : height * getEXRChunkSize(width);
+  if (ftruncate(fd, dataOffset + dataSize) != 0) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+bool HDRWriter::writeTile(int x0, int y0, int w, int h, const float *rgb) {
+  if (fd < 0 || x0 < 0 || y0 < 0 || w <= 0 || h <= 0 || x0 + w > width ||
+      y0 + h > height) {
+    return false;
+  }
+  if (format == HDRFormat::PFM) {
+    // PFM的扫描线从下往上存放，块内一行的像素在文件中是连续的
+    for (int j = 0; j < h; j++) {
+      uint64_t pixel =
+          static_cast<uint64_t>(height - 1 - (y0 + j)) * width + x0;
+      if (!writeAt(dataOffset + pixel * 3 * sizeof(float),
+                   rgb + static_cast<size_t>(j) * w * 3,
+                   static_cast<size_t>(w) * 3 * sizeof(float))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // EXR一行内按通道平面存放，先转成平面再分通道写出
+  std::vector<float> plane(w);
+  uint64_t chunkSize = getEXRChunkSize(width);
+  for (int j = 0; j < h; j++) {
+    const float *row = rgb + static_cast<size_t>(j) * w * 3;
+    uint64_t chunk = dataOffset + (y0 + j) * chunkSize + 8;
+    for (int c = 0; c < 3; c++) {
+      int channel = 2 - c;  // B、G、R依次对应RGB中的2、1、0
+      for (int i = 0; i < w; i++) {
+        plane[i] = row[i * 3 + channel];
+      }
+      uint64_t offset =
+          chunk + (static_cast<uint64_t>(c) * width + x0) * sizeof(float);
+      if (!writeAt(offset, plane.data(), w * sizeof(float))) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool HDRWriter::close() {
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = fsync(fd) == 0 && !failed;
+  ok = ::close(fd) == 0 && ok;
+  fd = -1;
+  return ok;
+}
+
+HDRReader::HDRReader()
+    : fd(-1), format(HDRFormat::PFM), width(0), height(0), dataOffset(0) {}
+
+HDRReader::~HDRReader() { close(); }
+
+bool HDRReader::readPFMHeader() {
+  char buf[128];
+  ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+  if (n <= 0) {
+    return false;
+  }
+  buf[n] = '\0';
+  char magic[3];
+  float scale;
+  int consumed = 0;
+  if (sscanf(buf, "%2s %d %d %f%n", magic, &width, &height, &scale,
+             &consumed) != 4 ||
+      strcmp(magic, "PF") != 0 || scale >= 0 || consumed >= n) {
+    // 只支持三通道、小端的PFM
+    return false;
+  }
+  // 比例因子后恰好一个空白字符
+  dataOffset = consumed + 1;
+  return width > 0 && height > 0;
+}
+
+bool HDRReader::readEXRHeader() {
+  std::vector<char> buf(1 << 16);
+  ssize_t n = pread(fd, buf.data(), buf.size(), 0);
+  if (n < 8) {
+    return false;
+  }
+  uint32_t magic, version;
+  memcpy(&magic, buf.data(), 4);
+  memcpy(&version, buf.data() + 4, 4);
+  if (magic != EXR_MAGIC || (version & 0xff) != EXR_VERSION ||
+      (version & ~0xffu) != 0) {
+    return false;
+  }
+
+  size_t pos = 8;
+  auto readString = [&](std::string &s) {
+    size_t end = pos;
+    while (end < static_cast<size_t>(n) && buf[end] != '\0') {
+      end++;
+    }
+    if (end >= static_cast<size_t>(n)) {
+      return false;
+    }
+    s.assign(buf.data() + pos, end - pos);
+    pos = end + 1;
+    return true;
+  };
+  bool channelsValid = false, compressionValid = false, windowValid = false;
+  while (true) {
+    std::string name, type;
+    if (!readString(name)) {
+      return false;
+    }
+    if (name.empty()) {
+      break;
+    }
+    int32_t size;
+    if (!readString(type) || pos + 4 > static_cast<size_t>(n)) {
+      return false;
+    }
+    memcpy(&size, buf.data() + pos, 4);
+    pos += 4;
+    if (size < 0 || pos + size > static_cast<size_t>(n)) {
+      return false;
+    }
+    const char *value = buf.data() + pos;
+    if (name == "channels") {
+      // 只接受HDRWriter写出的B、G、R三个FLOAT通道
+      std::string expected;
+      for (char c : EXR_CHANNELS) {
+        expected.push_back(c);
+        expected.push_back('\0');
+        append(expected, EXR_FLOAT);
+        append(expected, static_cast<uint32_t>(0));
+        append(expected, static_cast<int32_t>(1));
+        append(expected, static_cast<int32_t>(1));
+      }
+      expected.push_back('\0');
+      channelsValid = std::string(value, size) == expected;
+    } else if (name == "compression") {
+      compressionValid = size == 1 && value[0] == 0;
+    } else if (name == "dataWindow" && size == 16) {
+      int32_t box[4];
+      memcpy(box, value, sizeof(box));
+      width = box[2] - box[0] + 1;
+      height = box[3] - box[1] + 1;
+      windowValid = width > 0 && height > 0;
+    }
+    pos += size;
+  }
+  if (!channelsValid || !compressionValid || !windowValid) {
+    return false;
+  }
+
+  lineOffsets.resize(height);
+  ssize_t tableSize = static_cast<ssize_t>(height) * sizeof(uint64_t);
+  if (pread(fd, lineOffsets.data(), tableSize, pos) != tableSize) {
+    return false;
+  }
+  dataOffset = pos + tableSize;
+  return true;
+}
+
+bool HDRReader::open(const std::string &fileName) {
+  close();
+  format = hasSuffix(fileName, ".exr") ? HDRFormat::EXR : HDRFormat::PFM;
+  fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  bool valid =
+      format == HDRFormat::PFM ? readPFMHeader() : readEXRHeader();
+  if (!valid) {
+    close();
+    return false;
+  }
+  line.resize(static_cast<size_t>(width) * 3);
+  return true;
+}
+
+void HDRReader::close() {
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  width = height = 0;
+  lineOffsets.clear();
+}
+
+bool HDRReader::readLine(int y, float *r, float *g, float *b) {
+  if (fd < 0 || y < 0 || y >= height) {
+    return false;
+  }
+  ssize_t bytes = static_cast<ssize_t>(width) * 3 * sizeof(float);
+  if (format == HDRFormat::PFM) {
+    uint64_t offset = dataOffset + static_cast<uint64_t>(height - 1 - y) *
+                                       width * 3 * sizeof(float);
+    if (pread(fd, line.data(), bytes, offset) != bytes) {
+      return false;
+    }
+    for (int i = 0; i < width; i++) {
+      r[i] = line[i * 3];
+      g[i] = line[i * 3 + 1];
+      b[i] = line[i * 3 + 2];
+    }
+    return true;
+  }
+
+  int32_t chunk[2];
+  if (pread(fd, chunk, sizeof(chunk), lineOffsets[y]) != sizeof(chunk) ||
+      chunk[0] != y || chunk[1] != bytes ||
+      pread(fd, line.data(), bytes, lineOffsets[y] + 8) != bytes) {
+    return false;
+  }
+  memcpy(b, line.data(), width * sizeof(float));
+  memcpy(g, line.data() + width, width * sizeof(float));
+  memcpy(r, line.data() + 2 * width, width * sizeof(float));
+  return true;
+}
+
+// getter.
+int HDRReader::getWidth() const { return width; }
+int HDRReader::getHeight() const { return height; }
+}  // namespace sre
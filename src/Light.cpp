@@ -1,40 +1,110 @@
 #include "../include/Light.hpp"
 
+#include <algorithm>
+
+#include "../include/FrameBuffer.hpp"
 #include "../include/Material.hpp"
 #include "../include/Random.hpp"
 
 namespace sre {
-void Light::getRandomPoint(size_t& id, Vec3<float>& pos, Vec3<float>& radiance,
-                           float& area) const {
+Light::Light() : solidAngleSampling(true) {}
+
+void Light::sample(const Vec3<float>& p, LightSample& s) const {
+  assert(lightAreas.size() != 0 && lightAreas.size() == lightTriangles.size());
+  float pdfLight = 0;
+  size_t idx = getRandomLight(pdfLight);
+  size_t t = getRandomTriangle(idx);
+  const Triangle& triangle = lightTriangles[idx][t];
+  // 选中该三角形的概率
+  float pdfTriangle = pdfLight * triangle.getSize() / lightAreas[idx];
+
+  s.id = lightTriangleIds[idx][t];
+  s.normal = triangle.getNormal();
+  s.radiance = lightRadiances[idx];
+
+  float pdfSolidAngle = 0;
+  if (solidAngleSampling &&
+      triangle.getRandomPoint(p, s.position, pdfSolidAngle)) {
+    // 立体角pdf换算到面积测度：pdf_A = pdf_w * cos / dis^2
+    Vec3<float> d = s.position - p;
+    float dis2 = Vec3<float>::dot(d, d);
+    float cosine = fabs(Vec3<float>::dot(s.normal, d)) / std::sqrt(dis2);
+    s.pdf = pdfTriangle * pdfSolidAngle * cosine / dis2;
+  } else {
+    s.position = triangle.getRandomPoint();
+    s.pdf = pdfTriangle / triangle.getSize();
+  }
+}
+
+void Light::getRandomEmission(Vec3<float>& pos, Vec3<float>& normal,
+                              Vec3<float>& flux) const {
   assert(lightAreas.size() != 0 && lightAreas.size() == lightTriangles.size());
-  int idx = randInt(lightAreas.size());
-  int triangleIdx = randInt(lightTriangles[idx].size());
+  float pdfLight = 0;
+  size_t idx = getRandomLight(pdfLight);
+  const Triangle& triangle = lightTriangles[idx][getRandomTriangle(idx)];
 
-  id = lightTriangles[idx][triangleIdx].getId();
-  pos = lightTriangles[idx][triangleIdx].getRandomPoint();
-  radiance = lightTriangles[idx][triangleIdx].getMaterial().getEmission();
-  area = lightAreas[idx];
+  pos = triangle.getRandomPoint();
+  normal = triangle.getNormal();
+  // 余弦加权发射方向时，通量 = Le * PI * 面积 / 选择概率
+  flux = lightRadiances[idx] * (PI * lightAreas[idx] / pdfLight);
 }
 
-void Light::setLight(const Triangle& triangle) {
+void Light::setSolidAngleSampling(bool enable) { solidAngleSampling = enable; }
+
+bool Light::empty() const { return lightAreas.empty(); }
+
+bool Light::getSolidAngleSampling() const { return solidAngleSampling; }
+
+size_t Light::getRandomLight(float& pdf) const {
+  // 按 亮度 * 面积 选择光源
+  float u = randFloat(powerCdf.back());
+  size_t i = std::lower_bound(powerCdf.begin(), powerCdf.end(), u) -
+             powerCdf.begin();
+  i = std::min(i, powerCdf.size() - 1);
+  pdf = (powerCdf[i] - (i == 0 ? 0 : powerCdf[i - 1])) / powerCdf.back();
+  return i;
+}
+
+size_t Light::getRandomTriangle(size_t idx) const {
+  const std::vector<float>& cdf = lightCdfs[idx];
+  float u = randFloat(cdf.back());
+  size_t i = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+  return std::min(i, cdf.size() - 1);
+}
+
+void Light::setLight(const Triangle& triangle, size_t id) {
   Vec3<float> radiance = triangle.getMaterial().getEmission();
   assert(radiance.x != 0 && radiance.y != 0 && radiance.z != 0);
   assert(lightAreas.size() == lightTriangles.size());
-  int id = lightTriangles.size();
+  int idx = lightTriangles.size();
   if (lightIds.find(radiance) == lightIds.end()) {
-    lightIds[radiance] = id;
+    lightIds[radiance] = idx;
     lightTriangles.push_back({});
+    lightTriangleIds.push_back({});
     lightAreas.push_back(0);
+    lightCdfs.push_back({});
+    lightRadiances.push_back(radiance);
   } else {
-    id = lightIds[radiance];
+    idx = lightIds[radiance];
+  }
+  lightTriangles[idx].emplace_back(triangle);
+  lightTriangleIds[idx].push_back(id == static_cast<size_t>(-1) ? triangle.getId()
+                                                               : id);
+  lightAreas[idx] += triangle.getSize();
+  lightCdfs[idx].push_back(lightAreas[idx]);
+
+  powerCdf.resize(lightAreas.size());
+  for (size_t i = 0; i < lightAreas.size(); i++) {
+    powerCdf[i] = luminance(lightRadiances[i]) * lightAreas[i] +
+                  (i == 0 ? 0 : powerCdf[i - 1]);
   }
-  lightTriangles[id].emplace_back(triangle);
-  lightAreas[id] += triangle.getSize();
 }
 
 void Light::printStatus() const {
   std::cout << "light" << '\n';
-  std::cout << "number of light sources: " << lightIds.size() << '\n';
+  std::cout << "number of light sources: " << lightIds.size() << '\n'
+            << "solid angle sampling: " << (solidAngleSampling ? "on" : "off")
+            << '\n';
   for (auto [r, i] : lightIds) {
     std::cout << "id: " << i << ' ' 
               << "radiance: " << r.x << ' ' << r.y << ' ' << r.z << ' '
@@ -17,25 +17,29 @@ Vec3<float> Material::getEmission() const {
   }
   return Vec3<float>(0, 0, 0);
 }
-Vec3<float> Material::getAmbience(const Vec2<float>& texCoord) const {
+Vec3<float> Material::getAmbience(const Vec2<float>& texCoord,
+                                  float footprint) const {
   if (ambientTexture == nullptr) {
     return ambience;
   } else {
-    return ambientTexture->getColorAt(texCoord);
+    return ambientTexture->getColorAt(texCoord, footprint);
   }
 }
-Vec3<float> Material::getDiffusion(const Vec2<float>& texCoord) const {
+Vec3<float> Material::getDiffusion(const Vec2<float>& texCoord,
+                                   float footprint) const {
   if (diffuseTexture == nullptr) {
     return diffusion;
   } else {
-    return diffuseTexture->getColorAt(texCoord) * diffusion;
+    return diffuseTexture->getColorAt(texCoord, footprint) * diffusion;
   }
 }
-Vec3<float> Material::getSpecularity(const Vec2<float>& texCoord) const {
+Vec3<float> Material::getDiffusion() const { return diffusion; }
+Vec3<float> Material::getSpecularity(const Vec2<float>& texCoord,
+                                     float footprint) const {
   if (specularTexture == nullptr) {
     return specularity;
   } else {
-    return specularTexture->getColorAt(texCoord) * specularity;
+    return specularTexture->getColorAt(texCoord, footprint) * specularity;
   }
 }
 Vec3<float> Material::getTransmittance() const { return transmittance; }
@@ -50,6 +54,7 @@ bool Material::isSpecular() const {
   return specularity.x != 0 || specularity.y != 0 || specularity.z != 0;
 }
 bool Material::isTransmissive() const { return refraction > 1.0f; }
+bool Material::isTextured() const { return diffuseTexture != nullptr; }
 
 void Material::setName(const std::string& n) { name = n; }
 void Material::setEmissive(bool e) { emisssive = e; }
@@ -0,0 +1,129 @@
+#include "../include/Mesh.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <iostream>
+
+#include "../include/Profiler.hpp"
+
+namespace sre {
+
+uint32_t Mesh::addPosition(const Vec3<float> &position) {
+  auto itr = positionIds.find(position);
+  if (itr != positionIds.end()) {
+    return itr->second;
+  }
+  uint32_t id = positions.size();
+  positions.push_back(position);
+  positionIds.emplace(position, id);
+  return id;
+}
+
+uint32_t Mesh::addNormal(const Vec3<float> &normal) {
+  Vec3<float> n = Vec3<float>::normalize(normal);
+  auto itr = normalIds.find(n);
+  if (itr != normalIds.end()) {
+    return itr->second;
+  }
+  uint32_t id = normals.size();
+  normals.push_back(n);
+  normalIds.emplace(n, id);
+  return id;
+}
+
+uint32_t Mesh::addTexCoord(const Vec2<float> &texcoord) {
+  // 两个分量的位模式拼成一个键
+  uint32_t u, v;
+  memcpy(&u, &texcoord.u, sizeof(u));
+  memcpy(&v, &texcoord.v, sizeof(v));
+  uint64_t key = static_cast<uint64_t>(u) << 32 | v;
+  auto itr = texcoordIds.find(key);
+  if (itr != texcoordIds.end()) {
+    return itr->second;
+  }
+  uint32_t id = texcoords.size();
+  texcoords.push_back(texcoord);
+  texcoordIds.emplace(key, id);
+  return id;
+}
+
+uint32_t Mesh::addMaterial(const Material &material) {
+  materials.push_back(material);
+  return materials.size() - 1;
+}
+
+void Mesh::addTriangle(const TriangleIndex &index) {
+  assert(triangles.empty());
+  assert(index.v[0] < positions.size() && index.v[1] < positions.size() &&
+         index.v[2] < positions.size());
+  assert(index.vt[0] < texcoords.size() && index.vt[1] < texcoords.size() &&
+         index.vt[2] < texcoords.size());
+  assert(index.n < normals.size() && index.materialId < materials.size());
+  indices.push_back(index);
+}
+
+void Mesh::finalize() {
+  SRE_PROFILE_SCOPE("finalizeMesh");
+  std::unordered_map<Vec3<float>, uint32_t>().swap(positionIds);
+  std::unordered_map<Vec3<float>, uint32_t>().swap(normalIds);
+  std::unordered_map<uint64_t, uint32_t>().swap(texcoordIds);
+  positions.shrink_to_fit();
+  normals.shrink_to_fit();
+  texcoords.shrink_to_fit();
+  materials.shrink_to_fit();
+  indices.shrink_to_fit();
+
+  // 三角形id与下标一致
+  triangles.clear();
+  triangles.reserve(indices.size());
+  for (size_t i = 0; i < indices.size(); i++) {
+    triangles.emplace_back(i, this);
+  }
+}
+
+void Mesh::clear() {
+  positions.clear();
+  normals.clear();
+  texcoords.clear();
+  materials.clear();
+  indices.clear();
+  triangles.clear();
+  positionIds.clear();
+  normalIds.clear();
+  texcoordIds.clear();
+}
+
+size_t Mesh::getMemorySize() const {
+  return positions.capacity() * sizeof(Vec3<float>) +
+         normals.capacity() * sizeof(Vec3<float>) +
+         texcoords.capacity() * sizeof(Vec2<float>) +
+         materials.capacity() * sizeof(Material) +
+         indices.capacity() * sizeof(TriangleIndex) +
+         triangles.capacity() * sizeof(Triangle);
+}
+
+// print.
+void Mesh::printStatus() const {
+  size_t bytes = getMemorySize();
+  std::cout << "mesh" << '\n'
+            << "triangles: " << indices.size() << '\n'
+            << "positions: " << positions.size() << '\n'
+            << "normals: " << normals.size() << '\n'
+            << "texcoords: " << texcoords.size() << '\n'
+            << "materials: " << materials.size() << '\n'
+            << "memory: " << bytes / 1024 << "KB" << '\n'
+            << "  positions: " << positions.capacity() * sizeof(Vec3<float>) / 1024
+            << "KB" << '\n'
+            << "  normals: " << normals.capacity() * sizeof(Vec3<float>) / 1024
+            << "KB" << '\n'
+            << "  texcoords: "
+            << texcoords.capacity() * sizeof(Vec2<float>) / 1024 << "KB" << '\n'
+            << "  indices: "
+            << indices.capacity() * sizeof(TriangleIndex) / 1024 << "KB" << '\n'
+            << "  triangle views: "
+            << triangles.capacity() * sizeof(Triangle) / 1024 << "KB" << '\n'
+            << "bytes per triangle: "
+            << (indices.empty() ? 0 : bytes / indices.size()) << '\n';
+  std::cout << std::endl;
+}
+}  // namespace sre
@@ -0,0 +1,399 @@
+#include "../include/ObjLoader.hpp"
+
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+namespace sre {
+
+// 每块至少1MB，块数为线程数的若干倍以平衡负载
+static const size_t MIN_CHUNK_SIZE = 1 << 20;
+static const size_t CHUNKS_PER_THREAD = 4;
+
+struct ObjChunk {
+  const char *begin, *end;
+  size_t vNum, vnNum, vtNum, triangleNum;
+  // 第一遍得到的偏移，即此前各块的元素总数
+  size_t vOffset, vnOffset, vtOffset, triangleOffset;
+  std::vector<std::string> materials;  // 块内依次出现的usemtl
+  std::vector<std::string> mtlLibs;
+  int material;  // 块开始时生效的材质
+};
+
+static bool isBlank(char c) { return c == ' ' || c == '\t'; }
+
+static const char *skipBlank(const char *p, const char *end) {
+  while (p < end && isBlank(*p)) {
+    p++;
+  }
+  return p;
+}
+
+static const char *nextLine(const char *p, const char *end) {
+  while (p < end && *p != '\n') {
+    p++;
+  }
+  return p < end ? p + 1 : end;
+}
+
+static const char *parseToken(const char *p, const char *end,
+                              std::string &token) {
+  p = skipBlank(p, end);
+  const char *q = p;
+  while (q < end && !isBlank(*q) && *q != '\n' && *q != '\r') {
+    q++;
+  }
+  token.assign(p, q);
+  return q;
+}
+
+// 只处理常见的十进制与科学计数法，比strtof快数倍
+static const char *parseFloat(const char *p, const char *end, float &out) {
+  static const double powers[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+  p = skipBlank(p, end);
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int exponent = 0, digits = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa > 0;
+    } else {
+      exponent += 1;
+    }
+  }
+  if (p < end && *p == '.') {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++) {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa > 0;
+        exponent -= 1;
+      }
+    }
+  }
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char *q = p + 1;
+    bool expNegative = false;
+    if (q < end && (*q == '-' || *q == '+')) {
+      expNegative = *q == '-';
+      q++;
+    }
+    int e = 0;
+    for (; q < end && *q >= '0' && *q <= '9'; q++) {
+      e = std::min(e * 10 + (*q - '0'), 1000);
+    }
+    exponent += expNegative ? -e : e;
+    p = q;
+  }
+
+  double value = static_cast<double>(mantissa);
+  if (exponent < 0) {
+    value = -exponent <= 22 ? value / powers[-exponent]
+                            : value * std::pow(10.0, exponent);
+  } else if (exponent > 0) {
+    value = exponent <= 22 ? value * powers[exponent]
+                           : value * std::pow(10.0, exponent);
+  }
+  out = static_cast<float>(negative ? -value : value);
+  return p;
+}
+
+static const char *parseInt(const char *p, const char *end, int &out) {
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    p++;
+  }
+  int value = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++) {
+    value = value * 10 + (*p - '0');
+  }
+  out = negative ? -value : value;
+  return p;
+}
+
+// 把OBJ下标（从1开始，负数相对于当前已有元素数）转换为从0开始的下标
+static int fixIndex(int index, size_t count) {
+  if (index > 0) {
+    return index - 1;
+  }
+  if (index < 0 && static_cast<size_t>(-index) <= count) {
+    return static_cast<int>(count) + index;
+  }
+  return -1;
+}
+
+static bool isKeyword(const char *p, const char *end, const char *keyword,
+                      size_t n) {
+  return static_cast<size_t>(end - p) > n && memcmp(p, keyword, n) == 0 &&
+         isBlank(p[n]);
+}
+
+// 第一遍：统计块内各类元素个数
+static void countChunk(ObjChunk &chunk) {
+  chunk.vNum = chunk.vnNum = chunk.vtNum = chunk.triangleNum = 0;
+  std::string token;
+  for (const char *p = chunk.begin; p < chunk.end;
+       p = nextLine(p, chunk.end)) {
+    p = skipBlank(p, chunk.end);
+    if (p == chunk.end) {
+      break;
+    }
+    if (isKeyword(p, chunk.end, "v", 1)) {
+      chunk.vNum += 1;
+    } else if (isKeyword(p, chunk.end, "vn", 2)) {
+      chunk.vnNum += 1;
+    } else if (isKeyword(p, chunk.end, "vt", 2)) {
+      chunk.vtNum += 1;
+    } else if (isKeyword(p, chunk.end, "f", 1)) {
+      size_t corners = 0;
+      const char *q = p + 1;
+      while (true) {
+        q = skipBlank(q, chunk.end);
+        if (q == chunk.end || *q == '\n' || *q == '\r') {
+          break;
+        }
+        corners += 1;
+        while (q < chunk.end && !isBlank(*q) && *q != '\n' && *q != '\r') {
+          q++;
+        }
+      }
+      chunk.triangleNum += corners >= 3 ? corners - 2 : 0;
+    } else if (isKeyword(p, chunk.end, "usemtl", 6)) {
+      parseToken(p + 6, chunk.end, token);
+      chunk.materials.push_back(token);
+    } else if (isKeyword(p, chunk.end, "mtllib", 6)) {
+      const char *q = p + 6;
+      while (true) {
+        q = parseToken(q, chunk.end, token);
+        if (token.empty()) {
+          break;
+        }
+        chunk.mtlLibs.push_back(token);
+      }
+    }
+  }
+}
+
+// 第二遍：从各块的偏移处直接写入结果数组，返回是否所有顶点下标有效
+static bool parseChunk(const ObjChunk &chunk,
+                       const std::unordered_map<std::string, int> &materialIds,
+                       MeshBuffer &mesh) {
+  size_t v = chunk.vOffset, vn = chunk.vnOffset, vt = chunk.vtOffset,
+         t = chunk.triangleOffset;
+  int material = chunk.material;
+  bool valid = true;
+  std::string token;
+
+  for (const char *p = chunk.begin; p < chunk.end;
+       p = nextLine(p, chunk.end)) {
+    p = skipBlank(p, chunk.end);
+    if (p == chunk.end) {
+      break;
+    }
+    if (isKeyword(p, chunk.end, "v", 1)) {
+      Vec3<float> &pos = mesh.positions[v++];
+      p = parseFloat(p + 1, chunk.end, pos.x);
+      p = parseFloat(p, chunk.end, pos.y);
+      parseFloat(p, chunk.end, pos.z);
+    } else if (isKeyword(p, chunk.end, "vn", 2)) {
+      Vec3<float> &n = mesh.normals[vn++];
+      p = parseFloat(p + 2, chunk.end, n.x);
+      p = parseFloat(p, chunk.end, n.y);
+      parseFloat(p, chunk.end, n.z);
+    } else if (isKeyword(p, chunk.end, "vt", 2)) {
+      Vec2<float> &uv = mesh.texcoords[vt++];
+      p = parseFloat(p + 2, chunk.end, uv.u);
+      parseFloat(p, chunk.end, uv.v);
+    } else if (isKeyword(p, chunk.end, "f", 1)) {
+      MeshIndex first, prev;
+      size_t corners = 0;
+      const char *q = p + 1;
+      while (true) {
+        q = skipBlank(q, chunk.end);
+        if (q == chunk.end || *q == '\n' || *q == '\r') {
+          break;
+        }
+        // v, v/vt, v//vn, v/vt/vn
+        MeshIndex corner = {-1, -1, -1};
+        int index = 0;
+        q = parseInt(q, chunk.end, index);
+        corner.v = fixIndex(index, v);
+        if (q < chunk.end && *q == '/') {
+          q++;
+          if (q < chunk.end && *q != '/') {
+            q = parseInt(q, chunk.end, index);
+            corner.vt = fixIndex(index, vt);
+          }
+          if (q < chunk.end && *q == '/') {
+            q = parseInt(q + 1, chunk.end, index);
+            corner.vn = fixIndex(index, vn);
+          }
+        }
+        while (q < chunk.end && !isBlank(*q) && *q != '\n' && *q != '\r') {
+          q++;
+        }
+        valid = valid && corner.v >= 0;
+
+        // 扇形三角化
+        if (corners == 0) {
+          first = corner;
+        } else if (corners >= 2) {
+          mesh.indices[3 * t + 0] = first;
+          mesh.indices[3 * t + 1] = prev;
+          mesh.indices[3 * t + 2] = corner;
+          mesh.materialIds[t] = material;
+          t += 1;
+        }
+        prev = corner;
+        corners += 1;
+      }
+    } else if (isKeyword(p, chunk.end, "usemtl", 6)) {
+      parseToken(p + 6, chunk.end, token);
+      material = materialIds.at(token);
+    }
+  }
+  return valid;
+}
+
+ObjLoader::ObjLoader() : bytes(0), triangles(0), seconds(0) {}
+
+bool ObjLoader::load(const std::string &fileName, MeshBuffer &mesh) {
+  auto start = std::chrono::steady_clock::now();
+  mesh = MeshBuffer();
+
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  void *mapped = nullptr;
+  if (size > 0) {
+    mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapped == MAP_FAILED) {
+    return false;
+  }
+  const char *text = static_cast<const char *>(mapped);
+  const char *textEnd = text + size;
+
+  // 按行边界切块
+  size_t chunkNum = std::max<size_t>(
+      1, std::min(size / MIN_CHUNK_SIZE,
+                  static_cast<size_t>(omp_get_max_threads()) *
+                      CHUNKS_PER_THREAD));
+  std::vector<ObjChunk> chunks(chunkNum);
+  const char *p = text;
+  for (size_t i = 0; i < chunkNum; i++) {
+    chunks[i].begin = p;
+    p = i + 1 == chunkNum ? textEnd
+                          : nextLine(std::max(p, text + size / chunkNum * (i + 1)),
+                                     textEnd);
+    chunks[i].end = p;
+  }
+
+#pragma omp parallel for schedule(dynamic, 1)
+  for (long long i = 0; i < static_cast<long long>(chunkNum); i++) {
+    countChunk(chunks[i]);
+  }
+
+  // 前缀和，并确定材质编号以及每块开始时的材质
+  std::unordered_map<std::string, int> materialIds;
+  size_t vNum = 0, vnNum = 0, vtNum = 0, triangleNum = 0;
+  int material = -1;
+  for (ObjChunk &chunk : chunks) {
+    chunk.vOffset = vNum;
+    chunk.vnOffset = vnNum;
+    chunk.vtOffset = vtNum;
+    chunk.triangleOffset = triangleNum;
+    chunk.material = material;
+    vNum += chunk.vNum;
+    vnNum += chunk.vnNum;
+    vtNum += chunk.vtNum;
+    triangleNum += chunk.triangleNum;
+    for (const std::string &name : chunk.materials) {
+      auto itr = materialIds.find(name);
+      if (itr == materialIds.end()) {
+        itr = materialIds.emplace(name, mesh.materialNames.size()).first;
+        mesh.materialNames.push_back(name);
+      }
+      material = itr->second;
+    }
+    mesh.mtlLibs.insert(mesh.mtlLibs.end(), chunk.mtlLibs.begin(),
+                        chunk.mtlLibs.end());
+  }
+
+  mesh.positions.resize(vNum);
+  mesh.normals.resize(vnNum);
+  mesh.texcoords.resize(vtNum);
+  mesh.indices.resize(3 * triangleNum);
+  mesh.materialIds.resize(triangleNum);
+
+  bool valid = true;
+#pragma omp parallel for schedule(dynamic, 1) reduction(&& : valid)
+  for (long long i = 0; i < static_cast<long long>(chunkNum); i++) {
+    valid = parseChunk(chunks[i], materialIds, mesh) && valid;
+  }
+  if (mapped != nullptr) {
+    munmap(mapped, size);
+  }
+
+  // 下标可能引用后面定义的元素，全部解析完后再检查范围
+  for (MeshIndex &index : mesh.indices) {
+    valid = valid && static_cast<size_t>(index.v) < vNum;
+    if (index.vt >= static_cast<int>(vtNum)) {
+      index.vt = -1;
+    }
+    if (index.vn >= static_cast<int>(vnNum)) {
+      index.vn = -1;
+    }
+  }
+  if (!valid) {
+    std::cout << "Invalid vertex index in " << fileName << std::endl;
+    mesh = MeshBuffer();
+    return false;
+  }
+
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  bytes = size;
+  triangles = triangleNum;
+  seconds = elapsed.count();
+  return true;
+}
+
+// print.
+void ObjLoader::printStatus() const {
+  double mb = bytes / (1024.0 * 1024.0);
+  double s = std::max(seconds, 1e-9);
+  std::cout << "OBJ loader" << '\n'
+            << "size: " << mb << "MB" << '\n'
+            << "triangles: " << triangles << '\n'
+            << "time: " << seconds << "s" << '\n'
+            << "throughput: " << mb / s << "MB/s" << '\t' << triangles / s
+            << " triangles/s" << '\n';
+  std::cout << std::endl;
+}
+}  // namespace sre
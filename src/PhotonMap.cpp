@@ -0,0 +1,166 @@
+#include "../include/PhotonMap.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+#include "../include/Random.hpp"
+
+namespace sre {
+
+// 与渲染样本（stream 0~2）区分的随机数流
+static const uint64_t PHOTON_STREAM = 16;
+
+PhotonMap::PhotonMap(size_t _maxBounce)
+    : radius(0), cellSize(1), maxBounce(_maxBounce) {}
+
+size_t PhotonMap::hashCell(int x, int y, int z) const {
+  size_t h = (static_cast<size_t>(x) * 73856093u) ^
+             (static_cast<size_t>(y) * 19349663u) ^
+             (static_cast<size_t>(z) * 83492791u);
+  return h & (cellStart.size() - 2);
+}
+
+int PhotonMap::getCell(float v) const {
+  return static_cast<int>(floor(v / cellSize));
+}
+
+void PhotonMap::build(const Hittable *scene,
+                      const std::vector<Hittable *> &objects,
+                      const Light &light, size_t photonNum, float r) {
+  assert(scene != nullptr);
+  clear();
+  if (light.empty() || photonNum == 0) {
+    return;
+  }
+
+  radius = r > 0 ? r
+                 : Vec3<float>::distance(scene->getMinXYZ(),
+                                         scene->getMaxXYZ()) *
+                       0.01f;
+  cellSize = 2 * radius;
+
+  // 每个光子按编号设置随机数状态，分块存放后按块顺序合并，结果与线程数无关
+  const size_t chunkSize = 1024;
+  std::vector<std::vector<Photon>> chunks((photonNum + chunkSize - 1) /
+                                          chunkSize);
+#pragma omp parallel for schedule(dynamic)
+  for (long long c = 0; c < static_cast<long long>(chunks.size()); c++) {
+    std::vector<Photon> &local = chunks[c];
+    size_t begin = static_cast<size_t>(c) * chunkSize;
+    size_t end = std::min(photonNum, begin + chunkSize);
+    for (size_t i = begin; i < end; i++) {
+      seedRandom(i, 0, PHOTON_STREAM);
+      Vec3<float> pos, normal, flux;
+      light.getRandomEmission(pos, normal, flux);
+      flux /= static_cast<float>(photonNum);
+
+      Ray ray(pos, cosineDir(normal));
+      for (size_t bounce = 0; bounce < maxBounce; bounce++) {
+        HitResult res;
+        scene->hit(ray, res);
+        if (!res.isHit || res.material->isEmissive()) {
+          break;
+        }
+        Vec2<float> texCoord = objects[res.id]->getTexCoord(res.hitPoint);
+        Vec3<float> diffusion = res.material->getDiffusion(texCoord);
+
+        // 第一次落点属于直接光照，由光源采样负责，不存入光子图
+        if (bounce > 0) {
+          local.push_back({res.hitPoint, ray.getDirection(), flux});
+        }
+
+        // 按反照率做俄罗斯轮盘，余弦采样下漫反射的权重即为反照率
+        float q = std::min(
+            0.95f, std::max(diffusion.x, std::max(diffusion.y, diffusion.z)));
+        if (q <= 0 || randFloat(1) >= q) {
+          break;
+        }
+        flux = flux * diffusion / q;
+        ray = Ray(res.hitPoint, cosineDir(res.normal));
+      }
+    }
+  }
+  for (std::vector<Photon> &chunk : chunks) {
+    photons.insert(photons.end(), chunk.begin(), chunk.end());
+  }
+
+  // 计数排序，把同一哈希桶的光子放在一起
+  size_t tableSize = 1;
+  while (tableSize < photons.size() * 2) {
+    tableSize <<= 1;
+  }
+  cellStart.assign(tableSize + 1, 0);
+  std::vector<size_t> keys(photons.size());
+  for (size_t i = 0; i < photons.size(); i++) {
+    const Vec3<float> &p = photons[i].position;
+    keys[i] = hashCell(getCell(p.x), getCell(p.y), getCell(p.z));
+    cellStart[keys[i] + 1] += 1;
+  }
+  for (size_t i = 1; i <= tableSize; i++) {
+    cellStart[i] += cellStart[i - 1];
+  }
+  std::vector<unsigned int> fill(cellStart.begin(), cellStart.end() - 1);
+  std::vector<Photon> sorted(photons.size());
+  for (size_t i = 0; i < photons.size(); i++) {
+    sorted[fill[keys[i]]++] = photons[i];
+  }
+  photons.swap(sorted);
+}
+
+void PhotonMap::clear() {
+  photons.clear();
+  cellStart.clear();
+}
+
+// getter.
+size_t PhotonMap::size() const { return photons.size(); }
+float PhotonMap::getRadius() const { return radius; }
+
+Vec3<float> PhotonMap::getIrradiance(const Vec3<float> &p,
+                                     const Vec3<float> &n) const {
+  Vec3<float> sum(0, 0, 0);
+  if (photons.empty()) {
+    return sum;
+  }
+
+  float r2 = radius * radius;
+  // 网格边长为收集直径，以p为中心的收集范围落在从base起的2x2x2个网格内；
+  // 只求一次起始网格，分别取整p-r和p+r时舍入可能相差两格
+  int bx = static_cast<int>(floor(p.x / cellSize - 0.5f)),
+      by = static_cast<int>(floor(p.y / cellSize - 0.5f)),
+      bz = static_cast<int>(floor(p.z / cellSize - 0.5f));
+  // 不同网格可能落入同一个桶，需要去重
+  size_t visited[8];
+  int visitedNum = 0;
+  for (int x = bx; x <= bx + 1; x++) {
+    for (int y = by; y <= by + 1; y++) {
+      for (int z = bz; z <= bz + 1; z++) {
+        size_t h = hashCell(x, y, z);
+        if (std::find(visited, visited + visitedNum, h) !=
+            visited + visitedNum) {
+          continue;
+        }
+        visited[visitedNum++] = h;
+
+        for (unsigned int k = cellStart[h]; k < cellStart[h + 1]; k++) {
+          const Photon &photon = photons[k];
+          Vec3<float> d = photon.position - p;
+          if (Vec3<float>::dot(d, d) > r2 ||
+              Vec3<float>::dot(n, photon.direction) >= 0) {
+            continue;
+          }
+          sum += photon.flux;
+        }
+      }
+    }
+  }
+  return sum / (PI * r2);
+}
+
+void PhotonMap::printStatus() const {
+  std::cout << "photon map" << '\n'
+            << "stored photons: " << photons.size() << '\n'
+            << "gather radius: " << radius << '\n';
+  std::cout << std::endl;
+}
+}  // namespace sre
@@ -0,0 +1,125 @@
+#include "../include/Profiler.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace sre {
+
+Profiler::Profiler() : epoch(std::chrono::steady_clock::now()), threadNum(0) {}
+
+Profiler &Profiler::getInstance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+void Profiler::registerThread(ThreadEvents *events) {
+  std::lock_guard<std::mutex> lock(mutex);
+  events->id = threadNum++;
+  threads.push_back(events);
+}
+
+void Profiler::unregisterThread(ThreadEvents *events) {
+  std::lock_guard<std::mutex> lock(mutex);
+  threads.erase(std::find(threads.begin(), threads.end(), events));
+  if (!events->events.empty()) {
+    retired.push_back(std::move(*events));
+  }
+}
+
+// 线程局部的缓冲，析构时交还给Profiler
+struct ThreadProfile {
+  Profiler::ThreadEvents events;
+
+  ThreadProfile() { Profiler::getInstance().registerThread(&events); }
+  ~ThreadProfile() { Profiler::getInstance().unregisterThread(&events); }
+};
+
+int64_t Profiler::now() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - epoch)
+      .count();
+}
+
+void Profiler::record(const char *name, std::string detail, int64_t start,
+                      int64_t end) {
+  static thread_local ThreadProfile profile;
+  profile.events.events.push_back({name, std::move(detail), start, end - start});
+}
+
+// JSON字符串转义
+static std::string escape(const std::string &s) {
+  std::string res;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      res += '\\';
+      res += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      res += buf;
+    } else {
+      res += c;
+    }
+  }
+  return res;
+}
+
+bool Profiler::write(const std::string &fileName) {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::ofstream ofs(fileName);
+  if (!ofs.is_open()) {
+    return false;
+  }
+  std::vector<const ThreadEvents *> all;
+  for (const ThreadEvents *events : threads) {
+    all.push_back(events);
+  }
+  for (const ThreadEvents &events : retired) {
+    all.push_back(&events);
+  }
+
+  // 完整事件（ph为X），时间单位为微秒；另加线程名的元数据事件
+  ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  bool first = true;
+  char buf[64];
+  for (const ThreadEvents *events : all) {
+    ofs << (first ? "\n" : ",\n")
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": "
+        << events->id << ", \"args\": {\"name\": \"thread " << events->id
+        << "\"}}";
+    first = false;
+    for (const ProfileEvent &e : events->events) {
+      snprintf(buf, sizeof(buf), "\"ts\": %.3f, \"dur\": %.3f", e.start / 1e3,
+               e.duration / 1e3);
+      ofs << ",\n{\"name\": \"" << escape(e.name) << "\", \"ph\": \"X\", "
+          << buf << ", \"pid\": 1, \"tid\": " << events->id;
+      if (!e.detail.empty()) {
+        ofs << ", \"args\": {\"detail\": \"" << escape(e.detail) << "\"}";
+      }
+      ofs << "}";
+    }
+  }
+  ofs << "\n]}\n";
+  ofs.close();
+  return ofs.good();
+}
+
+void Profiler::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (ThreadEvents *events : threads) {
+    events->events.clear();
+  }
+  retired.clear();
+}
+
+ProfileScope::ProfileScope(const char *_name, std::string _detail)
+    : name(_name),
+      detail(std::move(_detail)),
+      start(Profiler::getInstance().now()) {}
+
+ProfileScope::~ProfileScope() {
+  Profiler &profiler = Profiler::getInstance();
+  profiler.record(name, std::move(detail), start, profiler.now());
+}
+}  // namespace sre
@@ -1,11 +1,55 @@
 #include "../include/Random.hpp"
 
+#include <atomic>
+
 namespace sre {
 
-int randInt(int max, int min) { return rand() % (max - min) + min; }
+static std::atomic<uint64_t> globalSeed(0);
+static std::atomic<uint64_t> threadCounter(0);
+
+// SplitMix64的混合函数
+static uint64_t mix(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+  return z ^ (z >> 31);
+}
+
+struct RandomState {
+  uint64_t state;
+  bool seeded;
+};
+
+static thread_local RandomState current = {0, false};
+
+static uint64_t next() {
+  if (!current.seeded) {
+    // 没有按样本设置过的线程（如预处理）各自取一个不同的初始状态
+    current.state = mix(globalSeed.load() ^ mix(threadCounter.fetch_add(1)));
+    current.seeded = true;
+  }
+  current.state += 0x9e3779b97f4a7c15ull;
+  return mix(current.state);
+}
+
+void setRandomSeed(uint64_t seed) { globalSeed = seed; }
+
+uint64_t getRandomSeed() { return globalSeed.load(); }
+
+void seedRandom(uint64_t key, uint64_t pass, uint64_t stream) {
+  uint64_t h = mix(globalSeed.load() + 0x9e3779b97f4a7c15ull);
+  h = mix(h ^ key);
+  h = mix(h ^ (pass * 0x9e3779b97f4a7c15ull));
+  current.state = mix(h ^ (stream + 1));
+  current.seeded = true;
+}
+
+int randInt(int max, int min) {
+  return static_cast<int>(next() % static_cast<uint64_t>(max - min)) + min;
+}
 
 float randFloat(float max, float min) {
-  return min + 1.0 * rand() / RAND_MAX * (max - min);
+  // 高24位转换为[0, 1)内的浮点数
+  return min + (next() >> 40) * (1.0f / 16777216.0f) * (max - min);
 }
 
-}  // namespace sre
\ No newline at end of file
+}  // namespace sre
@@ -1,18 +1,42 @@
 #include "../include/Ray.hpp"
 
+#include <algorithm>
 #include <iostream>
 
 namespace sre {
-Ray::Ray(const Vec3<float> &org, const Vec3<float> &dir)
-    : origin(org), direction(Vec3<float>::normalize(dir)) {}
+Ray::Ray(const Vec3<float> &org, const Vec3<float> &dir, float _tMin,
+         float _tMax)
+    : origin(org),
+      direction(Vec3<float>::normalize(dir)),
+      tMin(_tMin),
+      tMax(_tMax) {
+  invDirection = Vec3<float>(1.0f / direction.x, 1.0f / direction.y,
+                             1.0f / direction.z);
+  sign[0] = std::signbit(direction.x);
+  sign[1] = std::signbit(direction.y);
+  sign[2] = std::signbit(direction.z);
+}
 
 // getter.
 Vec3<float> Ray::getOrigin() const { return origin; }
 Vec3<float> Ray::getDirection() const { return direction; }
+Vec3<float> Ray::getInvDirection() const { return invDirection; }
+const int *Ray::getSign() const { return sign; }
+float Ray::getTMin() const { return tMin; }
+float Ray::getTMax() const { return tMax; }
 Vec3<float> Ray::getPointAt(const float &t) const {
   return origin + direction * t;
 }
 
+// setter.
+void Ray::setTMax(float t) { tMax = t; }
+
+// 终点处留出相对距离1e-4的余量，不与目标点所在的表面相交
+Ray shadowRay(const Vec3<float> &p, const Vec3<float> &q) {
+  Vec3<float> d = q - p;
+  return Ray(p, d, Ray::DEFAULT_T_MIN, d.length() * (1 - 1e-4f));
+}
+
 // 漫反射光线方向
 Vec3<float> diffuseDir(const Vec3<float> &wi, const Vec3<float> &n) {
   // 求出垂直于法向量的任意一对正交基
@@ -28,6 +52,18 @@ Vec3<float> diffuseDir(const Vec3<float> &wi, const Vec3<float> &n) {
   return v1 * x + v2 * y + n * z;
 }
 
+// 余弦加权的半球方向
+Vec3<float> cosineDir(const Vec3<float> &n) {
+  // 以n为z轴构造正交基
+  Vec3<float> a = fabs(n.x) > 0.9f ? Vec3<float>(0, 1, 0) : Vec3<float>(1, 0, 0);
+  Vec3<float> v1 = Vec3<float>::normalize(Vec3<float>::cross(a, n));
+  Vec3<float> v2 = Vec3<float>::cross(n, v1);
+  float r = std::sqrt(randFloat(1)), theta = 2 * PI * randFloat(1);
+  float x = r * std::cos(theta), y = r * std::sin(theta);
+  float z = std::sqrt(std::max(0.0f, 1 - x * x - y * y));
+  return v1 * x + v2 * y + n * z;
+}
+
 // 镜面反射光线方向
 Vec3<float> mirrorDir(const Vec3<float> &wi, const Vec3<float> &n) {
   float cosi = Vec3<float>::dot(wi, n);
@@ -0,0 +1,141 @@
+#include "../include/RenderStats.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace sre {
+
+RenderStats::RenderStats() { clear(); }
+
+void RenderStats::clear() {
+  primaryRays = 0;
+  shadowRays = 0;
+  bounceRays = 0;
+  nodesVisited = 0;
+  triangleTests = 0;
+  rouletteTerminations = 0;
+  textureLookups = 0;
+  std::fill(pathLengths, pathLengths + PATH_LENGTH_BINS, 0);
+}
+
+void RenderStats::merge(const RenderStats &other) {
+  primaryRays += other.primaryRays;
+  shadowRays += other.shadowRays;
+  bounceRays += other.bounceRays;
+  nodesVisited += other.nodesVisited;
+  triangleTests += other.triangleTests;
+  rouletteTerminations += other.rouletteTerminations;
+  textureLookups += other.textureLookups;
+  for (int i = 0; i < PATH_LENGTH_BINS; i++) {
+    pathLengths[i] += other.pathLengths[i];
+  }
+}
+
+void RenderStats::addPath(uint64_t length) {
+  pathLengths[std::min<uint64_t>(length, PATH_LENGTH_BINS - 1)]++;
+}
+
+void RenderStats::printStatus() const {
+  uint64_t rays = primaryRays + shadowRays + bounceRays;
+  uint64_t paths = 0;
+  for (int i = 0; i < PATH_LENGTH_BINS; i++) {
+    paths += pathLengths[i];
+  }
+  std::cout << "render statistics" << '\n'
+            << "primary rays: " << primaryRays << '\n'
+            << "shadow rays: " << shadowRays << '\n'
+            << "bounce rays: " << bounceRays << '\n'
+            << "BVH nodes visited: " << nodesVisited << " ("
+            << (rays > 0 ? static_cast<double>(nodesVisited) / rays : 0)
+            << " per ray)" << '\n'
+            << "triangle tests: " << triangleTests << " ("
+            << (rays > 0 ? static_cast<double>(triangleTests) / rays : 0)
+            << " per ray)" << '\n'
+            << "roulette terminations: " << rouletteTerminations << '\n'
+            << "texture lookups: " << textureLookups << '\n'
+            << "path lengths:";
+  for (int i = 0; i < PATH_LENGTH_BINS; i++) {
+    if (pathLengths[i] > 0) {
+      std::cout << ' ' << i << (i == PATH_LENGTH_BINS - 1 ? "+" : "") << ':'
+                << pathLengths[i] * 100.0 / paths << '%';
+    }
+  }
+  std::cout << '\n';
+  std::cout << std::endl;
+}
+
+// 各线程的计数登记在这里，线程退出时并入retired
+struct StatsRegistry {
+  std::mutex mutex;
+  std::vector<RenderStats *> threads;
+  RenderStats retired;
+};
+
+static StatsRegistry &getRegistry() {
+  static StatsRegistry registry;
+  return registry;
+}
+
+struct ThreadStats {
+  RenderStats stats;
+
+  ThreadStats() {
+    StatsRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.threads.push_back(&stats);
+  }
+  ~ThreadStats() {
+    StatsRegistry &registry = getRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    registry.retired.merge(stats);
+    registry.threads.erase(
+        std::find(registry.threads.begin(), registry.threads.end(), &stats));
+  }
+};
+
+RenderStats &getThreadStats() {
+  static thread_local ThreadStats threadStats;
+  return threadStats.stats;
+}
+
+static thread_local TraversalCost *threadCost = nullptr;
+
+std::atomic<int> threadCostUsers(0);
+
+void setThreadCost(TraversalCost *cost) {
+  if (threadCost == nullptr && cost != nullptr) {
+    threadCostUsers.fetch_add(1, std::memory_order_relaxed);
+  } else if (threadCost != nullptr && cost == nullptr) {
+    threadCostUsers.fetch_sub(1, std::memory_order_relaxed);
+  }
+  threadCost = cost;
+}
+
+void addThreadCost(uint64_t nodes, uint64_t triangles) {
+  if (threadCost != nullptr) {
+    threadCost->nodes += nodes;
+    threadCost->triangles += triangles;
+  }
+}
+
+void collectStats(RenderStats &total) {
+  StatsRegistry &registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  total = registry.retired;
+  for (const RenderStats *stats : registry.threads) {
+    total.merge(*stats);
+  }
+}
+
+void resetStats() {
+  StatsRegistry &registry = getRegistry();
+  std::lock_guard<std::mutex> lock(registry.mutex);
+  registry.retired.clear();
+  for (RenderStats *stats : registry.threads) {
+    stats->clear();
+  }
+}
+
+}  // namespace sre
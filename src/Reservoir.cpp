@@ -0,0 +1,20 @@
+#include "../include/Reservoir.hpp"
+
+#include "../include/Random.hpp"
+
+namespace sre {
+
+bool Reservoir::update(const LightSample& s, float w, float m) {
+  wSum += w;
+  M += m;
+  if (w > 0 && randFloat(wSum) < w) {
+    sample = s;
+    return true;
+  }
+  return false;
+}
+
+void Reservoir::finalize(float pHat) {
+  W = (pHat > 0 && M > 0) ? wSum / (M * pHat) : 0;
+}
+}  // namespace sre
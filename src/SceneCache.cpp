@@ -0,0 +1,436 @@
+#include "../include/SceneCache.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+#include "../include/Profiler.hpp"
+
+namespace sre {
+
+static const char MAGIC[8] = {'S', 'R', 'E', 'C', 'A', 'C', 'H', 'E'};
+static const uint64_t FNV_OFFSET = 14695981039346656037ull;
+static const uint64_t FNV_PRIME = 1099511628211ull;
+static const size_t ALIGNMENT = 64;
+
+static uint64_t hashBytes(const void *bytes, size_t n, uint64_t h) {
+  const unsigned char *p = static_cast<const unsigned char *>(bytes);
+  // 按8字节为单位做FNV-1a，大文件时比逐字节快得多
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    uint64_t word;
+    memcpy(&word, p + i, 8);
+    h = (h ^ word) * FNV_PRIME;
+  }
+  for (; i < n; i++) {
+    h = (h ^ p[i]) * FNV_PRIME;
+  }
+  return h;
+}
+
+// 哈希文件名与内容，mtlNames非空时顺便收集文件中引用的mtllib
+static uint64_t hashFile(const std::string &fileName, uint64_t h,
+                         std::vector<std::string> *mtlNames) {
+  h = hashBytes(fileName.data(), fileName.size(), h);
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    if (fd >= 0) {
+      ::close(fd);
+    }
+    // 文件缺失同样参与哈希，避免与存在时混淆
+    return h * FNV_PRIME;
+  }
+  size_t n = st.st_size;
+  h = hashBytes(&n, sizeof(n), h);
+  if (n == 0) {
+    ::close(fd);
+    return h;
+  }
+  void *mapped = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    return h * FNV_PRIME;
+  }
+  madvise(mapped, n, MADV_SEQUENTIAL);
+  h = hashBytes(mapped, n, h);
+
+  if (mtlNames != nullptr) {
+    const char *text = static_cast<const char *>(mapped);
+    for (size_t i = 0; i + 6 < n; i++) {
+      if ((i == 0 || text[i - 1] == '\n') &&
+          strncmp(text + i, "mtllib", 6) == 0) {
+        size_t j = i + 6;
+        while (j < n && text[j] != '\n' && text[j] != '\r') {
+          j++;
+        }
+        std::istringstream line(std::string(text + i + 6, j - i - 6));
+        std::string mtlName;
+        while (line >> mtlName) {
+          mtlNames->push_back(mtlName);
+        }
+        i = j;
+      }
+    }
+  }
+  munmap(mapped, n);
+  return h;
+}
+
+static size_t alignUp(size_t n) {
+  return (n + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+SceneCache::SceneCache() : fd(-1), data(nullptr), size(0), header(nullptr) {}
+
+SceneCache::~SceneCache() { close(); }
+
+uint64_t SceneCache::hashSources(const std::string &pathName,
+                                 const std::vector<std::string> &modelNames,
+                                 const std::string &configName) {
+  uint64_t h = FNV_OFFSET;
+  uint32_t version = VERSION;
+  h = hashBytes(&version, sizeof(version), h);
+  h = hashFile(pathName + configName, h, nullptr);
+  for (const std::string &modelName : modelNames) {
+    std::vector<std::string> mtlNames;
+    h = hashFile(pathName + modelName, h, &mtlNames);
+    for (const std::string &mtlName : mtlNames) {
+      h = hashFile(pathName + mtlName, h, nullptr);
+    }
+  }
+  return h;
+}
+
+void SceneCache::packMaterials(const std::vector<Material> &materials,
+                               std::vector<MaterialRecord> &records,
+                               std::string &strings) {
+  std::unordered_map<std::string, uint32_t> stringIds;
+  auto addString = [&](const std::string &s) {
+    auto itr = stringIds.find(s);
+    if (itr != stringIds.end()) {
+      return itr->second;
+    }
+    uint32_t offset = strings.size();
+    strings.append(s);
+    strings.push_back('\0');
+    stringIds.emplace(s, offset);
+    return offset;
+  };
+  auto addTexture = [&](const Texture *texture) {
+    return texture == nullptr ? NO_STRING : addString(texture->getName());
+  };
+
+  records.resize(materials.size());
+  for (size_t i = 0; i < materials.size(); i++) {
+    const Material &m = materials[i];
+    MaterialRecord &mr = records[i];
+    memset(&mr, 0, sizeof(mr));
+    const Vec3<float> *colors[5] = {&m.emission, &m.ambience, &m.diffusion,
+                                    &m.specularity, &m.transmittance};
+    float(*dst[5])[3] = {&mr.emission, &mr.ambience, &mr.diffusion,
+                         &mr.specularity, &mr.transmittance};
+    for (int k = 0; k < 5; k++) {
+      (*dst[k])[0] = colors[k]->x;
+      (*dst[k])[1] = colors[k]->y;
+      (*dst[k])[2] = colors[k]->z;
+    }
+    mr.shiness = m.shiness;
+    mr.refraction = m.refraction;
+    mr.emissive = m.emisssive ? 1 : 0;
+    mr.name = addString(m.name);
+    mr.ambientTexture = addTexture(m.ambientTexture);
+    mr.diffuseTexture = addTexture(m.diffuseTexture);
+    mr.specularTexture = addTexture(m.specularTexture);
+  }
+}
+
+void SceneCache::unpackMaterials(const MaterialRecord *records, size_t num,
+                                 const char *strings, size_t stringSize,
+                                 std::vector<Material> &materials) {
+  auto getString = [&](uint32_t offset) {
+    return offset == NO_STRING || offset >= stringSize
+               ? std::string()
+               : std::string(strings + offset);
+  };
+
+  materials.resize(num);
+  for (size_t i = 0; i < num; i++) {
+    const MaterialRecord &mr = records[i];
+    Material &m = materials[i];
+    m.setName(getString(mr.name));
+    m.setEmissive(mr.emissive != 0);
+    m.setEmission(mr.emission[0], mr.emission[1], mr.emission[2]);
+    m.setAmbience(mr.ambience[0], mr.ambience[1], mr.ambience[2]);
+    m.setDiffusion(mr.diffusion[0], mr.diffusion[1], mr.diffusion[2]);
+    m.setSpecularity(mr.specularity[0], mr.specularity[1], mr.specularity[2]);
+    m.setTransmittance(mr.transmittance[0], mr.transmittance[1],
+                       mr.transmittance[2]);
+    m.setShiness(mr.shiness);
+    m.setRefraction(mr.refraction);
+    // 纹理按路径重新加载，源纹理改动不需要重建缓存
+    if (mr.ambientTexture != NO_STRING) {
+      m.setAmbientTexture(getString(mr.ambientTexture));
+    }
+    if (mr.diffuseTexture != NO_STRING) {
+      m.setDiffuseTexture(getString(mr.diffuseTexture));
+    }
+    if (mr.specularTexture != NO_STRING) {
+      m.setSpecularTexture(getString(mr.specularTexture));
+    }
+  }
+}
+
+bool SceneCache::write(const std::string &cacheName, uint64_t hash,
+                       const Mesh &mesh, const LinearBVH &bvh) {
+  std::string strings;
+  std::vector<MaterialRecord> materials;
+  packMaterials(mesh.materials, materials, strings);
+
+  // 共享缓冲按分量展开为float数组
+  std::vector<float> positions, normals, texcoords;
+  positions.reserve(mesh.positions.size() * 3);
+  for (const Vec3<float> &p : mesh.positions) {
+    positions.insert(positions.end(), {p.x, p.y, p.z});
+  }
+  normals.reserve(mesh.normals.size() * 3);
+  for (const Vec3<float> &n : mesh.normals) {
+    normals.insert(normals.end(), {n.x, n.y, n.z});
+  }
+  texcoords.reserve(mesh.texcoords.size() * 2);
+  for (const Vec2<float> &vt : mesh.texcoords) {
+    texcoords.insert(texcoords.end(), {vt.u, vt.v});
+  }
+
+  std::vector<uint32_t> primitives;
+  primitives.reserve(bvh.getPrimitives().size());
+  for (const Hittable *object : bvh.getPrimitives()) {
+    primitives.push_back(object->getId());
+  }
+
+  SceneCacheHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, MAGIC, sizeof(MAGIC));
+  h.version = VERSION;
+  h.headerSize = sizeof(SceneCacheHeader);
+  h.sourceHash = hash;
+  h.stringOffset = alignUp(sizeof(SceneCacheHeader));
+  h.stringSize = strings.size();
+  h.materialOffset = alignUp(h.stringOffset + h.stringSize);
+  h.materialNum = materials.size();
+  h.positionOffset =
+      alignUp(h.materialOffset + h.materialNum * sizeof(MaterialRecord));
+  h.positionNum = mesh.positions.size();
+  h.normalOffset = alignUp(h.positionOffset + positions.size() * sizeof(float));
+  h.normalNum = mesh.normals.size();
+  h.texcoordOffset = alignUp(h.normalOffset + normals.size() * sizeof(float));
+  h.texcoordNum = mesh.texcoords.size();
+  h.triangleOffset =
+      alignUp(h.texcoordOffset + texcoords.size() * sizeof(float));
+  h.triangleNum = mesh.indices.size();
+  h.nodeOffset =
+      alignUp(h.triangleOffset + h.triangleNum * sizeof(TriangleIndex));
+  h.nodeNum = bvh.getNodeNum();
+  h.primitiveOffset =
+      alignUp(h.nodeOffset + h.nodeNum * sizeof(LinearBVHNode));
+  h.primitiveNum = primitives.size();
+
+  std::string tmpName = cacheName + ".tmp";
+  std::ofstream ofs(tmpName, std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open()) {
+    return false;
+  }
+  size_t written = 0;
+  auto put = [&](uint64_t offset, const void *bytes, size_t n) {
+    static const char zeros[ALIGNMENT] = {0};
+    ofs.write(zeros, offset - written);
+    ofs.write(static_cast<const char *>(bytes), n);
+    written = offset + n;
+  };
+  put(0, &h, sizeof(h));
+  put(h.stringOffset, strings.data(), strings.size());
+  put(h.materialOffset, materials.data(),
+      materials.size() * sizeof(MaterialRecord));
+  put(h.positionOffset, positions.data(), positions.size() * sizeof(float));
+  put(h.normalOffset, normals.data(), normals.size() * sizeof(float));
+  put(h.texcoordOffset, texcoords.data(), texcoords.size() * sizeof(float));
+  put(h.triangleOffset, mesh.indices.data(),
+      mesh.indices.size() * sizeof(TriangleIndex));
+  put(h.nodeOffset, bvh.getNodes(), h.nodeNum * sizeof(LinearBVHNode));
+  put(h.primitiveOffset, primitives.data(),
+      primitives.size() * sizeof(uint32_t));
+  ofs.close();
+  if (!ofs.good() || std::rename(tmpName.c_str(), cacheName.c_str()) != 0) {
+    std::remove(tmpName.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool SceneCache::open(const std::string &cacheName, uint64_t hash) {
+  close();
+  fd = ::open(cacheName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      static_cast<size_t>(st.st_size) < sizeof(SceneCacheHeader)) {
+    close();
+    return false;
+  }
+  size = st.st_size;
+  data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    data = nullptr;
+    close();
+    return false;
+  }
+  header = static_cast<const SceneCacheHeader *>(data);
+
+  auto inside = [&](uint64_t offset, uint64_t bytes) {
+    return offset % ALIGNMENT == 0 && offset <= size && bytes <= size - offset;
+  };
+  const SceneCacheHeader &h = *header;
+  bool valid = memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+               h.version == VERSION &&
+               h.headerSize == sizeof(SceneCacheHeader) &&
+               h.sourceHash == hash && inside(h.stringOffset, h.stringSize) &&
+               inside(h.materialOffset,
+                      h.materialNum * sizeof(MaterialRecord)) &&
+               inside(h.positionOffset, h.positionNum * 3 * sizeof(float)) &&
+               inside(h.normalOffset, h.normalNum * 3 * sizeof(float)) &&
+               inside(h.texcoordOffset, h.texcoordNum * 2 * sizeof(float)) &&
+               inside(h.triangleOffset,
+                      h.triangleNum * sizeof(TriangleIndex)) &&
+               inside(h.nodeOffset, h.nodeNum * sizeof(LinearBVHNode)) &&
+               inside(h.primitiveOffset, h.primitiveNum * sizeof(uint32_t)) &&
+               h.primitiveNum == h.triangleNum;
+  if (valid) {
+    // 检查下标，损坏的缓存不能在遍历时越界
+    const char *base = static_cast<const char *>(data);
+    const LinearBVHNode *nodes =
+        reinterpret_cast<const LinearBVHNode *>(base + h.nodeOffset);
+    for (uint64_t i = 0; valid && i < h.nodeNum; i++) {
+      const LinearBVHNode &node = nodes[i];
+      valid = node.count > 0
+                  ? node.offset >= 0 &&
+                        static_cast<uint64_t>(node.offset) + node.count <=
+                            h.primitiveNum
+                  : node.count == 0 && node.offset > static_cast<int64_t>(i) &&
+                        static_cast<uint64_t>(node.offset) < h.nodeNum;
+    }
+    const TriangleIndex *tis =
+        reinterpret_cast<const TriangleIndex *>(base + h.triangleOffset);
+    for (uint64_t i = 0; valid && i < h.triangleNum; i++) {
+      const TriangleIndex &ti = tis[i];
+      valid = ti.materialId < h.materialNum && ti.n < h.normalNum;
+      for (int k = 0; valid && k < 3; k++) {
+        valid = ti.v[k] < h.positionNum && ti.vt[k] < h.texcoordNum;
+      }
+    }
+    const uint32_t *ids =
+        reinterpret_cast<const uint32_t *>(base + h.primitiveOffset);
+    for (uint64_t i = 0; valid && i < h.primitiveNum; i++) {
+      valid = ids[i] < h.triangleNum;
+    }
+  }
+  if (!valid) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SceneCache::close() {
+  if (data != nullptr) {
+    munmap(data, size);
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+  fd = -1;
+  data = nullptr;
+  size = 0;
+  header = nullptr;
+}
+
+bool SceneCache::isOpen() const { return header != nullptr; }
+
+LinearBVH *SceneCache::restore(Mesh &mesh,
+                              std::vector<Hittable *> &objects) const {
+  SRE_PROFILE_SCOPE("restoreSceneCache");
+  assert(isOpen());
+  const char *base = static_cast<const char *>(data);
+
+  mesh.clear();
+  unpackMaterials(
+      reinterpret_cast<const MaterialRecord *>(base + header->materialOffset),
+      header->materialNum, base + header->stringOffset, header->stringSize,
+      mesh.materials);
+
+  const float *positions =
+      reinterpret_cast<const float *>(base + header->positionOffset);
+  mesh.positions.resize(header->positionNum);
+  for (size_t i = 0; i < mesh.positions.size(); i++) {
+    mesh.positions[i] = Vec3<float>(positions[3 * i], positions[3 * i + 1],
+                                    positions[3 * i + 2]);
+  }
+  const float *normals =
+      reinterpret_cast<const float *>(base + header->normalOffset);
+  mesh.normals.resize(header->normalNum);
+  for (size_t i = 0; i < mesh.normals.size(); i++) {
+    mesh.normals[i] =
+        Vec3<float>(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+  }
+  const float *texcoords =
+      reinterpret_cast<const float *>(base + header->texcoordOffset);
+  mesh.texcoords.resize(header->texcoordNum);
+  for (size_t i = 0; i < mesh.texcoords.size(); i++) {
+    mesh.texcoords[i] = Vec2<float>(texcoords[2 * i], texcoords[2 * i + 1]);
+  }
+  const TriangleIndex *tis =
+      reinterpret_cast<const TriangleIndex *>(base + header->triangleOffset);
+  mesh.indices.assign(tis, tis + header->triangleNum);
+  mesh.finalize();
+
+  objects.clear();
+  objects.reserve(header->triangleNum);
+  for (const Triangle &triangle : mesh.getTriangles()) {
+    objects.push_back(const_cast<Triangle *>(&triangle));
+  }
+
+  const uint32_t *ids =
+      reinterpret_cast<const uint32_t *>(base + header->primitiveOffset);
+  std::vector<Hittable *> primitives(header->primitiveNum);
+  for (size_t i = 0; i < primitives.size(); i++) {
+    primitives[i] = objects[ids[i]];
+  }
+  const LinearBVHNode *nodes =
+      reinterpret_cast<const LinearBVHNode *>(base + header->nodeOffset);
+  return new LinearBVH(nodes, header->nodeNum, primitives);
+}
+
+// print.
+void SceneCache::printStatus() const {
+  std::cout << "scene cache" << '\n';
+  if (isOpen()) {
+    std::cout << "file size: " << size / 1024 << "KB" << '\n'
+              << "materials: " << header->materialNum << '\n'
+              << "positions: " << header->positionNum << '\n'
+              << "triangles: " << header->triangleNum << '\n'
+              << "BVH nodes: " << header->nodeNum << '\n';
+  } else {
+    std::cout << "not mapped" << '\n';
+  }
+  std::cout << std::endl;
+}
+}  // namespace sre
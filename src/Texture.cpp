@@ -1,51 +1,271 @@
 #include "../include/Texture.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 
+#include "../include/Profiler.hpp"
+#include "../include/RenderStats.hpp"
+#include "../include/TextureCache.hpp"
+
 namespace sre {
+std::mutex Texture::instanceMutex;
 std::unordered_map<std::string, Texture*> Texture::textures;
 
+// 8x8分块
+static const int TILE_BITS = 3;
+static const int TILE_SIZE = 1 << TILE_BITS;
+static const int TILE_MASK = TILE_SIZE - 1;
+// 3位坐标按位交错的结果，x占偶数位，y占奇数位
+static const int MORTON[TILE_SIZE] = {0, 1, 4, 5, 16, 17, 20, 21};
+
+// sRGB编码转换到线性空间
+static float srgbToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+Texture::Texture() : ready(false), width(0), height(0), levelNum(0) {}
+
 Texture* Texture::getInstance(const std::string& texName) {
-  if (textures.find(texName) == textures.end()) {
+  std::lock_guard<std::mutex> lock(instanceMutex);
+  auto itr = textures.find(texName);
+  if (itr == textures.end()) {
+    // 只登记，第一次采样时才读取图像
     Texture* ntex = new Texture();
-    ntex->img = cv::imread(texName, cv::IMREAD_COLOR);
-    textures[texName] = ntex;
-    // std::cout << "texture image: " << ntex->img.cols << '\t' <<
-    // ntex->img.rows
-    //           << '\t' << ntex->img.channels() << '\t' << ntex->img.depth()
-    //           << std::endl;
-    cv::namedWindow(texName.c_str(), 0);
-    cv::imshow(texName.c_str(), ntex->img);
-    cv::waitKey(0);
-    cv::destroyWindow(texName.c_str());
-  }
-  return textures[texName];
+    ntex->name = texName;
+    itr = textures.emplace(texName, ntex).first;
+    TextureCache::getInstance().registerTexture(ntex);
+  }
+  return itr->second;
 }
+
 void Texture::realeaseAllInstances() {
+  std::lock_guard<std::mutex> lock(instanceMutex);
+  TextureCache::getInstance().unregisterAll();
   for (auto itr = textures.begin(); itr != textures.end(); itr++) {
     delete itr->second;
     itr->second = nullptr;
   }
+  textures.clear();
 }
-Vec3<float> Texture::getColorAt(const Vec2<float>& pos) {
-  assert(pos.u >= 0 && pos.u <= 1 && pos.v >= 0 && pos.v <= 1);
-  Vec3<float> color(0, 0, 0);
-  int rows = img.rows - 1, cols = img.cols - 1;
-  switch (img.depth()) {
-    case CV_8U:
-      color.x = img.at<cv::Vec3b>(pos.u * rows, pos.v * cols)[2] / 255.0f;
-      color.y = img.at<cv::Vec3b>(pos.u * rows, pos.v * cols)[1] / 255.0f;
-      color.z = img.at<cv::Vec3b>(pos.u * rows, pos.v * cols)[0] / 255.0f;
-      break;
-    default:
-      color.x = img.at<cv::Vec3f>(pos.u * rows, pos.v * cols)[2];
-      color.y = img.at<cv::Vec3f>(pos.u * rows, pos.v * cols)[1];
-      color.z = img.at<cv::Vec3f>(pos.u * rows, pos.v * cols)[0];
+
+bool Texture::decode(std::vector<Level>& levels, size_t count) const {
+  levels.clear();
+  cv::Mat img = cv::imread(name, cv::IMREAD_COLOR);
+  if (img.empty()) {
+    return false;
+  }
+
+  // 8位图像按sRGB解码，浮点图像认为已经是线性值
+  float lut[256];
+  for (int i = 0; i < 256; i++) {
+    lut[i] = srgbToLinear(i / 255.0f);
+  }
+
+  int w = img.cols, h = img.rows;
+  std::vector<Texel> linear(static_cast<size_t>(w) * h);
+  for (int y = 0; y < h; y++) {
+    for (int x = 0; x < w; x++) {
+      Texel& t = linear[static_cast<size_t>(y) * w + x];
+      if (img.depth() == CV_8U) {
+        const cv::Vec3b& c = img.at<cv::Vec3b>(y, x);
+        t = {lut[c[2]], lut[c[1]], lut[c[0]]};
+      } else {
+        const cv::Vec3f& c = img.at<cv::Vec3f>(y, x);
+        t = {c[2], c[1], c[0]};
+      }
+    }
+  }
+  img.release();
+
+  while (count == 0 || levels.size() < count) {
+    Level level;
+    level.width = w;
+    level.height = h;
+    level.tilesX = (w + TILE_MASK) >> TILE_BITS;
+    int tilesY = (h + TILE_MASK) >> TILE_BITS;
+    level.texels.resize(static_cast<size_t>(level.tilesX) * tilesY *
+                        TILE_SIZE * TILE_SIZE);
+    for (int y = 0; y < h; y++) {
+      for (int x = 0; x < w; x++) {
+        level.texels[getIndex(level, x, y)] =
+            linear[static_cast<size_t>(y) * w + x];
+      }
+    }
+    levels.push_back(std::move(level));
+    if (w == 1 && h == 1) {
       break;
+    }
+
+    // 2x2盒式滤波生成下一级，奇数边长时边界纹素重复使用
+    int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+    std::vector<Texel> next(static_cast<size_t>(nw) * nh);
+    for (int y = 0; y < nh; y++) {
+      int y0 = std::min(2 * y, h - 1);
+      int y1 = std::min(2 * y + 1, h - 1);
+      for (int x = 0; x < nw; x++) {
+        int x0 = std::min(2 * x, w - 1);
+        int x1 = std::min(2 * x + 1, w - 1);
+        const Texel& a = linear[static_cast<size_t>(y0) * w + x0];
+        const Texel& b = linear[static_cast<size_t>(y0) * w + x1];
+        const Texel& c = linear[static_cast<size_t>(y1) * w + x0];
+        const Texel& d = linear[static_cast<size_t>(y1) * w + x1];
+        next[static_cast<size_t>(y) * nw + x] = {
+            (a.r + b.r + c.r + d.r) * 0.25f, (a.g + b.g + c.g + d.g) * 0.25f,
+            (a.b + b.b + c.b + d.b) * 0.25f};
+      }
+    }
+    linear.swap(next);
+    w = nw;
+    h = nh;
+  }
+  return true;
+}
+
+void Texture::prepare() const {
+  std::lock_guard<std::mutex> lock(loadMutex);
+  if (ready.load(std::memory_order_acquire)) {
+    return;
+  }
+  SRE_PROFILE_SCOPE("loadTexture", name);
+  // 第一次访问时生成完整的mipmap链并全部放入缓存，之后由缓存按需换出
+  std::vector<Level> levels;
+  if (!decode(levels, 0)) {
+    std::cout << "Texture loading fails: " << name << std::endl;
+  }
+  width = levels.empty() ? 0 : levels[0].width;
+  height = levels.empty() ? 0 : levels[0].height;
+  levelNum = levels.size();
+  slots.reset(new Slot[levelNum]);
+  for (size_t l = 0; l < levelNum; l++) {
+    slots[l].lastUse = 0;
+    slots[l].bytes = levels[l].texels.size() * sizeof(Texel);
+  }
+  ready.store(true, std::memory_order_release);
+
+  TextureCache& cache = TextureCache::getInstance();
+  for (size_t l = 0; l < levelNum; l++) {
+    cache.insert(slots[l], std::make_shared<Level>(std::move(levels[l])));
+  }
+}
+
+std::shared_ptr<const Texture::Level> Texture::getLevel(size_t l) const {
+  Slot& slot = slots[l];
+  TextureCache& cache = TextureCache::getInstance();
+  std::shared_ptr<const Level> level = std::atomic_load(&slot.level);
+  if (level != nullptr) {
+    cache.recordHit(slot);
+    return level;
+  }
+
+  // 缺失：重新读取图像并生成到第l级，只放回这一级
+  std::lock_guard<std::mutex> lock(loadMutex);
+  level = std::atomic_load(&slot.level);
+  if (level != nullptr) {
+    cache.recordHit(slot);
+    return level;
+  }
+  std::vector<Level> levels;
+  if (!decode(levels, l + 1) || levels.size() <= l) {
+    return nullptr;
   }
+  level = std::make_shared<Level>(std::move(levels[l]));
+  cache.insert(slot, level);
+  return level;
+}
+
+size_t Texture::getIndex(const Level& level, int x, int y) const {
+  size_t tile = static_cast<size_t>(y >> TILE_BITS) * level.tilesX +
+                (x >> TILE_BITS);
+  int inner = MORTON[x & TILE_MASK] | (MORTON[y & TILE_MASK] << 1);
+  return (tile << (2 * TILE_BITS)) | inner;
+}
 
+const Texture::Texel& Texture::fetch(const Level& level, int x, int y) const {
+  return level.texels[getIndex(level, x, y)];
+}
+
+Vec3<float> Texture::bilinear(const Level& level, float u, float v) const {
+  // 纹素中心位于半整数处，坐标按重复方式环绕
+  float fx = u * level.width - 0.5f, fy = v * level.height - 0.5f;
+  float x0f = std::floor(fx), y0f = std::floor(fy);
+  float tx = fx - x0f, ty = fy - y0f;
+  auto wrap = [](int i, int n) {
+    i %= n;
+    return i < 0 ? i + n : i;
+  };
+  int x0 = wrap(static_cast<int>(x0f), level.width);
+  int y0 = wrap(static_cast<int>(y0f), level.height);
+  int x1 = x0 + 1 == level.width ? 0 : x0 + 1;
+  int y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+
+  const Texel& a = fetch(level, x0, y0);
+  const Texel& b = fetch(level, x1, y0);
+  const Texel& c = fetch(level, x0, y1);
+  const Texel& d = fetch(level, x1, y1);
+  float wa = (1 - tx) * (1 - ty), wb = tx * (1 - ty), wc = (1 - tx) * ty,
+        wd = tx * ty;
+  return Vec3<float>(a.r * wa + b.r * wb + c.r * wc + d.r * wd,
+                     a.g * wa + b.g * wb + c.g * wc + d.g * wd,
+                     a.b * wa + b.b * wb + c.b * wc + d.b * wd);
+}
+
+void Texture::prefetch() const {
+  if (!ready.load(std::memory_order_acquire)) {
+    prepare();
+  }
+}
+
+// getter.
+std::string Texture::getName() const { return name; }
+int Texture::getWidth() const {
+  prepare();
+  return width;
+}
+int Texture::getHeight() const {
+  prepare();
+  return height;
+}
+size_t Texture::getLevelNum() const {
+  prepare();
+  return levelNum;
+}
+
+Vec3<float> Texture::getColorAt(const Vec2<float>& pos,
+                                float footprint) const {
+  SRE_STAT(getThreadStats().textureLookups++);
+  if (!ready.load(std::memory_order_acquire)) {
+    prepare();
+  }
+  if (levelNum == 0) {
+    // 加载失败时不影响材质本身的颜色
+    return Vec3<float>(1, 1, 1);
+  }
+  // 纹理坐标v轴向上，图像的行从上往下
+  float u = pos.u, v = 1 - pos.v;
+
+  float lod = 0;
+  if (footprint > 0) {
+    float texels =
+        footprint * std::sqrt(static_cast<float>(width) * height);
+    lod = std::min(std::max(std::log2(texels), 0.0f),
+                   static_cast<float>(levelNum - 1));
+  }
+  size_t l0 = static_cast<size_t>(lod);
+  float t = lod - l0;
+  std::shared_ptr<const Level> level = getLevel(l0);
+  if (level == nullptr) {
+    return Vec3<float>(1, 1, 1);
+  }
+  Vec3<float> color = bilinear(*level, u, v);
+  if (t > 0 && l0 + 1 < levelNum) {
+    std::shared_ptr<const Level> next = getLevel(l0 + 1);
+    if (next != nullptr) {
+      color = color * (1 - t) + bilinear(*next, u, v) * t;
+    }
+  }
   return color;
 }
 
-}  // namespace sre
\ No newline at end of file
+}  // namespace sre
@@ -0,0 +1,127 @@
+#include "../include/TextureCache.hpp"
+
+#include <iostream>
+
+namespace sre {
+
+// 命中计数每个线程攒够一批再写入共享计数器，避免频繁争用同一缓存行
+static const uint64_t HIT_BATCH = 256;
+static thread_local uint64_t pendingHits = 0;
+
+// 默认预算1GB
+TextureCache::TextureCache()
+    : budget(static_cast<size_t>(1) << 30),
+      usedBytes(0),
+      clock(0),
+      hits(0),
+      misses(0),
+      evictions(0) {}
+
+TextureCache &TextureCache::getInstance() {
+  static TextureCache cache;
+  return cache;
+}
+
+void TextureCache::registerTexture(Texture *texture) {
+  std::lock_guard<std::mutex> lock(mutex);
+  textures.push_back(texture);
+}
+
+void TextureCache::unregisterAll() {
+  std::lock_guard<std::mutex> lock(mutex);
+  textures.clear();
+  usedBytes = 0;
+}
+
+void TextureCache::recordHit(Texture::Slot &slot) {
+  uint64_t now = clock.load(std::memory_order_relaxed);
+  if (slot.lastUse.load(std::memory_order_relaxed) != now) {
+    slot.lastUse.store(now, std::memory_order_relaxed);
+  }
+  if (++pendingHits == HIT_BATCH) {
+    hits.fetch_add(pendingHits, std::memory_order_relaxed);
+    pendingHits = 0;
+  }
+}
+
+void TextureCache::insert(Texture::Slot &slot,
+                          std::shared_ptr<const Texture::Level> level) {
+  slot.lastUse.store(clock.fetch_add(1, std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+  // 先计入占用再发布，其他线程换出这一级时不会把计数减成负数
+  usedBytes.fetch_add(slot.bytes);
+  std::atomic_store(&slot.level, std::move(level));
+  misses.fetch_add(1, std::memory_order_relaxed);
+  if (budget > 0 && usedBytes.load() > budget) {
+    evict();
+  }
+}
+
+void TextureCache::evict() {
+  std::lock_guard<std::mutex> lock(mutex);
+  while (usedBytes.load() > budget) {
+    // 纹理级数很少，线性扫描找最久未使用的一级
+    Texture::Slot *victim = nullptr;
+    uint64_t oldest = UINT64_MAX;
+    for (Texture *texture : textures) {
+      if (!texture->ready.load(std::memory_order_acquire)) {
+        continue;
+      }
+      for (size_t l = 0; l < texture->levelNum; l++) {
+        Texture::Slot &slot = texture->slots[l];
+        uint64_t lastUse = slot.lastUse.load(std::memory_order_relaxed);
+        if (lastUse < oldest && std::atomic_load(&slot.level) != nullptr) {
+          oldest = lastUse;
+          victim = &slot;
+        }
+      }
+    }
+    if (victim == nullptr) {
+      break;
+    }
+    // 正在使用这一级的线程仍持有shared_ptr，换出后才真正释放
+    if (std::atomic_exchange(&victim->level,
+                             std::shared_ptr<const Texture::Level>()) !=
+        nullptr) {
+      usedBytes.fetch_sub(victim->bytes);
+      evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+// setter.
+void TextureCache::setBudget(size_t bytes) {
+  budget = bytes;
+  if (budget > 0 && usedBytes.load() > budget) {
+    evict();
+  }
+}
+
+// getter.
+size_t TextureCache::getBudget() const { return budget; }
+size_t TextureCache::getUsedBytes() const { return usedBytes.load(); }
+uint64_t TextureCache::getHits() const { return hits.load(); }
+uint64_t TextureCache::getMisses() const { return misses.load(); }
+uint64_t TextureCache::getEvictions() const { return evictions.load(); }
+bool TextureCache::empty() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return textures.empty();
+}
+
+// print.
+void TextureCache::printStatus() {
+  size_t textureNum;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    textureNum = textures.size();
+  }
+  std::cout << "texture cache" << '\n'
+            << "textures: " << textureNum << '\n'
+            << "budget: " << budget / (1024 * 1024) << "MB" << '\n'
+            << "resident: " << usedBytes.load() / (1024 * 1024) << "MB" << '\n'
+            << "hits (approx.): " << hits.load() << '\n'
+            << "misses: " << misses.load() << '\n'
+            << "evictions: " << evictions.load() << '\n';
+  std::cout << std::endl;
+}
+}  // namespace sre
@@ -0,0 +1,92 @@
+#include "../include/ToneMapper.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+#include "../include/HDRFile.hpp"
+#include "../include/Profiler.hpp"
+
+namespace sre {
+
+ToneMapper::ToneMapper(double _exponent) : exponent(_exponent) {
+  // 与按像素计算 255 * pow(c, exponent) 后截断的结果逐位一致
+  auto reaches = [&](float c, int k) {
+    return 255 * std::pow(static_cast<double>(c), exponent) >= k;
+  };
+  thresholds[0] = -std::numeric_limits<float>::infinity();
+  for (int k = 1; k < 256; k++) {
+    float c = static_cast<float>(std::pow(k / 255.0, 1.0 / exponent));
+    while (!reaches(c, k)) {
+      c = std::nextafter(c, std::numeric_limits<float>::infinity());
+    }
+    while (c > 0 && reaches(std::nextafter(c, 0.0f), k)) {
+      c = std::nextafter(c, 0.0f);
+    }
+    thresholds[k] = c;
+  }
+}
+
+unsigned char ToneMapper::map(float c) const {
+  // 找满足 thresholds[k] <= c 的最大k，NaN和负数得到0
+  int k = 0;
+  for (int step = 128; step > 0; step >>= 1) {
+    k += c >= thresholds[k + step] ? step : 0;
+  }
+  return static_cast<unsigned char>(k);
+}
+
+void ToneMapper::apply(const float *r, const float *g, const float *b,
+                       size_t n, unsigned char *bgr) const {
+  for (size_t i = 0; i < n; i++) {
+    bgr[3 * i] = map(b[i]);
+    bgr[3 * i + 1] = map(g[i]);
+    bgr[3 * i + 2] = map(r[i]);
+  }
+}
+
+cv::Mat ToneMapper::apply(const FrameBuffer &frame) const {
+  SRE_PROFILE_SCOPE("toneMap");
+  int width = frame.getWidth(), height = frame.getHeight();
+  cv::Mat img(height, width, CV_8UC3);
+  const float *r = frame.getColorPlane(0);
+  const float *g = frame.getColorPlane(1);
+  const float *b = frame.getColorPlane(2);
+#pragma omp parallel for schedule(static)
+  for (int row = 0; row < height; row++) {
+    size_t offset = static_cast<size_t>(row) * width;
+    apply(r + offset, g + offset, b + offset, width,
+          img.ptr<unsigned char>(row));
+  }
+  return img;
+}
+
+bool ToneMapper::apply(const std::string &hdrName,
+                       const std::string &ppmName) const {
+  HDRReader reader;
+  if (!reader.open(hdrName)) {
+    return false;
+  }
+  int width = reader.getWidth(), height = reader.getHeight();
+  FILE *fp = fopen(ppmName.c_str(), "wb");
+  if (fp == nullptr) {
+    return false;
+  }
+  fprintf(fp, "P6\n%d %d\n255\n", width, height);
+  std::vector<float> r(width), g(width), b(width);
+  std::vector<unsigned char> rgb(static_cast<size_t>(width) * 3);
+  bool ok = true;
+  for (int y = 0; ok && y < height; y++) {
+    ok = reader.readLine(y, r.data(), g.data(), b.data());
+    // PPM按R、G、B顺序存放，交换输入通道即可
+    apply(b.data(), g.data(), r.data(), width, rgb.data());
+    ok = ok && fwrite(rgb.data(), 1, rgb.size(), fp) == rgb.size();
+  }
+  ok = fclose(fp) == 0 && ok;
+  return ok;
+}
+
+// getter.
+double ToneMapper::getExponent() const { return exponent; }
+}  // namespace sre
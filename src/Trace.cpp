@@ -3,30 +3,66 @@
 #include <omp.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <fstream>
+#include <map>
 
+#include "../include/HDRFile.hpp"
 #include "../include/Material.hpp"
+#include "../include/ObjLoader.hpp"
+#include "../include/Profiler.hpp"
+#include "../include/Random.hpp"
+#include "../include/TextureCache.hpp"
 #include "../include/Triangle.hpp"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "../third-parties/tinyobjloader/tiny_obj_loader.h"
 
 #define EPSILON 1e-6f
+// 迭代积分器的路径长度上限，正常情况下由俄罗斯轮盘终止
+#define MAX_PATH_DEPTH 64
 
 namespace sre {
 Tracer::Tracer(size_t _depth, size_t _samples, float _p)
-    : scenes(nullptr), maxDepth(_depth), samples(_samples), thresholdP(_p) {}
+    : scenes(nullptr),
+      compressedScenes(nullptr),
+      accelerator(nullptr),
+      compressBVH(false),
+      sourceHash(0),
+      sourceHashed(false),
+      chunkBudget(0),
+      chunkTriangles(0),
+      maxDepth(_depth),
+      samples(_samples),
+      thresholdP(_p),
+      denoise(false),
+      photonNum(0),
+      gatherDepth(1),
+      photonRadius(0),
+      checkpointInterval(600),
+      features(0),
+      kernel(nullptr),
+      primaryShader(nullptr) {}
 
 Tracer::~Tracer() {
   if (scenes != nullptr) {
     delete scenes;
   }
   scenes = nullptr;
+  if (compressedScenes != nullptr) {
+    delete compressedScenes;
+  }
+  compressedScenes = nullptr;
+  accelerator = nullptr;
+  // objects指向mesh中的三角形视图，由mesh释放
+  objects.clear();
 }
 
 bool Tracer::loadConfiguration(
     const std::string &configName,
     std::unordered_map<std::string, Vec3<float>> &lightRadiances) {
+  SRE_PROFILE_SCOPE("loadConfiguration", configName);
   std::ifstream ifs;
   ifs.open(configName, std::ios::in);
   if (!ifs.is_open()) {
@@ -143,20 +179,27 @@ bool Tracer::loadConfiguration(
   return true;
 }
 
-bool Tracer::loadModel(
+bool Tracer::parseModel(
     const std::string &modelName, const std::string &pathName,
-    const std::unordered_map<std::string, Vec3<float>> &lightRadiances) {
-  tinyobj::attrib_t attrib;
-  std::vector<tinyobj::shape_t> shapes;
-  std::vector<tinyobj::material_t> materials;
-  std::string warn;
-  std::string err;
-  if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, &warn,
-                        modelName.c_str(), pathName.c_str())) {
+    const std::unordered_map<std::string, Vec3<float>> &lightRadiances,
+    ModelData &model) const {
+  if (!model.loader.load(modelName, model.buffer)) {
     return false;
   }
 
-  std::vector<Material> actualMaterials;
+  std::map<std::string, int> &materialMap = model.materialMap;
+  std::vector<tinyobj::material_t> materials;
+  for (const auto &mtlLib : model.buffer.mtlLibs) {
+    std::ifstream ifs(pathName + mtlLib);
+    if (!ifs.is_open()) {
+      continue;
+    }
+    std::string warn;
+    std::string err;
+    tinyobj::LoadMtl(&materialMap, &materials, &ifs, &warn, &err);
+  }
+
+  std::vector<Material> &actualMaterials = model.materials;
   for (const auto &material : materials) {
     Material actualMaterial;
     actualMaterial.setName(material.name);
@@ -181,102 +224,244 @@ bool Tracer::loadModel(
 
     if (!material.ambient_texname.empty()) {
       actualMaterial.setAmbientTexture(pathName + material.ambient_texname);
+      model.textureNames.push_back(pathName + material.ambient_texname);
     }
     if (!material.diffuse_texname.empty()) {
       actualMaterial.setDiffuseTexture(pathName + material.diffuse_texname);
+      model.textureNames.push_back(pathName + material.diffuse_texname);
     }
     if (!material.specular_texname.empty()) {
       actualMaterial.setSpecularTexture(pathName + material.specular_texname);
+      model.textureNames.push_back(pathName + material.specular_texname);
     }
 
     actualMaterials.emplace_back(actualMaterial);
   }
+  return true;
+}
 
-  size_t id = 0;
-  for (const auto &shape : shapes) {
-    assert(shape.mesh.material_ids.size() ==
-           shape.mesh.num_face_vertices.size());
+void Tracer::appendModel(const ModelData &model) {
+  model.loader.printStatus();
+  const MeshBuffer &buffer = model.buffer;
+  const std::map<std::string, int> &materialMap = model.materialMap;
+  const std::vector<Material> &actualMaterials = model.materials;
 
-    size_t triagnleNum = shape.mesh.material_ids.size();
-    for (size_t face_i = 0; face_i < triagnleNum; face_i++) {
-      Vec3<float> points[3];
-      for (size_t point_i = 0; point_i < 3; point_i++) {
-        int vertex_index =
-            shape.mesh.indices[face_i * 3 + point_i].vertex_index;
+  // usemtl引用的材质，没有材质或MTL中找不到时使用灰色漫反射材质
+  Material defaultMaterial;
+  defaultMaterial.setEmissive(false);
+  defaultMaterial.setDiffusion(0.6f, 0.6f, 0.6f);
+  defaultMaterial.setSpecularity(0, 0, 0);
+  defaultMaterial.setTransmittance(0, 0, 0);
+  defaultMaterial.setShiness(1);
+  defaultMaterial.setRefraction(1);
+  std::vector<uint32_t> materialIds;
+  for (const auto &name : buffer.materialNames) {
+    auto itr = materialMap.find(name);
+    if (itr != materialMap.end()) {
+      materialIds.push_back(mesh.addMaterial(actualMaterials[itr->second]));
+    } else {
+      defaultMaterial.setName(name);
+      materialIds.push_back(mesh.addMaterial(defaultMaterial));
+    }
+  }
+  uint32_t defaultMaterialId = 0;
+  if (std::find(buffer.materialIds.begin(), buffer.materialIds.end(), -1) !=
+      buffer.materialIds.end()) {
+    defaultMaterial.setName("");
+    defaultMaterialId = mesh.addMaterial(defaultMaterial);
+  }
 
-        points[point_i].x = attrib.vertices[vertex_index * 3 + 0];
-        points[point_i].y = attrib.vertices[vertex_index * 3 + 1];
-        points[point_i].z = attrib.vertices[vertex_index * 3 + 2];
+  // 顶点和纹理坐标按OBJ中的下标第一次用到时加入共享缓冲
+  const uint32_t UNSET = 0xffffffffu;
+  std::vector<uint32_t> positionIds(buffer.positions.size(), UNSET);
+  std::vector<uint32_t> texcoordIds(buffer.texcoords.size(), UNSET);
+  uint32_t zeroTexcoordId = UNSET;
+  for (size_t face_i = 0; face_i < buffer.getTriangleNum(); face_i++) {
+    const MeshIndex *corners = &buffer.indices[face_i * 3];
+    TriangleIndex index;
+    Vec3<float> points[3];
+    for (size_t point_i = 0; point_i < 3; point_i++) {
+      int position_index = corners[point_i].v;
+      points[point_i] = buffer.positions[position_index];
+      if (positionIds[position_index] == UNSET) {
+        positionIds[position_index] = mesh.addPosition(points[point_i]);
       }
+      index.v[point_i] = positionIds[position_index];
+    }
 
-      Vec2<float> point_textures[3];
-      for (size_t point_i = 0; point_i < 3; point_i++) {
-        int texcoord_index =
-            shape.mesh.indices[face_i * 3 + point_i].texcoord_index;
-
-        if (texcoord_index * 2 + 1 < 0 ||
-            texcoord_index * 2 + 0 >= attrib.texcoords.size()) {
-          point_textures[point_i] = Vec2<float>(0, 0);
-          continue;
-        } 
+    for (size_t point_i = 0; point_i < 3; point_i++) {
+      int texcoord_index = corners[point_i].vt;
+      if (texcoord_index < 0) {
+        if (zeroTexcoordId == UNSET) {
+          zeroTexcoordId = mesh.addTexCoord(Vec2<float>(0, 0));
+        }
+        index.vt[point_i] = zeroTexcoordId;
+      } else {
+        if (texcoordIds[texcoord_index] == UNSET) {
+          texcoordIds[texcoord_index] =
+              mesh.addTexCoord(buffer.texcoords[texcoord_index]);
+        }
+        index.vt[point_i] = texcoordIds[texcoord_index];
+      }
+    }
 
-        point_textures[point_i].u = attrib.texcoords[texcoord_index * 2 + 0];
-        point_textures[point_i].v = attrib.texcoords[texcoord_index * 2 + 1];
+    bool normalValid = true;
+    Vec3<float> point_normals[3];
+    for (size_t point_i = 0; point_i < 3; point_i++) {
+      int normal_index = corners[point_i].vn;
+      if (normal_index < 0) {
+        normalValid = false;
+        break;
       }
-      // std::cout << "texture load success!\n";
+      point_normals[point_i] = buffer.normals[normal_index];
+    }
 
-      bool normalValid = true;
-      Vec3<float> point_normals[3];
-      for (size_t point_i = 0; point_i < 3; point_i++) {
-        int normal_index =
-            shape.mesh.indices[face_i * 3 + point_i].normal_index;
+    Vec3<float> normal =
+        Vec3<float>::cross(points[1] - points[0], points[2] - points[0]);
+    if (normalValid && (point_normals[0] == point_normals[1] ||
+                        point_normals[0] == point_normals[2] ||
+                        point_normals[1] == point_normals[2])) {
+      if (point_normals[0] == point_normals[1] ||
+          point_normals[0] == point_normals[2]) {
+        normal = point_normals[0];
+      } else {
+        normal = point_normals[1];
+      }
+    } else if (normalValid) {
+      if (Vec3<float>::dot(point_normals[0], normal) < 0) {
+        normal = -normal;
+      }
+    }
+    index.n = mesh.addNormal(normal);
 
-        if (normal_index * 3 + 2 < 0 ||
-            normal_index * 3 + 0 >= attrib.normals.size()) {
-          normalValid = false;
-          break;
-        }
+    int materialId = buffer.materialIds[face_i];
+    index.materialId =
+        materialId < 0 ? defaultMaterialId : materialIds[materialId];
+    mesh.addTriangle(index);
+  }
+}
 
-        point_normals[point_i].x = attrib.normals[normal_index * 3 + 0];
-        point_normals[point_i].y = attrib.normals[normal_index * 3 + 1];
-        point_normals[point_i].z = attrib.normals[normal_index * 3 + 2];
+bool Tracer::loadModels(
+    const std::string &pathName, const std::vector<std::string> &modelNames,
+    const std::unordered_map<std::string, Vec3<float>> &lightRadiances) {
+  // Scene
+  // 各模型的解析并发进行，每个模型解析完就开始预取纹理、构建它的BVH子树，
+  // 并入Mesh的任务按模型顺序依次执行，三角形编号与逐个加载时相同；
+  // 只有一个模型时不开并行区域，ObjLoader仍在文件内部并行解析
+  size_t modelNum = modelNames.size();
+  std::vector<ModelData> models(modelNum);
+  std::vector<LinearBVHSubtree> subtrees(modelNum);
+  std::vector<size_t> bases(modelNum, 0);
+  // 只作为任务依赖的标记，不读写
+  std::vector<char> parsedFlags(modelNum);
+  [[maybe_unused]] char *parsed = parsedFlags.data();
+  [[maybe_unused]] char meshOrder = 0;
+  bool valid = true;
+  // 各阶段在所有任务上累加的耗时，阶段之间互相重叠
+  std::vector<double> parseTimes(modelNum, 0), subtreeTimes(modelNum, 0),
+      mergeTimes(modelNum, 0);
+  double textureTime = 0;
+  auto seconds = [](std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t)
+        .count();
+  };
+#pragma omp parallel if (modelNum > 1)
+#pragma omp single
+  for (size_t i = 0; i < modelNum; i++) {
+#pragma omp task depend(out : parsed[i])
+    {
+      SRE_PROFILE_SCOPE("parseModel", modelNames[i]);
+      auto t = std::chrono::steady_clock::now();
+      if (!parseModel(pathName + modelNames[i], pathName, lightRadiances,
+                      models[i])) {
+        std::cout << "Model loading fails: " << modelNames[i] << std::endl;
+#pragma omp atomic write
+        valid = false;
       }
-
-      Vec3<float> normal =
-          Vec3<float>::cross(points[1] - points[0], points[2] - points[0]);
-      if (normalValid && (point_normals[0] == point_normals[1] ||
-                          point_normals[0] == point_normals[2] ||
-                          point_normals[1] == point_normals[2])) {
-        if (point_normals[0] == point_normals[1] ||
-            point_normals[0] == point_normals[2]) {
-          normal = point_normals[0];
-        } else {
-          normal = point_normals[1];
-        }
-      } else {
-        if (Vec3<float>::dot(point_normals[0], normal) < 0) {
-          normal = -normal;
+      parseTimes[i] = seconds(t);
+      for (std::string textureName : models[i].textureNames) {
+#pragma omp task
+        {
+          auto t0 = std::chrono::steady_clock::now();
+          Texture::getInstance(textureName)->prefetch();
+          double elapsed = seconds(t0);
+#pragma omp atomic
+          textureTime += elapsed;
         }
       }
-
-      Material material = actualMaterials[shape.mesh.material_ids[face_i]];
-      Triangle triangle(id, points[0], points[1], points[2], normal, material);
-      if (material.isEmissive()) {
-        light.setLight(triangle);
+    }
+#pragma omp task depend(in : parsed[i])
+    {
+      SRE_PROFILE_SCOPE("buildSubtree", modelNames[i]);
+      auto t = std::chrono::steady_clock::now();
+      const MeshBuffer &buffer = models[i].buffer;
+      std::vector<AABB> bounds(buffer.getTriangleNum());
+      for (size_t f = 0; f < bounds.size(); f++) {
+        const MeshIndex *corners = &buffer.indices[f * 3];
+        Vec3<float> a = buffer.positions[corners[0].v];
+        Vec3<float> b = buffer.positions[corners[1].v];
+        Vec3<float> c = buffer.positions[corners[2].v];
+        bounds[f] = AABB(
+            Vec3<float>(std::min(a.x, std::min(b.x, c.x)),
+                        std::min(a.y, std::min(b.y, c.y)),
+                        std::min(a.z, std::min(b.z, c.z))),
+            Vec3<float>(std::max(a.x, std::max(b.x, c.x)),
+                        std::max(a.y, std::max(b.y, c.y)),
+                        std::max(a.z, std::max(b.z, c.z))));
       }
-      Hittable *obj =
-          new Triangle(id, points[0], points[1], points[2], point_textures[0],
-                       point_textures[1], point_textures[2], normal, material);
-      objects.push_back(obj);
-      id += 1;
+      LinearBVH::buildSubtree(bounds, subtrees[i]);
+      subtreeTimes[i] = seconds(t);
     }
+#pragma omp task depend(in : parsed[i]) depend(inout : meshOrder)
+    {
+      SRE_PROFILE_SCOPE("appendModel", modelNames[i]);
+      auto t = std::chrono::steady_clock::now();
+      bases[i] = mesh.getTriangleNum();
+      appendModel(models[i]);
+      mergeTimes[i] = seconds(t);
+    }
+    // 子树和合并都完成后释放解析结果
+#pragma omp task depend(inout : parsed[i])
+    models[i] = ModelData();
+  }
+  if (!valid) {
+    std::cout << "Model loading fails!" << std::endl;
+    return false;
   }
+  std::cout << "Model loading success!" << std::endl;
 
+  auto t = std::chrono::steady_clock::now();
+  mesh.finalize();
+  for (const Triangle &triangle : mesh.getTriangles()) {
+    objects.push_back(const_cast<Triangle *>(&triangle));
+  }
+  double finalizeTime = seconds(t);
+  // 顶层只在各模型子树的根之上构建
+  t = std::chrono::steady_clock::now();
+  scenes = new LinearBVH(subtrees, bases, objects);
+  double topLevelTime = seconds(t);
+
+  auto sum = [](const std::vector<double> &times) {
+    double total = 0;
+    for (double time : times) {
+      total += time;
+    }
+    return total;
+  };
+  std::cout << "scene loading stages" << '\n'
+            << "parse: " << sum(parseTimes) << "s" << '\n'
+            << "texture prefetch: " << textureTime << "s" << '\n'
+            << "BVH subtrees: " << sum(subtreeTimes) << "s" << '\n'
+            << "mesh merge: " << sum(mergeTimes) << "s" << '\n'
+            << "mesh finalize: " << finalizeTime << "s" << '\n'
+            << "BVH top level: " << topLevelTime << "s" << '\n';
+  std::cout << std::endl;
   return true;
 }
 
 void Tracer::load(const std::string &pathName, const std::vector<std::string> &modelNames,
                   const std::string &configName) {
+  SRE_PROFILE_SCOPE("load", pathName);
   // Configuration -Camera
   std::unordered_map<std::string, Vec3<float>> lightRadiances;
   std::string config = pathName + configName;
@@ -285,57 +470,866 @@ void Tracer::load(const std::string &pathName, const std::vector<std::string> &m
     return;
   }
   std::cout << "Camera config loading success!" << std::endl;
-  // Scene
-  for (auto modelName : modelNames) {
-    std::string model = pathName + modelName;
-    if (!loadModel(model, pathName, lightRadiances)) {
-      std::cout << "Model loading fails!" << std::endl;
-      return;
+
+  auto start = std::chrono::steady_clock::now();
+  sourcePath = pathName;
+  sourceModels = modelNames;
+  sourceConfig = configName;
+  sourceHashed = false;
+  if (!chunkName.empty()) {
+    // 划分粒度不同时重新写出分块文件
+    uint64_t hash = (getSourceHash() ^ chunkTriangles) * 1099511628211ull;
+    chunkedScene.setBudget(chunkBudget);
+    if (chunkedScene.open(chunkName, hash)) {
+      std::cout << "Chunked scene loading success!" << std::endl;
+    } else {
+      // 在内存中完整加载一次，写出分块文件后释放
+      if (!loadModels(pathName, modelNames, lightRadiances)) {
+        return;
+      }
+      bool written =
+          ChunkedScene::write(chunkName, hash, mesh, chunkTriangles);
+      delete scenes;
+      scenes = nullptr;
+      objects.clear();
+      mesh.clear();
+      if (!written || !chunkedScene.open(chunkName, hash)) {
+        std::cout << "Chunked scene writing fails!" << std::endl;
+        return;
+      }
+      std::cout << "Chunked scene writing success!" << std::endl;
+    }
+    accelerator = &chunkedScene;
+    const std::vector<Triangle> &lightTriangles =
+        chunkedScene.getLightTriangles();
+    for (size_t i = 0; i < lightTriangles.size(); i++) {
+      light.setLight(lightTriangles[i], chunkedScene.getLightIds()[i]);
+    }
+  } else {
+    if (!cacheName.empty()) {
+      if (sceneCache.open(cacheName, getSourceHash())) {
+        scenes = sceneCache.restore(mesh, objects);
+        std::cout << "Scene cache loading success!" << std::endl;
+      }
+    }
+
+    if (scenes == nullptr) {
+      if (!loadModels(pathName, modelNames, lightRadiances)) {
+        return;
+      }
+      if (!cacheName.empty()) {
+        if (SceneCache::write(cacheName, getSourceHash(), mesh, *scenes)) {
+          std::cout << "Scene cache writing success!" << std::endl;
+        } else {
+          std::cout << "Scene cache writing fails!" << std::endl;
+        }
+      }
+    }
+    setCompressedBVH(compressBVH);
+    bvhReport = scenes->getReport();
+    for (const Triangle &triangle : mesh.getTriangles()) {
+      if (triangle.getMaterial().isEmissive()) {
+        light.setLight(triangle);
+      }
     }
   }
-  std::cout << "Model loading success!" << std::endl;
-  scenes = new BVH(objects, 0, objects.size());
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Scene loading time: " << elapsed.count() << "s" << std::endl;
 
   printStatus();
 }
 
+const Camera &Tracer::getCamera() const { return camera; }
+
+const Mesh &Tracer::getMesh() const { return mesh; }
+
+const LinearBVH *Tracer::getBVH() const { return scenes; }
+
+const BVHReport &Tracer::getBVHReport() const { return bvhReport; }
+
+const RenderStats &Tracer::getStats() const { return stats; }
+
+void Tracer::setSceneCache(const std::string &fileName) {
+  cacheName = fileName;
+}
+
+void Tracer::setCompressedBVH(bool enable) {
+  compressBVH = enable;
+  if (scenes == nullptr) {
+    return;
+  }
+  if (compressBVH && compressedScenes == nullptr) {
+    compressedScenes = new CompressedBVH(*scenes, &mesh);
+  }
+  accelerator = compressBVH ? static_cast<const Hittable *>(compressedScenes)
+                            : scenes;
+}
+
+void Tracer::setOutOfCore(const std::string &fileName, size_t budget,
+                          size_t _chunkTriangles) {
+  chunkName = fileName;
+  chunkBudget = budget;
+  chunkTriangles = _chunkTriangles;
+}
+
+void Tracer::setTextureBudget(size_t bytes) {
+  TextureCache::getInstance().setBudget(bytes);
+}
+
+void Tracer::setDenoise(bool enable, size_t iterations) {
+  denoise = enable;
+  denoiser.setIterations(iterations);
+}
+
+void Tracer::setPhotonMap(size_t num, size_t depth, float radius) {
+  photonNum = num;
+  gatherDepth = depth;
+  photonRadius = radius;
+  photonMap.clear();
+}
+
+void Tracer::setIntegrator(const IntegratorConfig &config) {
+  integrator = config;
+}
+
+void Tracer::setResampling(const ResamplingConfig &config) {
+  resampling = config;
+}
+
+void Tracer::setSolidAngleSampling(bool enable) {
+  light.setSolidAngleSampling(enable);
+}
+
+void Tracer::setCheckpoint(const std::string &fileName, double interval) {
+  checkpoint.setFileName(fileName);
+  checkpointInterval = interval;
+}
+
 cv::Mat Tracer::render() {
+  FrameBuffer frame;
+  render(frame);
+  return frame.toImage();
+}
+
+void Tracer::prepare() {
+  // 光子图预处理
+  if (photonNum > 0 && chunkedScene.isOpen()) {
+    // 光子追踪的访问是随机的，核外几何时会频繁换入换出
+    std::cout << "Photon map is skipped out of core" << std::endl;
+  } else if (photonNum > 0 && photonMap.size() == 0) {
+    SRE_PROFILE_SCOPE("buildPhotonMap");
+    photonMap.build(accelerator, objects, light, photonNum, photonRadius);
+    photonMap.printStatus();
+  }
+
+  selectKernel();
+
+  if (integrator.iterative && integrator.autoTune) {
+    SRE_PROFILE_SCOPE("tuneIntegrator");
+    tuneIntegrator();
+  }
+}
+
+void Tracer::render(FrameBuffer &frame) {
+  int height = camera.getHeight(), width = camera.getWidth();
+  frame.resize(width, height);
+  prepare();
+  resetStats();
+
+  if (resampling.candidates > 0) {
+    // 蓄水池在遍与遍之间传递，检查点中没有保存
+    if (checkpoint.isEnabled()) {
+      std::cout << "Checkpoint is skipped when resampling" << std::endl;
+    }
+    renderResampled(frame);
+  } else {
+    CheckpointHeader header;
+    header.width = width;
+    header.height = height;
+    header.seed = getRandomSeed();
+    header.configHash = checkpoint.isEnabled() ? getConfigHash() : 0;
+    header.passes = 0;
+    if (checkpoint.isEnabled() && checkpoint.load(frame, header)) {
+      std::cout << "Checkpoint loading success: " << header.passes << "/"
+                << samples << " passes" << std::endl;
+    }
+
+    // 逐遍渲染，每遍为每个像素累加一个样本
+    auto lastSave = std::chrono::steady_clock::now();
+    for (size_t k = header.passes; k < samples; k++) {
+      SRE_PROFILE_SCOPE("pass", std::to_string(k));
+      if (chunkedScene.isOpen()) {
+        renderBatched(frame, k);
+      } else {
+  #pragma omp parallel for schedule(dynamic)
+        for (int row = 0; row < height; row++) {
+          SRE_PROFILE_SCOPE("row");
+          for (int col = 0; col < width; col++) {
+            seedRandom(static_cast<uint64_t>(row) * width + col, k);
+            AOVSample aov;
+            Vec3<float> color = sample(camera.getRay(row, col), &aov);
+            frame.addSample(row, col, color, aov);
+          }
+        }
+      }
+
+      if (checkpoint.isEnabled()) {
+        header.passes = k + 1;
+        std::chrono::duration<double> elapsed =
+            std::chrono::steady_clock::now() - lastSave;
+        // 最后一遍等上一次写入完成，保证文件中是完整的结果
+        if (header.passes == samples) {
+          checkpoint.wait();
+        }
+        if ((header.passes == samples ||
+             elapsed.count() >= checkpointInterval) &&
+            checkpoint.save(frame, header)) {
+          lastSave = std::chrono::steady_clock::now();
+        }
+      }
+    }
+    if (checkpoint.isEnabled() && !checkpoint.wait()) {
+      std::cout << "Checkpoint writing fails: " << checkpoint.getFileName()
+                << std::endl;
+    }
+  }
+
+  if (denoise) {
+    SRE_PROFILE_SCOPE("denoise");
+    denoiser.denoise(frame);
+  }
+
+  collectStats(stats);
+  SRE_STAT(stats.printStatus());
+  TextureCache &textureCache = TextureCache::getInstance();
+  if (!textureCache.empty()) {
+    textureCache.printStatus();
+  }
+  if (chunkedScene.isOpen()) {
+    chunkedScene.printStatus();
+  }
+}
+
+bool Tracer::render(const std::string &fileName, int tileSize) {
+  int height = camera.getHeight(), width = camera.getWidth();
+  assert(tileSize > 0);
+  HDRWriter writer;
+  if (!writer.open(fileName, width, height)) {
+    std::cout << "HDR file opening fails: " << fileName << std::endl;
+    return false;
+  }
+  // 降噪和蓄水池复用都需要整帧数据，流式渲染时不做
+  if (denoise) {
+    std::cout << "Denoising is skipped when rendering to a file" << std::endl;
+  }
+  if (resampling.temporalReuse || resampling.spatialReuse) {
+    std::cout << "Reservoir reuse is skipped when rendering to a file"
+              << std::endl;
+  }
+  prepare();
+  resetStats();
+
+  // 每块累加完所有样本后立即写入文件，内存中只有正在渲染的块
+  int tilesX = (width + tileSize - 1) / tileSize;
+  int tilesY = (height + tileSize - 1) / tileSize;
+  bool ok = true;
+#pragma omp parallel for schedule(dynamic) reduction(&& : ok)
+  for (int t = 0; t < tilesX * tilesY; t++) {
+    SRE_PROFILE_SCOPE("tile", std::to_string(t));
+    int x0 = t % tilesX * tileSize, y0 = t / tilesX * tileSize;
+    int w = std::min(tileSize, width - x0), h = std::min(tileSize, height - y0);
+    std::vector<float> rgb(static_cast<size_t>(w) * h * 3);
+    for (int j = 0; j < h; j++) {
+      for (int i = 0; i < w; i++) {
+        Vec3<float> color(0, 0, 0);
+        for (size_t k = 0; k < samples; k++) {
+          seedRandom(static_cast<uint64_t>(y0 + j) * width + x0 + i, k);
+          color += sample(camera.getRay(y0 + j, x0 + i), nullptr);
+        }
+        color = color / static_cast<float>(samples);
+        float *pixel = &rgb[(static_cast<size_t>(j) * w + i) * 3];
+        pixel[0] = color.x;
+        pixel[1] = color.y;
+        pixel[2] = color.z;
+      }
+    }
+    SRE_PROFILE_SCOPE("writeTile", std::to_string(t));
+    ok = writer.writeTile(x0, y0, w, h, rgb.data()) && ok;
+  }
+  ok = writer.close() && ok;
+  if (!ok) {
+    std::cout << "HDR file writing fails: " << fileName << std::endl;
+  }
+
+  collectStats(stats);
+  SRE_STAT(stats.printStatus());
+  TextureCache &textureCache = TextureCache::getInstance();
+  if (!textureCache.empty()) {
+    textureCache.printStatus();
+  }
+  return ok;
+}
+
+void Tracer::renderBatched(FrameBuffer &frame, size_t pass) {
+  int height = camera.getHeight(), width = camera.getWidth();
+  size_t n = static_cast<size_t>(width) * height;
+  // 每批的光线数，批越大每次换入的块被越多光线共用
+  const size_t batchSize = 65536;
+  std::vector<Ray> rays;
+  std::vector<HitResult> hits;
+  for (size_t first = 0; first < n; first += batchSize) {
+    SRE_PROFILE_SCOPE("batch", std::to_string(first / batchSize));
+    size_t num = std::min(batchSize, n - first);
+    rays.resize(num);
+#pragma omp parallel for schedule(static)
+    for (long long j = 0; j < static_cast<long long>(num); j++) {
+      size_t i = first + j;
+      seedRandom(i, pass, 0);
+      rays[j] = camera.getRay(i / width, i % width);
+    }
+    chunkedScene.intersect(rays, hits);
+
+#pragma omp parallel for schedule(dynamic)
+    for (long long j = 0; j < static_cast<long long>(num); j++) {
+      size_t i = first + j;
+      seedRandom(i, pass, 1);
+      PrimarySample g;
+      g.hit = hits[j];
+      shadePrimary(rays[j], g);
+      AOVSample aov;
+      Vec3<float> color = sample(rays[j], &aov, &g);
+      frame.addSample(i / width, i % width, color, aov);
+    }
+  }
+}
+
+void Tracer::shadePrimary(const Ray &ray, PrimarySample &g) const {
+  assert(primaryShader != nullptr);
+  (this->*primaryShader)(ray, g);
+}
+
+template <unsigned F>
+void Tracer::shadePrimary(const Ray &ray, PrimarySample &g) const {
+  g.direct = Vec3<float>(0, 0, 0);
+  if (g.hit.isHit && !g.hit.material->isEmissive()) {
+    g.diffusion = getDiffusion<F>(g.hit, ray,
+                                  camera.getSpreadAngle() * g.hit.distance);
+    g.direct = sampleDirect<F>(g.hit.hitPoint, g.hit.normal, g.diffusion);
+  }
+}
+
+// 伪彩色：0到1依次为蓝、青、绿、黄、红
+static Vec3<float> falseColor(float t) {
+  static const Vec3<float> STOPS[5] = {
+      Vec3<float>(0, 0, 1), Vec3<float>(0, 1, 1), Vec3<float>(0, 1, 0),
+      Vec3<float>(1, 1, 0), Vec3<float>(1, 0, 0)};
+  t = std::clamp(t, 0.0f, 1.0f) * 4;
+  int k = std::min(static_cast<int>(t), 3);
+  float f = t - k;
+  return STOPS[k] * (1 - f) + STOPS[k + 1] * f;
+}
+
+bool Tracer::renderHeatmap(const std::string &baseName, size_t heatSamples) {
   int height = camera.getHeight(), width = camera.getWidth();
-  cv::Mat img(height, width, CV_8UC3);
+  assert(heatSamples > 0);
+  prepare();
 
-#pragma omp parallel for num_threads(20)
+  // 下标0为首次光线，1为整条路径
+  size_t n = static_cast<size_t>(width) * height;
+  std::vector<float> nodes[2], triangles[2];
+  for (int s = 0; s < 2; s++) {
+    nodes[s].resize(n);
+    triangles[s].resize(n);
+  }
+#pragma omp parallel for schedule(dynamic)
   for (int row = 0; row < height; row++) {
-#pragma omp parallel for num_threads(20)
     for (int col = 0; col < width; col++) {
-      Vec3<float> color(0, 0, 0);
-#pragma omp parallel for num_threads(10)
-      for (int k = 0; k < samples; k++) {
+      size_t i = static_cast<size_t>(row) * width + col;
+      TraversalCost primaryCost, pathCost;
+      for (size_t k = 0; k < heatSamples; k++) {
+        seedRandom(i, k, 0);
         Ray ray = camera.getRay(row, col);
-        color += trace(ray, 0);
+        PrimarySample g;
+        setThreadCost(&primaryCost);
+        accelerator->hit(ray, g.hit);
+        setThreadCost(&pathCost);
+        seedRandom(i, k, 1);
+        shadePrimary(ray, g);
+        sample(ray, nullptr, &g);
+        setThreadCost(nullptr);
+      }
+      nodes[0][i] = static_cast<float>(primaryCost.nodes) / heatSamples;
+      triangles[0][i] = static_cast<float>(primaryCost.triangles) / heatSamples;
+      nodes[1][i] = nodes[0][i] +
+                    static_cast<float>(pathCost.nodes) / heatSamples;
+      triangles[1][i] = triangles[0][i] +
+                        static_cast<float>(pathCost.triangles) / heatSamples;
+    }
+  }
+
+  bool ok = true;
+  const char *suffixes[2] = {"-primary", "-path"};
+  std::cout << "traversal heatmap" << '\n';
+  for (int s = 0; s < 2; s++) {
+    std::vector<float> rgb(n * 3, 0);
+    double nodeSum = 0, triangleSum = 0;
+    for (size_t i = 0; i < n; i++) {
+      rgb[i * 3] = nodes[s][i];
+      rgb[i * 3 + 1] = triangles[s][i];
+      nodeSum += nodes[s][i];
+      triangleSum += triangles[s][i];
+    }
+    HDRWriter writer;
+    std::string floatName = baseName + suffixes[s] + ".pfm";
+    bool written = writer.open(floatName, width, height) &&
+                   writer.writeTile(0, 0, width, height, rgb.data());
+    written = writer.close() && written;
+
+    // 少数极端像素不决定色标
+    std::vector<float> sorted = nodes[s];
+    size_t q = n > 0 ? (n - 1) * 99 / 100 : 0;
+    std::nth_element(sorted.begin(), sorted.begin() + q, sorted.end());
+    float scale = n > 0 && sorted[q] > 0 ? 1 / sorted[q] : 0;
+    cv::Mat img(height, width, CV_8UC3);
+    for (int row = 0; row < height; row++) {
+      unsigned char *bgr = img.ptr<unsigned char>(row);
+      for (int col = 0; col < width; col++) {
+        Vec3<float> c =
+            falseColor(nodes[s][static_cast<size_t>(row) * width + col] * scale);
+        bgr[3 * col] = static_cast<unsigned char>(c.z * 255);
+        bgr[3 * col + 1] = static_cast<unsigned char>(c.y * 255);
+        bgr[3 * col + 2] = static_cast<unsigned char>(c.x * 255);
+      }
+    }
+    std::string imageName = baseName + suffixes[s] + ".png";
+    written = cv::imwrite(imageName, img) && written;
+    if (!written) {
+      std::cout << "Heatmap writing fails: " << baseName + suffixes[s]
+                << std::endl;
+    }
+    ok = ok && written;
+    std::cout << suffixes[s] + 1 << " nodes per pixel: "
+              << (n > 0 ? nodeSum / n : 0) << " (99%: "
+              << (n > 0 ? sorted[q] : 0) << ")" << '\n'
+              << suffixes[s] + 1 << " triangles per pixel: "
+              << (n > 0 ? triangleSum / n : 0) << '\n';
+  }
+  std::cout << std::endl;
+  return ok;
+}
+
+// 两个首次击中点的几何是否相近，用于判断蓄水池能否复用
+static bool isSimilar(const HitResult &a, const HitResult &b) {
+  return a.isHit && b.isHit &&
+         Vec3<float>::dot(a.normal, b.normal) > 0.9f &&
+         fabs(a.distance - b.distance) < 0.1f * a.distance;
+}
+
+void Tracer::renderResampled(FrameBuffer &frame) {
+  int height = camera.getHeight(), width = camera.getWidth();
+  size_t n = static_cast<size_t>(width) * height;
+  std::vector<Ray> rays(n);
+  std::vector<PrimarySample> primaries(n), previous(n);
+  std::vector<Reservoir> reservoirs(n), history(n), spatial(n);
+  // 时间复用时限制历史蓄水池的候选数，避免过时样本权重过大
+  float historyCap = 20.0f * resampling.candidates;
+
+  for (size_t k = 0; k < samples; k++) {
+    SRE_PROFILE_SCOPE("pass", std::to_string(k));
+    // 1. 首次求交，按候选生成每个像素的初始蓄水池，再与上一遍合并
+#pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width; col++) {
+        size_t i = static_cast<size_t>(row) * width + col;
+        PrimarySample &g = primaries[i];
+        seedRandom(i, k, 0);
+        rays[i] = camera.getRay(row, col);
+        g.hit = HitResult();
+        accelerator->hit(rays[i], g.hit);
+        reservoirs[i] = Reservoir();
+        if (!g.hit.isHit || g.hit.material->isEmissive()) {
+          continue;
+        }
+
+        const Vec3<float> &p = g.hit.hitPoint, &N = g.hit.normal;
+        // 没有纹理的场景不求纹理坐标，核外几何时也就不必为此换入三角形所在的块
+        float coneWidth = camera.getSpreadAngle() * g.hit.distance;
+        g.diffusion = (features & SCENE_TEXTURED) != 0
+                          ? getDiffusion<SCENE_TEXTURED>(g.hit, rays[i],
+                                                         coneWidth)
+                          : getDiffusion<0>(g.hit, rays[i], coneWidth);
+        reservoirs[i] = sampleReservoir(p, N, g.diffusion);
+        if (resampling.temporalReuse && k > 0 &&
+            isSimilar(g.hit, previous[i].hit)) {
+          Reservoir prev = history[i];
+          prev.M = std::min(prev.M, historyCap);
+          combineReservoir(reservoirs[i], prev, p, N, g.diffusion);
+        }
+      }
+    }
+
+    // 2. 合并几何相近的随机邻居
+    if (resampling.spatialReuse) {
+      int radius = resampling.spatialRadius;
+#pragma omp parallel for schedule(dynamic)
+      for (int row = 0; row < height; row++) {
+        for (int col = 0; col < width; col++) {
+          size_t i = static_cast<size_t>(row) * width + col;
+          const PrimarySample &g = primaries[i];
+          spatial[i] = reservoirs[i];
+          if (!g.hit.isHit || g.hit.material->isEmissive()) {
+            continue;
+          }
+          seedRandom(i, k, 1);
+          for (size_t j = 0; j < resampling.spatialNeighbors; j++) {
+            int r = std::clamp(row + randInt(radius + 1, -radius), 0, height - 1);
+            int c = std::clamp(col + randInt(radius + 1, -radius), 0, width - 1);
+            size_t q = static_cast<size_t>(r) * width + c;
+            if (q == i || !isSimilar(g.hit, primaries[q].hit)) {
+              continue;
+            }
+            combineReservoir(spatial[i], reservoirs[q], g.hit.hitPoint,
+                             g.hit.normal, g.diffusion);
+          }
+        }
+      }
+      reservoirs.swap(spatial);
+    }
+
+    // 3. 着色：只为最终选中的光源样本发射一条阴影光线
+#pragma omp parallel for schedule(dynamic)
+    for (int row = 0; row < height; row++) {
+      for (int col = 0; col < width; col++) {
+        size_t i = static_cast<size_t>(row) * width + col;
+        PrimarySample &g = primaries[i];
+        Reservoir &r = reservoirs[i];
+        seedRandom(i, k, 2);
+        g.direct = Vec3<float>(0, 0, 0);
+        if (g.hit.isHit && !g.hit.material->isEmissive() && r.W > 0) {
+          g.direct = evalLight(g.hit.hitPoint, g.hit.normal, g.diffusion,
+                               r.sample, true) *
+                     r.W;
+          // 被遮挡的样本不再传给下一遍
+          if (g.direct == Vec3<float>(0, 0, 0)) {
+            r.W = 0;
+          }
+        }
+
+        AOVSample aov;
+        Vec3<float> color = sample(rays[i], &aov, &g);
+        frame.addSample(row, col, color, aov);
+      }
+    }
+
+    history.swap(reservoirs);
+    previous.swap(primaries);
+  }
+}
+
+Vec3<float> Tracer::sample(const Ray &ray, AOVSample *aov,
+                           const PrimarySample *primary) {
+  SRE_STAT(getThreadStats().primaryRays++);
+  assert(kernel != nullptr);
+  return (this->*kernel)(ray, aov, primary);
+}
+
+template <size_t... F>
+Tracer::Kernel Tracer::getKernel(unsigned mask, bool iterative,
+                                 std::index_sequence<F...>) {
+  static const Kernel recursiveKernels[] = {&Tracer::traceRecursive<F>...};
+  static const Kernel iterativeKernels[] = {&Tracer::traceIterative<F>...};
+  return iterative ? iterativeKernels[mask] : recursiveKernels[mask];
+}
+
+template <size_t... F>
+Tracer::PrimaryShader Tracer::getPrimaryShader(unsigned mask,
+                                               std::index_sequence<F...>) {
+  static const PrimaryShader shaders[] = {&Tracer::shadePrimary<F>...};
+  return shaders[mask];
+}
+
+void Tracer::selectKernel() {
+  unsigned mask = 0;
+  const std::vector<Material> *materials =
+      chunkedScene.isOpen() ? &chunkedScene.getMaterials() : nullptr;
+  size_t materialNum =
+      materials != nullptr ? materials->size() : mesh.getMaterialNum();
+  for (size_t i = 0; i < materialNum; i++) {
+    const Material &material =
+        materials != nullptr ? (*materials)[i] : mesh.getMaterial(i);
+    if (material.isTextured()) {
+      mask |= SCENE_TEXTURED;
+      break;
+    }
+  }
+  // 核外几何时不构建光子图
+  if (photonNum > 0 && photonMap.size() > 0) {
+    mask |= SCENE_PHOTON_MAP;
+  }
+  if (resampling.candidates > 0) {
+    mask |= SCENE_RESAMPLED;
+  }
+
+  Kernel selected = getKernel(mask, integrator.iterative,
+                              std::make_index_sequence<SCENE_FEATURE_NUM>());
+  if (selected != kernel) {
+    std::cout << "integrator kernel: "
+              << (integrator.iterative ? "iterative" : "recursive")
+              << ((mask & SCENE_TEXTURED) != 0 ? " textured" : "")
+              << ((mask & SCENE_PHOTON_MAP) != 0 ? " photon-map" : "")
+              << ((mask & SCENE_RESAMPLED) != 0 ? " resampled" : "")
+              << std::endl;
+  }
+  features = mask;
+  kernel = selected;
+  primaryShader = getPrimaryShader(
+      mask, std::make_index_sequence<SCENE_FEATURE_NUM>());
+}
+
+void Tracer::tuneIntegrator() {
+  // 在稀疏像素网格上试渲染各组参数，按 1 / (方差 * 时间) 选择效率最高的一组
+  const int grid = 32, pilotSamples = 8;
+  const size_t rrDepths[] = {1, 2, 3};
+  const float splitFactors[] = {1, 2, 4, 8};
+  int height = camera.getHeight(), width = camera.getWidth();
+
+  IntegratorConfig best = integrator;
+  double bestEfficiency = -1;
+  for (size_t rrDepth : rrDepths) {
+    for (float splitFactor : splitFactors) {
+      integrator.rrDepth = rrDepth;
+      integrator.splitFactor = splitFactor;
+
+      auto start = std::chrono::steady_clock::now();
+      double variance = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : variance)
+      for (int k = 0; k < grid * grid; k++) {
+        int row = (k / grid * 2 + 1) * height / (grid * 2);
+        int col = (k % grid * 2 + 1) * width / (grid * 2);
+        double mean = 0, m2 = 0;
+        for (int n = 1; n <= pilotSamples; n++) {
+          double lum = luminance(sample(camera.getRay(row, col), nullptr));
+          double delta = lum - mean;
+          mean += delta / n;
+          m2 += delta * (lum - mean);
+        }
+        variance += m2 / (pilotSamples - 1);
+      }
+      double time = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+      double efficiency = 1 / (variance / (grid * grid) * time + 1e-12);
+      if (efficiency > bestEfficiency) {
+        bestEfficiency = efficiency;
+        best = integrator;
       }
-      color /= samples;
-      // gama correction
-      img.at<cv::Vec3b>(row, col)[0] = std::min(255., 255 * pow(color.z, 0.6));
-      img.at<cv::Vec3b>(row, col)[1] = std::min(255., 255 * pow(color.y, 0.6));
-      img.at<cv::Vec3b>(row, col)[2] = std::min(255., 255 * pow(color.x, 0.6));
     }
   }
 
-  return img;
+  integrator = best;
+  std::cout << "auto tuned integrator" << '\n'
+            << "roulette depth: " << integrator.rrDepth << '\n'
+            << "split factor: " << integrator.splitFactor << '\n';
+  std::cout << std::endl;
+}
+
+uint64_t Tracer::getSourceHash() {
+  // 场景缓存、分块文件和检查点都用它判断源文件是否改动
+  if (!sourceHashed) {
+    sourceHash =
+        SceneCache::hashSources(sourcePath, sourceModels, sourceConfig);
+    sourceHashed = true;
+  }
+  return sourceHash;
+}
+
+uint64_t Tracer::getConfigHash() {
+  // 自动调整的积分器参数取决于计时，调整结果不同时检查点也会被丢弃
+  // 源文件哈希覆盖几何、材质、纹理路径、光源亮度和XML中的相机
+  uint64_t h = 14695981039346656037ull;
+  auto add = [&h](uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+  auto addFloat = [&add](float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    add(bits);
+  };
+  add(getSourceHash());
+  add(mesh.getTriangleNum());
+  add(chunkedScene.getTriangleNum());
+  add(mesh.getMaterialNum());
+  add(maxDepth);
+  addFloat(thresholdP);
+  add(integrator.iterative);
+  add(integrator.rrDepth);
+  add(integrator.splitDepth);
+  addFloat(integrator.splitFactor);
+  add(integrator.maxSplit);
+  add(photonNum);
+  add(gatherDepth);
+  addFloat(photonRadius);
+  add(light.getSolidAngleSampling());
+  add(compressBVH);
+  // 相机的位置、朝向和视角，分辨率已在检查点文件头中比较
+  Vec3<float> eye = camera.getEye(), lookat = camera.getLookAt(),
+              up = camera.getUp();
+  for (float v : {eye.x, eye.y, eye.z, lookat.x, lookat.y, lookat.z, up.x,
+                  up.y, up.z, camera.getFovy()}) {
+    addFloat(v);
+  }
+  return h;
+}
+
+template <unsigned F>
+Vec3<float> Tracer::sampleDirect(const Vec3<float> &p, const Vec3<float> &N,
+                                  const Vec3<float> &diffusion) const {
+  // 直接光照 —— 节省路径（自己打过去）
+  if constexpr ((F & SCENE_RESAMPLED) != 0) {
+    // 重采样：多个候选中只为最终选中的样本发射阴影光线
+    Reservoir r = sampleReservoir(p, N, diffusion);
+    if (r.W <= 0) {
+      return Vec3<float>(0, 0, 0);
+    }
+    return evalLight(p, N, diffusion, r.sample, true) * r.W;
+  } else {
+    LightSample s;
+    light.sample(p, s);
+    if (s.pdf <= 0) {
+      return Vec3<float>(0, 0, 0);
+    }
+    return evalLight(p, N, diffusion, s, true) / s.pdf;
+  }
+}
+
+Vec3<float> Tracer::evalLight(const Vec3<float> &p, const Vec3<float> &N,
+                              const Vec3<float> &diffusion,
+                              const LightSample &s, bool shadow) const {
+  Vec3<float> d = s.position - p;
+  float dis = std::max(d.length(), EPSILON);
+  Vec3<float> ws_dir = d / dis;  // 击中点到光源的方向
+
+  float cosine1 = std::max(Vec3<float>::dot(N, ws_dir), 0.0f);
+  float cosine2 = std::max(Vec3<float>::dot(s.normal, -ws_dir), 0.0f);
+  if (cosine1 <= 0 || cosine2 <= 0) {
+    return Vec3<float>(0, 0, 0);
+  }
+
+  if (shadow) {
+    // 检查是否有障碍：光线停在光源采样点之前，区间内有交点即被遮挡
+    Ray ws = shadowRay(p + N * EPSILON, s.position);
+    HitResult nres;
+    SRE_STAT(getThreadStats().shadowRays++);
+    accelerator->hit(ws, nres);
+    if (nres.isHit) {
+      return Vec3<float>(0, 0, 0);
+    }
+  }
+  // albedo = diffuse/pi
+  return s.radiance * (diffusion / PI) * cosine1 * cosine2 / (dis * dis);
+}
+
+Reservoir Tracer::sampleReservoir(const Vec3<float> &p, const Vec3<float> &N,
+                                  const Vec3<float> &diffusion) const {
+  // 目标函数取不考虑遮挡的贡献亮度，候选权重 = 目标函数 / 源pdf
+  Reservoir r;
+  float pHat = 0;
+  for (size_t k = 0; k < resampling.candidates; k++) {
+    LightSample s;
+    light.sample(p, s);
+    float target = luminance(evalLight(p, N, diffusion, s, false));
+    if (r.update(s, s.pdf > 0 ? target / s.pdf : 0)) {
+      pHat = target;
+    }
+  }
+  r.finalize(pHat);
+  return r;
 }
 
-Vec3<float> Tracer::trace(const Ray &wi, size_t depth) {
-  assert(scenes != nullptr);
+void Tracer::combineReservoir(Reservoir &dst, const Reservoir &src,
+                              const Vec3<float> &p, const Vec3<float> &N,
+                              const Vec3<float> &diffusion) const {
+  // 两个蓄水池的样本都在当前着色点重新计算目标函数
+  Reservoir r;
+  float pDst = dst.M > 0
+                   ? luminance(evalLight(p, N, diffusion, dst.sample, false))
+                   : 0;
+  float pSrc = src.M > 0
+                   ? luminance(evalLight(p, N, diffusion, src.sample, false))
+                   : 0;
+  float pHat = pDst;
+  r.update(dst.sample, pDst * dst.W * dst.M, dst.M);
+  if (r.update(src.sample, pSrc * src.W * src.M, src.M)) {
+    pHat = pSrc;
+  }
+  r.finalize(pHat);
+  dst = r;
+}
+
+Vec2<float> Tracer::getTexCoord(const HitResult &res) const {
+  if (chunkedScene.isOpen()) {
+    return chunkedScene.getTexCoord(res.id, res.hitPoint);
+  }
+  assert(res.id >= 0 && static_cast<size_t>(res.id) < objects.size());
+  return objects[res.id]->getTexCoord(res.hitPoint);
+}
+
+float Tracer::getTexelScale(const HitResult &res) const {
+  if (chunkedScene.isOpen()) {
+    return chunkedScene.getTexelScale(res.id);
+  }
+  assert(res.id >= 0 && static_cast<size_t>(res.id) < objects.size());
+  return objects[res.id]->getTexelScale();
+}
+
+float Tracer::getFootprint(const HitResult &res, const Ray &ray,
+                           float coneWidth) const {
+  // 光锥斜着落在表面上时投影变宽，限制余弦避免掠射时过度模糊
+  float cosine = fabs(Vec3<float>::dot(res.normal, ray.getDirection()));
+  return coneWidth * getTexelScale(res) /
+         std::max(cosine, 0.1f);
+}
+
+template <unsigned F>
+Vec3<float> Tracer::getDiffusion(const HitResult &res, const Ray &ray,
+                                 float coneWidth) const {
+  // 没有纹理的场景不必求纹理坐标和光锥的投影宽度
+  if constexpr ((F & SCENE_TEXTURED) != 0) {
+    return res.material->getDiffusion(getTexCoord(res),
+                                      getFootprint(res, ray, coneWidth));
+  } else {
+    return res.material->getDiffusion();
+  }
+}
+
+template <unsigned F>
+Vec3<float> Tracer::traceRecursive(const Ray &ray, AOVSample *aov,
+                                   const PrimarySample *primary) {
+  return trace<F>(ray, 0, aov, primary);
+}
+
+template <unsigned F>
+Vec3<float> Tracer::trace(const Ray &wi, size_t depth, AOVSample *aov,
+                          const PrimarySample *primary, float coneWidth) {
+  assert(accelerator != nullptr);
   if (depth >= maxDepth) {
+    SRE_STAT(getThreadStats().addPath(depth));
     return Vec3<float>(0, 0, 0);
   }
 
   HitResult res;
-  scenes->hit(wi, res);
+  if (primary != nullptr) {
+    res = primary->hit;
+  } else {
+    SRE_STAT(if (depth > 0) getThreadStats().bounceRays++);
+    accelerator->hit(wi, res);
+  }
   if (!res.isHit) {
+    SRE_STAT(getThreadStats().addPath(depth));
     return Vec3<float>(0, 0, 0);
   }
-  assert(res.id >= 0 && res.id < objects.size());
+  // 路径是否继续到下一个击中点，没有继续时在这里结束
+  SRE_STAT(bool extended = false);
+  assert(res.id >= 0);
 
   // 直接光照 & 间接光照
   Vec3<float> L_d(0, 0, 0), L_ind(0, 0, 0);
@@ -344,73 +1338,221 @@ Vec3<float> Tracer::trace(const Ray &wi, size_t depth) {
   Vec3<float> p = res.hitPoint; // 击中点
   Vec3<float> N = res.normal;   // 击中点法向量
 
-  // 击中点材料信息
-  Vec2<float> texCoord = objects[res.id]->getTexCoord(res.hitPoint);
-  Vec3<float> diffusion = res.material.getDiffusion(texCoord);
-  Vec3<float> specularity = res.material.getSpecularity(texCoord);
-  Vec3<float> transmittance = res.material.getTransmittance();
-
-  if (!res.material.isEmissive()) {
-    // 直接光照 —— 节省路径（自己打过去）
-    size_t id = -1;
-    float area = 0; // 光源面积
-    Vec3<float> x;  // 光源采样点
-    Vec3<float> radiance; // 光源辐射
-    light.getRandomPoint(id, x, radiance, area);
-    float pdf_l = 1 / area;
-
-    // 检查是否有障碍
-    Ray ws(p + N * EPSILON, x - p);             // 击中点到光源采样点的光线
-    HitResult nres;
-    scenes->hit(ws, nres);
-    if (nres.isHit && nres.id == id) {
-      Vec3<float> NN = nres.normal; // 光源法向量
-      Vec3<float> ws_dir = ws.getDirection();   // 击中点到光源的方向
+  // 击中点材料信息，光锥按像素张角随距离展开
+  coneWidth += camera.getSpreadAngle() * res.distance;
+  Vec3<float> diffusion = getDiffusion<F>(res, wi, coneWidth);
 
-      float cosine1 = std::max(Vec3<float>::dot(N, ws_dir), 0.0f);
-      float cosine2 = std::max(Vec3<float>::dot(NN, -ws_dir), 0.0f);
-      float dis = std::max(nres.distance, EPSILON);
-      // albedo = diffuse/pi
-      L_d = radiance * (diffusion / PI) * cosine1 * cosine2 / (dis * dis * pdf_l);
-    }
+  if (aov != nullptr) {
+    aov->albedo = diffusion;
+    aov->normal = N;
+    aov->depth = res.distance;
+  }
+
+  if (!res.material->isEmissive()) {
+    L_d = primary != nullptr ? primary->direct
+                             : sampleDirect<F>(p, N, diffusion);
   }
   
   // 间接光照（只考虑漫反射）
-  float possibility = randFloat(1);
-  static float pdf = 1 / (2 * PI);
-  // 俄罗斯轮盘
-  if (possibility < thresholdP) {
-    Vec3<float> ws_dir = diffuseDir(wi.getDirection(), N);
-    Ray ws(p, ws_dir);
-    HitResult nres;
-    scenes->hit(ws, nres);
-    
-    if (nres.isHit && !nres.material.isEmissive()) {
-      Vec3<float> radiance = trace(ws, depth + 1);
-      float cosine = std::max(Vec3<float>::dot(N, ws_dir), 0.0f);
-      L_ind = radiance * (diffusion / PI) * cosine / (pdf * thresholdP);
+  if ((F & SCENE_PHOTON_MAP) != 0 && depth >= gatherDepth) {
+    // 光子图中只有间接光，直接做密度估计，不再递归
+    L_ind = photonMap.getIrradiance(p, N) * (diffusion / PI);
+  } else {
+    float possibility = randFloat(1);
+    static float pdf = 1 / (2 * PI);
+    // 俄罗斯轮盘
+    if (possibility < thresholdP) {
+      Vec3<float> ws_dir = diffuseDir(wi.getDirection(), N);
+      Ray ws(p, ws_dir);
+      HitResult nres;
+      SRE_STAT(getThreadStats().bounceRays++);
+      accelerator->hit(ws, nres);
+      
+      if (nres.isHit && !nres.material->isEmissive()) {
+        SRE_STAT(extended = true);
+        Vec3<float> radiance =
+            trace<F>(ws, depth + 1, nullptr, nullptr, coneWidth);
+        float cosine = std::max(Vec3<float>::dot(N, ws_dir), 0.0f);
+        L_ind = radiance * (diffusion / PI) * cosine / (pdf * thresholdP);
+      }
+    } else {
+      SRE_STAT(getThreadStats().rouletteTerminations++);
     }
   }
+  SRE_STAT(if (!extended) getThreadStats().addPath(depth + 1));
 
   // 返回结果为：直接光+间接光
   // 需要避免直接检测是不是光源，然后直接返回光源的辐射，这样会导致光源融入天花板
-  return res.material.getEmission() + L_d + L_ind;
+  return res.material->getEmission() + L_d + L_ind;
+}
+
+template <unsigned F>
+Vec3<float> Tracer::traceIterative(const Ray &ray, AOVSample *aov,
+                                   const PrimarySample *primary) {
+  assert(accelerator != nullptr);
+
+  // 待处理的路径分支：光线、吞吐量、深度、起点处的光锥宽度
+  struct PathState {
+    Ray ray;
+    Vec3<float> throughput;
+    size_t depth;
+    float coneWidth;
+  };
+  std::vector<PathState> stack;
+  stack.push_back({ray, Vec3<float>(1, 1, 1), 0, 0});
+
+  Vec3<float> L(0, 0, 0);
+  while (!stack.empty()) {
+    PathState state = stack.back();
+    stack.pop_back();
+
+    // 这一分支击中的表面数
+    SRE_STAT(size_t length = state.depth);
+    while (state.depth < MAX_PATH_DEPTH) {
+      HitResult res;
+      bool first = state.depth == 0 && primary != nullptr;
+      if (first) {
+        res = primary->hit;
+      } else {
+        SRE_STAT(if (state.depth > 0) getThreadStats().bounceRays++);
+        accelerator->hit(state.ray, res);
+      }
+      if (!res.isHit) {
+        break;
+      }
+      SRE_STAT(length = state.depth + 1);
+      assert(res.id >= 0);
+
+      Vec3<float> p = res.hitPoint;
+      Vec3<float> N = res.normal;
+      float coneWidth =
+          state.coneWidth + camera.getSpreadAngle() * res.distance;
+      Vec3<float> diffusion = getDiffusion<F>(res, state.ray, coneWidth);
+
+      if (state.depth == 0 && aov != nullptr) {
+        aov->albedo = diffusion;
+        aov->normal = N;
+        aov->depth = res.distance;
+      }
+
+      // 光源的贡献只在首次击中时计入，之后由直接光照负责
+      if (res.material->isEmissive()) {
+        if (state.depth == 0) {
+          L += state.throughput * res.material->getEmission();
+        }
+        break;
+      }
+
+      L += state.throughput *
+           (first ? primary->direct : sampleDirect<F>(p, N, diffusion));
+
+      if ((F & SCENE_PHOTON_MAP) != 0 && state.depth >= gatherDepth) {
+        L += state.throughput * photonMap.getIrradiance(p, N) *
+             (diffusion / PI);
+        break;
+      }
+
+      // 余弦采样下漫反射的权重就是反照率
+      Vec3<float> throughput = state.throughput * diffusion;
+      float contribution =
+          std::max(throughput.x, std::max(throughput.y, throughput.z));
+      if (contribution <= 0) {
+        break;
+      }
+
+      // 按吞吐量做俄罗斯轮盘：贡献越小越容易被终止
+      if (state.depth + 1 >= integrator.rrDepth) {
+        float q = std::min(contribution, 0.95f);
+        if (randFloat(1) >= q) {
+          SRE_STAT(getThreadStats().rouletteTerminations++);
+          break;
+        }
+        throughput /= q;
+        contribution /= q;
+      }
+
+      // 前几次反弹按吞吐量分裂，额外的分支压栈稍后处理
+      size_t split = 1;
+      if (state.depth < integrator.splitDepth) {
+        split = static_cast<size_t>(integrator.splitFactor * contribution + 0.5f);
+        split = std::max<size_t>(1, std::min(split, integrator.maxSplit));
+      }
+      throughput /= static_cast<float>(split);
+      for (size_t k = 1; k < split; k++) {
+        stack.push_back(
+            {Ray(p, cosineDir(N)), throughput, state.depth + 1, coneWidth});
+      }
+
+      state.ray = Ray(p, cosineDir(N));
+      state.throughput = throughput;
+      state.depth += 1;
+      state.coneWidth = coneWidth;
+    }
+    SRE_STAT(getThreadStats().addPath(length));
+  }
+  return L;
 }
 
 void Tracer::printStatus() {
   // configuration
   std::cout << "sample number: " << samples << '\n'
             << "tracing depth: " << maxDepth << '\n'
-            << "threshod probability: " << thresholdP << '\n';
+            << "threshod probability: " << thresholdP << '\n'
+            << "denoise: " << (denoise ? "on" : "off") << '\n'
+            << "photon number: " << photonNum << '\n'
+            << "photon gather depth: " << gatherDepth << '\n'
+            << "integrator: " << (integrator.iterative ? "iterative" : "recursive")
+            << '\n';
+  if (resampling.candidates > 0) {
+    std::cout << "light candidates: " << resampling.candidates << '\n'
+              << "temporal reuse: " << (resampling.temporalReuse ? "on" : "off")
+              << '\n'
+              << "spatial reuse: " << (resampling.spatialReuse ? "on" : "off")
+              << '\n';
+  }
+  if (integrator.iterative) {
+    std::cout << "roulette depth: " << integrator.rrDepth << '\n'
+              << "split depth: " << integrator.splitDepth << '\n'
+              << "split factor: "
+              << (integrator.autoTune ? "auto" : std::to_string(integrator.splitFactor))
+              << '\n';
+  }
   camera.printStatus();
+  if (denoise) {
+    denoiser.printStatus();
+  }
   // light
   light.printStatus();
   // shapes
   std::cout << "shapes" << '\n'
             << "triange number: "
-            << (scenes == nullptr ? 0 : scenes->getNodeNum()) << '\n';
+            << (chunkedScene.isOpen() ? chunkedScene.getTriangleNum()
+                                      : objects.size())
+            << '\n';
+  std::cout << std::endl;
+  mesh.printStatus();
   // scenes
-  // scenes->getAABB().printStatus();
-  // scenes->printStatus();
+  if (scenes != nullptr) {
+    scenes->printStatus();
+    bvhReport.printStatus();
+    size_t bytes = mesh.getMemorySize() +
+                   scenes->getNodeNum() * sizeof(LinearBVHNode) +
+                   (compressedScenes != nullptr
+                        ? compressedScenes->getMemorySize()
+                        : 0) +
+                   scenes->getPrimitives().size() * sizeof(Hittable *) +
+                   objects.size() * sizeof(Hittable *);
+    if (compressedScenes != nullptr) {
+      compressedScenes->printStatus();
+    }
+    std::cout << "scene memory: " << bytes / 1024 << "KB" << '\n';
+    std::cout << std::endl;
+  }
+  if (sceneCache.isOpen()) {
+    sceneCache.printStatus();
+  }
+  if (chunkedScene.isOpen()) {
+    chunkedScene.printStatus();
+  }
 }
 }  // namespace sre
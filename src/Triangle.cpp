@@ -1,45 +1,21 @@
 #include "../include/Triangle.hpp"
 
+#include <algorithm>
 #include <cassert>
 
+#include "../include/Mesh.hpp"
+
 namespace sre {
 
-Triangle::Triangle(size_t id, const Vec3<float>& _v1, const Vec3<float>& _v2,
-                   const Vec3<float>& _v3, const Material& _m)
-    : Hittable(id),
-      v1(_v1),
-      v2(_v2),
-      v3(_v3),
-      normal(Vec3<float>::normalize(Vec3<float>::cross(_v2 - _v1, _v3 - _v1))),
-      material(_m) {}
-
-Triangle::Triangle(size_t id, const Vec3<float>& _v1, const Vec3<float>& _v2,
-                   const Vec3<float>& _v3, const Vec3<float>& _n,
-                   const Material& _m)
-    : Hittable(id),
-      v1(_v1),
-      v2(_v2),
-      v3(_v3),
-      normal(Vec3<float>::normalize(_n)),
-      material(_m) {}
-
-Triangle::Triangle(size_t id, const Vec3<float>& _v1, const Vec3<float>& _v2,
-                   const Vec3<float>& _v3, const Vec2<float>& _vt1,
-                   const Vec2<float>& _vt2, const Vec2<float>& _vt3,
-                   const Vec3<float>& _n, const Material& _m)
-    : Hittable(id),
-      v1(_v1),
-      v2(_v2),
-      v3(_v3),
-      vt1(_vt1),
-      vt2(_vt2),
-      vt3(_vt3),
-      normal(Vec3<float>::normalize(_n)),
-      material(_m) {}
+Triangle::Triangle(size_t id, const Mesh* _mesh) : Hittable(id), mesh(_mesh) {}
 
 Triangle::~Triangle() {}
 
 Vec3<float> Triangle::getMinXYZ() const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
   Vec3<float> minXYZ;
   minXYZ.x = std::min(v1.x, std::min(v2.x, v3.x));
   minXYZ.y = std::min(v1.y, std::min(v2.y, v3.y));
@@ -48,6 +24,10 @@ Vec3<float> Triangle::getMinXYZ() const {
 }
 
 Vec3<float> Triangle::getMaxXYZ() const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
   Vec3<float> maxXYZ;
   maxXYZ.x = std::max(v1.x, std::max(v2.x, v3.x));
   maxXYZ.y = std::max(v1.y, std::max(v2.y, v3.y));
@@ -56,12 +36,104 @@ Vec3<float> Triangle::getMaxXYZ() const {
 }
 
 Vec3<float> Triangle::getRandomPoint() const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
   Vec3<float> e1 = v2 - v1, e2 = v3 - v2;
-  float a = sqrt(randFloat(1)), b = randFloat(1);
+  float a = std::sqrt(randFloat(1)), b = randFloat(1);
   return e1 * a + e2 * a * b + v1;
 }
 
+// 两个单位向量的夹角，比acos(dot)在接近0和PI时更精确
+static float angleBetween(const Vec3<float>& a, const Vec3<float>& b) {
+  if (Vec3<float>::dot(a, b) < 0) {
+    return PI - 2 * asin(std::min(1.0f, (a + b).length() / 2));
+  }
+  return 2 * asin(std::min(1.0f, (b - a).length() / 2));
+}
+
+// 去掉v在单位向量w上的分量
+static Vec3<float> gramSchmidt(const Vec3<float>& v, const Vec3<float>& w) {
+  return v - w * Vec3<float>::dot(v, w);
+}
+
+bool Triangle::getRandomPoint(const Vec3<float>& p, Vec3<float>& point,
+                              float& pdf) const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
+  const Vec3<float>& normal = mesh->getNormal(index.n);
+  // Arvo, Stratified Sampling of Spherical Triangles, 1995
+  Vec3<float> a = v1 - p, b = v2 - p, c = v3 - p;
+  if (a.length() == 0 || b.length() == 0 || c.length() == 0) {
+    return false;
+  }
+  a.normalize();
+  b.normalize();
+  c.normalize();
+
+  Vec3<float> nab = Vec3<float>::cross(a, b), nbc = Vec3<float>::cross(b, c),
+              nca = Vec3<float>::cross(c, a);
+  if (nab.length() == 0 || nbc.length() == 0 || nca.length() == 0) {
+    return false;
+  }
+  nab.normalize();
+  nbc.normalize();
+  nca.normalize();
+
+  // 球面三角形三个内角，立体角 = 内角和 - PI
+  float alpha = angleBetween(nab, -nca);
+  float beta = angleBetween(nbc, -nab);
+  float gamma = angleBetween(nca, -nbc);
+  float area = alpha + beta + gamma - PI;
+  if (area < 3e-4f || area > 6.22f) {
+    return false;
+  }
+
+  // 按面积均匀选取子三角形，求出其顶点c'
+  float u0 = randFloat(1), u1 = randFloat(1);
+  float subArea = PI + u0 * area;
+  float cosAlpha = cos(alpha), sinAlpha = sin(alpha);
+  float sinPhi = sin(subArea) * cosAlpha - cos(subArea) * sinAlpha;
+  float cosPhi = cos(subArea) * cosAlpha + sin(subArea) * sinAlpha;
+  float k1 = cosPhi + cosAlpha;
+  float k2 = sinPhi - sinAlpha * Vec3<float>::dot(a, b);
+  float cosB = (k2 + (k2 * cosPhi - k1 * sinPhi) * cosAlpha) /
+               ((k2 * sinPhi + k1 * cosPhi) * sinAlpha);
+  cosB = std::clamp(cosB, -1.0f, 1.0f);
+  float sinB = std::sqrt(std::max(0.0f, 1 - cosB * cosB));
+  Vec3<float> cp = a * cosB + Vec3<float>::normalize(gramSchmidt(c, a)) * sinB;
+
+  // 在b和c'之间的弧上采样方向
+  float cosTheta = 1 - u1 * (1 - Vec3<float>::dot(cp, b));
+  float sinTheta = std::sqrt(std::max(0.0f, 1 - cosTheta * cosTheta));
+  Vec3<float> w =
+      b * cosTheta + Vec3<float>::normalize(gramSchmidt(cp, b)) * sinTheta;
+
+  // 方向与三角形所在平面求交得到采样点
+  float denom = Vec3<float>::dot(normal, w);
+  if (denom == 0) {
+    return false;
+  }
+  float t = Vec3<float>::dot(normal, v1 - p) / denom;
+  if (t <= 0) {
+    return false;
+  }
+  point = p + w * t;
+  pdf = 1 / area;
+  return true;
+}
+
 Vec2<float> Triangle::getTexCoord(const Vec3<float>& coord) const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
+  const Vec2<float>& vt1 = mesh->getTexCoord(index.vt[0]);
+  const Vec2<float>& vt2 = mesh->getTexCoord(index.vt[1]);
+  const Vec2<float>& vt3 = mesh->getTexCoord(index.vt[2]);
   Vec3<float> e1 = v2 - v1, e2 = v3 - v1;
   Vec3<float> e = coord - v1;
   float a, b;
@@ -97,32 +169,54 @@ Vec2<float> Triangle::getTexCoord(const Vec3<float>& coord) const {
   return texCoord;
 }
 
-Material Triangle::getMaterial() const { return material; }
+float Triangle::getTexelScale() const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec2<float>& vt1 = mesh->getTexCoord(index.vt[0]);
+  const Vec2<float>& vt2 = mesh->getTexCoord(index.vt[1]);
+  const Vec2<float>& vt3 = mesh->getTexCoord(index.vt[2]);
+  Vec2<float> d1 = vt2 - vt1, d2 = vt3 - vt1;
+  float uvArea = fabs(d1.u * d2.v - d1.v * d2.u) / 2;
+  float area = getSize();
+  return area > 0 ? std::sqrt(uvArea / area) : 0;
+}
+
+Vec3<float> Triangle::getNormal() const {
+  return mesh->getNormal(mesh->getIndex(getId()).n);
+}
+
+const Material& Triangle::getMaterial() const {
+  return mesh->getMaterial(mesh->getIndex(getId()).materialId);
+}
 
 float Triangle::getSize() const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
   return Vec3<float>::cross(v2 - v1, v3 - v1).length() / 2;
 }
 
 void Triangle::hit(const Ray& ray, HitResult& res) const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
+  const Vec3<float>& normal = mesh->getNormal(index.n);
   Vec3<float> origin = ray.getOrigin();
   Vec3<float> direction = ray.getDirection();
+  float cosine = Vec3<float>::dot(normal, direction);
 
-  if (Vec3<float>::dot(normal, direction) > 0) {
-    res.isHit = false;
-    res.id = this->getId();
-    return;
-  }
-
-  if (Vec3<float>::dot(normal, direction) == 0) {
+  // 背面或与平面平行
+  if (!(cosine < 0)) {
     res.isHit = false;
     res.id = this->getId();
     res.normal = normal;
     return;
   }
 
-  float t = (Vec3<float>::dot(normal, v1) - Vec3<float>::dot(normal, origin)) /
-            Vec3<float>::dot(normal, direction);
-  if (t < 0.1) {
+  float t = Vec3<float>::dot(normal, v1 - origin) / cosine;
+  // 区间外（包括比已找到的交点更远）的交点不再做重心判断
+  if (!(t >= ray.getTMin() && t <= ray.getTMax())) {
     res.isHit = false;
     res.id = this->getId();
     res.normal = normal;
@@ -143,8 +237,9 @@ void Triangle::hit(const Ray& ray, HitResult& res) const {
   float c5 = Vec3<float>::dot(e1, e2);
   // c1 = x * c3 + y * c5
   // c2 = x * c5 + y * c4
-  float x = (c1 * c4 - c2 * c5) / (c3 * c4 - c5 * c5);
-  float y = (c1 * c5 - c2 * c3) / (c5 * c5 - c3 * c4);
+  float inv = 1.0f / (c3 * c4 - c5 * c5);
+  float x = (c1 * c4 - c2 * c5) * inv;
+  float y = (c2 * c3 - c1 * c5) * inv;
 
   if (x < 0 || y < 0 || x + y > 1) {
     res.isHit = false;
@@ -159,14 +254,22 @@ void Triangle::hit(const Ray& ray, HitResult& res) const {
   res.hitPoint = p;
   res.distance = t;
   res.normal = normal;
-  res.material = material;
+  res.material = &mesh->getMaterial(index.materialId);
   return;
 }
 
 void Triangle::printStatus() const {
+  const TriangleIndex& index = mesh->getIndex(getId());
+  const Vec3<float>& v1 = mesh->getPosition(index.v[0]);
+  const Vec3<float>& v2 = mesh->getPosition(index.v[1]);
+  const Vec3<float>& v3 = mesh->getPosition(index.v[2]);
+  const Vec2<float>& vt1 = mesh->getTexCoord(index.vt[0]);
+  const Vec2<float>& vt2 = mesh->getTexCoord(index.vt[1]);
+  const Vec2<float>& vt3 = mesh->getTexCoord(index.vt[2]);
+  const Vec3<float>& normal = mesh->getNormal(index.n);
   std::cout << "triangle: \n"
             << "id: " << this->getId() << '\n'
-            << "material: " << material.getName() << '\n'
+            << "material: " << getMaterial().getName() << '\n'
             << "vertex 1: " << v1.x << '\t' << v1.y << '\t' << v1.z << '\n'
             << "vertex 2: " << v2.x << '\t' << v2.y << '\t' << v2.z << '\n'
             << "vertex 3: " << v3.x << '\t' << v3.y << '\t' << v3.z << '\n'
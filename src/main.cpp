@@ -2,27 +2,52 @@
 #include <ctime>
 #include <iostream>
 
+#include "../include/Profiler.hpp"
+#include "../include/Random.hpp"
+#include "../include/ToneMapper.hpp"
 #include "../include/Trace.hpp"
 
 using namespace cv;
 using namespace sre;
 
 int main() {
-  srand(time(nullptr));
+  setRandomSeed(time(nullptr));
   char windName[] = "simple render engine";
   int depth = 4;
   int spp = 128;
   float threshold = 0.8;
   Tracer tracer(depth, spp, threshold);
+  // 低SPP配合降噪，例如 spp = 16
+  // tracer.setDenoise(true);
+  // 缓存解析好的场景和BVH，下次启动直接映射
+  // tracer.setSceneCache("cornell-box.sre-cache");
+  // 大场景可以改用量化的4叉BVH减少节点内存
+  // tracer.setCompressedBVH(true);
+  // 内存放不下的场景分块写入文件，渲染时按需映射，常驻部分不超过预算
+  // 分块文件写出时要完整加载整个场景，内存不够时先在别的机器上用sre_chunk生成
+  // tracer.setOutOfCore("cornell-box.sre-chunks", 512 << 20);
+  // 长时间渲染时定期保存检查点，中断后用相同的种子重新运行即可继续
+  // setRandomSeed(1);
+  // tracer.setCheckpoint("cornell-box.sre-ckpt", 300);
 
   tracer.load("../example/cornell-box/", {"cornell-box.obj"}, "cornell-box.xml");
   // tracer.load("../example/simple cornell-box/", {"floor.obj", "light.obj", "left.obj", "right.obj", "shortbox.obj", "tallbox.obj"}, "cornell-box.xml");
 
+  // 超大分辨率时按块渲染并直接写入HDR文件，再单独做色调映射
+  // tracer.render(std::string("out.exr"));
+  // ToneMapper().apply("out.exr", "out.ppm");
+  // 输出每个像素的BVH遍历开销，查看哪些物体求交最贵
+  // tracer.renderHeatmap("heatmap", 4);
+  // 导出BVH质量诊断（SAH代价、深度与叶大小分布、重叠率等）
+  // tracer.getBVHReport().write("bvh.json");
+
   // render
   time_t start = time(0);
   auto img = tracer.render();
   time_t end = time(0);
   std::cout << "Rendering time: " << difftime(end, start) << "s" << std::endl;
+  // 以-DSRE_PROFILE=ON编译时写出计时区间，用chrome://tracing或Perfetto打开
+  // Profiler::getInstance().write("trace.json");
 
   // show result
   namedWindow(windName, 0);
@@ -2,18 +2,29 @@
 #include <vector>
 
 #include "../include/Camera.hpp"
-#include "../include/Triangle.hpp"
+#include "../include/Mesh.hpp"
 
 int main() {
-  std::vector<sre::Triangle> triangles;
+  sre::Mesh mesh;
   sre::Material m;
   // m.setEmission(Vec3<float>(255, 255, 255));
-  triangles.emplace_back(sre::Triangle(
-      0, sre::Vec3<float>(-10, 40, 30), sre::Vec3<float>(-10, 40, 10),
-      sre::Vec3<float>(10, 40, 10), sre::Vec3<float>(0, -1, 0), m));
-  triangles.emplace_back(sre::Triangle(
-      1, sre::Vec3<float>(-10, 40, 30), sre::Vec3<float>(10, 40, 30),
-      sre::Vec3<float>(10, 40, 10), sre::Vec3<float>(0, -1, 0), m));
+  uint32_t materialId = mesh.addMaterial(m);
+  uint32_t normalId = mesh.addNormal(sre::Vec3<float>(0, -1, 0));
+  uint32_t texcoordId = mesh.addTexCoord(sre::Vec2<float>(0, 0));
+  uint32_t a = mesh.addPosition(sre::Vec3<float>(-10, 40, 30));
+  uint32_t b = mesh.addPosition(sre::Vec3<float>(-10, 40, 10));
+  uint32_t c = mesh.addPosition(sre::Vec3<float>(10, 40, 10));
+  uint32_t d = mesh.addPosition(sre::Vec3<float>(10, 40, 30));
+  mesh.addTriangle({{a, b, c},
+                    {texcoordId, texcoordId, texcoordId},
+                    normalId,
+                    materialId});
+  mesh.addTriangle({{a, d, c},
+                    {texcoordId, texcoordId, texcoordId},
+                    normalId,
+                    materialId});
+  mesh.finalize();
+  const std::vector<sre::Triangle>& triangles = mesh.getTriangles();
   sre::Camera camera;
   camera.setWidth(500);
   camera.setHeight(500);
@@ -0,0 +1,46 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../include/Trace.hpp"
+
+// 离线生成核外几何的分块文件：写出时要把整个场景完整加载进内存，
+// 所以在内存足够的机器上运行一次，再把生成的文件连同源文件一起拷到渲染机器上
+// 用法：sre_chunk <场景目录> <配置XML> <输出文件> <每块三角形数> <模型OBJ>...
+// 渲染时 setOutOfCore 要用相同的文件名和每块三角形数，源文件只做哈希校验，
+// 以流式读取，不会被完整加载
+
+int main(int argc, char *argv[]) {
+  if (argc < 6) {
+    std::cout << "usage: sre_chunk <sceneDir> <config.xml> <out.chunks> "
+                 "<chunkTriangles> <model.obj>..."
+              << std::endl;
+    return 1;
+  }
+  std::string pathName = argv[1];
+  std::string configName = argv[2];
+  std::string chunkName = argv[3];
+  long long chunkTriangles = std::atoll(argv[4]);
+  if (chunkTriangles <= 0) {
+    std::cout << "Invalid chunk triangles: " << argv[4] << std::endl;
+    return 1;
+  }
+  std::vector<std::string> modelNames(argv + 5, argv + argc);
+
+  // 总是重新写出；分块文件先写到临时文件再改名，失败时不会留下输出
+  std::remove(chunkName.c_str());
+  sre::Tracer tracer;
+  tracer.setOutOfCore(chunkName, 64 << 20,
+                      static_cast<size_t>(chunkTriangles));
+  tracer.load(pathName, modelNames, configName);
+
+  std::ifstream ifs(chunkName, std::ios::binary);
+  if (!ifs.is_open()) {
+    std::cout << "Chunked scene writing fails!" << std::endl;
+    return 1;
+  }
+  return 0;
+}